@@ -0,0 +1,599 @@
+// bench
+//
+// Times every stage of detection on its own, on synthetic images and on
+// fixture images scaled to several resolutions:
+//
+//   load_jpeg, load_png    decoding a JPEG or PNG in memory to grayscale
+//   pyramid_down           one pyramid_down<6> step of the full image
+//   fhog                   extracting the FHOG features of the full image
+//   apply_filters_to_fhog  applying the detector's first filterbank to them
+//   detect                 a whole scan, as the addon runs it
+//   shape_predictor        predicting the shape in a box a third of the image
+//
+// Every stage runs until it has taken --seconds and at least --iterations
+// calls. The results are printed as a table and, with --json, written as
+// JSON to compare builds.
+//
+// Allocations are counted by replacing operator new, so they cover dlib
+// and the standard library but not the malloc calls of libjpeg and libpng.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "dlib/image_io.h"
+#include "dlib/image_processing.h"
+#include "dlib/image_processing/frontal_face_detector.h"
+#include "dlib/image_transforms.h"
+
+#include "src/detection.h"
+
+static std::atomic<uint64_t> allocations(0);
+static std::atomic<uint64_t> allocatedBytes(0);
+
+static void* CountedAlloc(size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+  void* p = malloc(size == 0 ? 1 : size);
+  if (!p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void* operator new(size_t size) { return CountedAlloc(size); }
+void* operator new[](size_t size) { return CountedAlloc(size); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+  try {
+    return CountedAlloc(size);
+  } catch (std::bad_alloc&) {
+    return NULL;
+  }
+}
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+  try {
+    return CountedAlloc(size);
+  } catch (std::bad_alloc&) {
+    return NULL;
+  }
+}
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+
+namespace ObjectDetector {
+  namespace {
+
+    struct BenchSize {
+      const char* name;
+      long width;
+      long height;
+    };
+
+    const BenchSize kSizes[] = {
+      { "vga", 640, 480 },
+      { "720p", 1280, 720 },
+      { "1080p", 1920, 1080 },
+      { "4k", 3840, 2160 },
+      { "12mp", 4000, 3000 },
+      { "24mp", 6000, 4000 },
+    };
+
+    const char* const kStages[] = {
+      "load_jpeg", "load_png", "pyramid_down", "fhog", "apply_filters_to_fhog", "detect", "shape_predictor"
+    };
+
+    struct BenchOptions {
+      BenchOptions() : seconds(1), iterations(3), synthetic(true) {
+        for (size_t i = 0; i < sizeof(kSizes) / sizeof(kSizes[0]); ++i) {
+          sizes.push_back(kSizes[i].name);
+        }
+        for (size_t i = 0; i < sizeof(kStages) / sizeof(kStages[0]); ++i) {
+          stages.push_back(kStages[i]);
+        }
+      }
+
+      double seconds;
+      uint64_t iterations;
+      std::vector<std::string> sizes;
+      std::vector<std::string> stages;
+      std::vector<std::string> images;
+      std::string detectorPath;
+      std::string predictorPath;
+      std::string jsonPath;
+      bool synthetic;
+    };
+
+    struct BenchResult {
+      std::string stage;
+      std::string image;
+      long width;
+      long height;
+      uint64_t iterations;
+      uint64_t total;
+      uint64_t min;
+      uint64_t max;
+      uint64_t p50;
+      uint64_t p90;
+      uint64_t p99;
+      double allocations;
+      double allocatedBytes;
+    };
+
+    uint64_t Now() {
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // The value at quantile q of sorted samples, by the nearest rank.
+    uint64_t Quantile(const std::vector<uint64_t>& sorted, double q) {
+      size_t rank = static_cast<size_t>(q * sorted.size() + 0.5);
+      return sorted[std::min(std::max<size_t>(rank, 1), sorted.size()) - 1];
+    }
+
+    // Runs fn once to warm up, then until it has run for options.seconds and
+    // options.iterations times.
+    BenchResult Measure(const BenchOptions& options, const std::string& stage, const std::string& image,
+                        long width, long height, const std::function<void()>& fn) {
+      fn();
+
+      std::vector<uint64_t> samples;
+      const uint64_t allocationsBefore = allocations.load();
+      const uint64_t bytesBefore = allocatedBytes.load();
+      const uint64_t budget = static_cast<uint64_t>(options.seconds * 1e9);
+      uint64_t total = 0;
+      while (samples.size() < options.iterations || total < budget) {
+        const uint64_t start = Now();
+        fn();
+        samples.push_back(Now() - start);
+        total += samples.back();
+      }
+
+      BenchResult result;
+      result.stage = stage;
+      result.image = image;
+      result.width = width;
+      result.height = height;
+      result.iterations = samples.size();
+      result.total = total;
+      result.allocations = static_cast<double>(allocations.load() - allocationsBefore) / samples.size();
+      result.allocatedBytes = static_cast<double>(allocatedBytes.load() - bytesBefore) / samples.size();
+
+      std::sort(samples.begin(), samples.end());
+      result.min = samples.front();
+      result.max = samples.back();
+      result.p50 = Quantile(samples, 0.5);
+      result.p90 = Quantile(samples, 0.9);
+      result.p99 = Quantile(samples, 0.99);
+      return result;
+    }
+
+    // A color image with edges at every scale and some noise, so that it
+    // compresses and scans roughly like a photograph rather than a flat
+    // image.
+    void SyntheticImage(long width, long height, dlib::array2d<dlib::rgb_pixel>& img) {
+      dlib::rand rnd;
+      img.set_size(height, width);
+      for (long r = 0; r < height; ++r) {
+        for (long c = 0; c < width; ++c) {
+          const double x = static_cast<double>(c) / width;
+          const double y = static_cast<double>(r) / height;
+          const double wave = 0.5 + 0.25 * std::sin(40 * x * (1 + y)) + 0.25 * std::cos(23 * y + 9 * x * x);
+          const int noise = static_cast<int>(rnd.get_random_32bit_number() % 32) - 16;
+          const int base = static_cast<int>(wave * 200) + noise;
+          img[r][c].red = static_cast<unsigned char>(std::min(255, std::max(0, base + 20)));
+          img[r][c].green = static_cast<unsigned char>(std::min(255, std::max(0, base)));
+          const int check = (r / 16 + c / 16) % 2 == 0 ? 0 : 30;
+          img[r][c].blue = static_cast<unsigned char>(std::min(255, std::max(0, base - 20 + check)));
+        }
+      }
+    }
+
+    std::string ReadFile(const std::string& path) {
+      std::ifstream in(path.c_str(), std::ios::binary);
+      if (!in) {
+        throw std::runtime_error("Unable to read " + path);
+      }
+      return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+
+    // The image encoded as JPEG and as PNG, through a temporary file since
+    // dlib only saves to files.
+    void Encode(const dlib::array2d<dlib::rgb_pixel>& img, std::string& jpeg, std::string& png) {
+      char dir[] = "/tmp/object-detector-bench-XXXXXX";
+      if (!mkdtemp(dir)) {
+        throw std::runtime_error("Unable to create a temporary directory");
+      }
+
+      const std::string jpegPath = std::string(dir) + "/image.jpg";
+      const std::string pngPath = std::string(dir) + "/image.png";
+      dlib::save_jpeg(img, jpegPath, 90);
+      dlib::save_png(img, pngPath);
+      jpeg = ReadFile(jpegPath);
+      png = ReadFile(pngPath);
+
+      unlink(jpegPath.c_str());
+      unlink(pngPath.c_str());
+      rmdir(dir);
+    }
+
+    // A predictor with the dimensions of dlib's 68 point face landmark
+    // model (15 cascades of 500 trees of depth 5 over 500 pixels) and random
+    // values, which costs the same to run as the real one.
+    dlib::shape_predictor SyntheticPredictor() {
+      const unsigned long kParts = 68, kCascades = 15, kTrees = 500, kDepth = 5, kPixels = 500;
+      dlib::rand rnd;
+
+      dlib::matrix<float, 0, 1> initialShape(kParts * 2);
+      for (long i = 0; i < initialShape.size(); ++i) {
+        initialShape(i) = 0.1 + 0.8 * rnd.get_random_float();
+      }
+
+      std::vector<std::vector<dlib::impl::regression_tree> > forests(kCascades);
+      std::vector<std::vector<dlib::vector<float, 2> > > pixels(kCascades);
+      for (unsigned long i = 0; i < kCascades; ++i) {
+        forests[i].resize(kTrees);
+        for (unsigned long t = 0; t < kTrees; ++t) {
+          dlib::impl::regression_tree& tree = forests[i][t];
+          tree.splits.resize((1 << kDepth) - 1);
+          for (unsigned long s = 0; s < tree.splits.size(); ++s) {
+            tree.splits[s].idx1 = rnd.get_random_32bit_number() % kPixels;
+            tree.splits[s].idx2 = rnd.get_random_32bit_number() % kPixels;
+            tree.splits[s].thresh = 64 * (rnd.get_random_float() - 0.5f);
+          }
+          tree.leaf_values.resize(1 << kDepth);
+          for (unsigned long l = 0; l < tree.leaf_values.size(); ++l) {
+            tree.leaf_values[l].set_size(kParts * 2);
+            for (long v = 0; v < tree.leaf_values[l].size(); ++v) {
+              tree.leaf_values[l](v) = 0.002f * (rnd.get_random_float() - 0.5f);
+            }
+          }
+        }
+
+        for (unsigned long p = 0; p < kPixels; ++p) {
+          pixels[i].push_back(dlib::vector<float, 2>(rnd.get_random_float(), rnd.get_random_float()));
+        }
+      }
+
+      return dlib::shape_predictor(initialShape, forests, pixels);
+    }
+
+    bool Wants(const std::vector<std::string>& list, const std::string& name) {
+      return std::find(list.begin(), list.end(), name) != list.end();
+    }
+
+    // Runs the selected stages on one image.
+    void Run(const BenchOptions& options, const std::string& name, const dlib::array2d<dlib::rgb_pixel>& rgb,
+             const object_detector_type& detector, const dlib::shape_predictor& predictor,
+             std::vector<BenchResult>& results) {
+      const long width = rgb.nc(), height = rgb.nr();
+      std::vector<BenchResult> imageResults;
+
+      std::string jpeg, png;
+      if (Wants(options.stages, "load_jpeg") || Wants(options.stages, "load_png")) {
+        Encode(rgb, jpeg, png);
+      }
+
+      dlib::array2d<unsigned char> gray;
+      dlib::assign_image(gray, rgb);
+
+      if (Wants(options.stages, "load_jpeg")) {
+        dlib::array2d<unsigned char> decoded;
+        imageResults.push_back(Measure(options, "load_jpeg", name, width, height, [&]() {
+          dlib::load_image(decoded, reinterpret_cast<const unsigned char*>(jpeg.data()), jpeg.size());
+        }));
+      }
+
+      if (Wants(options.stages, "load_png")) {
+        dlib::array2d<unsigned char> decoded;
+        imageResults.push_back(Measure(options, "load_png", name, width, height, [&]() {
+          dlib::load_image(decoded, reinterpret_cast<const unsigned char*>(png.data()), png.size());
+        }));
+      }
+
+      if (Wants(options.stages, "pyramid_down")) {
+        image_scanner_type::pyramid_type pyr;
+        dlib::array2d<unsigned char> down;
+        imageResults.push_back(Measure(options, "pyramid_down", name, width, height, [&]() {
+          pyr(gray, down);
+        }));
+      }
+
+      // The features of the full image, as the first level of a scan.
+      const image_scanner_type& scanner = detector.get_scanner();
+      const image_scanner_type::feature_extractor_type& fe = scanner.get_feature_extractor();
+      dlib::array<dlib::array2d<float> > feats;
+      const auto extract = [&]() {
+        fe(gray, feats, scanner.get_cell_size(), scanner.get_fhog_window_height(), scanner.get_fhog_window_width());
+      };
+
+      if (Wants(options.stages, "fhog")) {
+        imageResults.push_back(Measure(options, "fhog", name, width, height, extract));
+      }
+
+      if (Wants(options.stages, "apply_filters_to_fhog")) {
+        extract();
+        const image_scanner_type::fhog_filterbank& fb = detector.get_processed_w(0).get_detect_argument();
+        dlib::array2d<float> saliency;
+        imageResults.push_back(Measure(options, "apply_filters_to_fhog", name, width, height, [&]() {
+          dlib::impl::apply_filters_to_fhog(fb, feats, saliency);
+        }));
+      }
+
+      if (Wants(options.stages, "detect")) {
+        DetectionScratch scratch;
+        std::vector<dlib::rect_detection> dets;
+        imageResults.push_back(Measure(options, "detect", name, width, height, [&]() {
+          Detect(detector, gray, 0, scratch, dets);
+        }));
+      }
+
+      if (Wants(options.stages, "shape_predictor")) {
+        const long side = std::min(width, height) / 3;
+        const dlib::rectangle box = dlib::centered_rect(dlib::center(dlib::get_rect(gray)), side, side);
+        imageResults.push_back(Measure(options, "shape_predictor", name, width, height, [&]() {
+          predictor(gray, box);
+        }));
+      }
+
+      for (size_t i = 0; i < imageResults.size(); ++i) {
+        const BenchResult& r = imageResults[i];
+        printf("%-12s %5ldx%-5ld %-22s %8llu  %10.3f  %10.3f  %10.3f  %10.1f  %10.1f  %12.0f\n", r.image.c_str(),
+               r.width, r.height, r.stage.c_str(), static_cast<unsigned long long>(r.iterations), r.p50 / 1e6,
+               r.p90 / 1e6, r.p99 / 1e6, r.iterations / (r.total / 1e9),
+               r.iterations * r.width * r.height / (r.total / 1e9) / 1e6, r.allocations);
+        fflush(stdout);
+      }
+      results.insert(results.end(), imageResults.begin(), imageResults.end());
+    }
+
+    std::string JsonString(const std::string& value) {
+      std::string quoted = "\"";
+      for (size_t i = 0; i < value.size(); ++i) {
+        const unsigned char c = value[i];
+        if (c == '"' || c == '\\') {
+          quoted += '\\';
+          quoted += c;
+        } else if (c < 0x20) {
+          char escaped[8];
+          snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+          quoted += escaped;
+        } else {
+          quoted += c;
+        }
+      }
+      return quoted + "\"";
+    }
+
+    // What the numbers depend on besides the code, to tell builds apart.
+    std::string BuildJson() {
+      std::ostringstream out;
+      out << "{\"compiler\":" << JsonString(__VERSION__) << ",\"optimized\":"
+#ifdef __OPTIMIZE__
+          << "true"
+#else
+          << "false"
+#endif
+          << ",\"asserts\":"
+#ifdef ENABLE_ASSERTS
+          << "true"
+#else
+          << "false"
+#endif
+          << ",\"simd\":[";
+      const char* simd[] = {
+#ifdef __SSE2__
+        "sse2",
+#endif
+#ifdef __SSE4_1__
+        "sse4.1",
+#endif
+#ifdef __AVX__
+        "avx",
+#endif
+#ifdef __AVX2__
+        "avx2",
+#endif
+#ifdef __ARM_NEON
+        "neon",
+#endif
+        NULL
+      };
+      for (size_t i = 0; simd[i]; ++i) {
+        out << (i == 0 ? "" : ",") << JsonString(simd[i]);
+      }
+      out << "],\"hardwareConcurrency\":" << std::thread::hardware_concurrency() << "}";
+      return out.str();
+    }
+
+    std::string ToJson(const BenchOptions& options, const std::vector<BenchResult>& results) {
+      std::ostringstream out;
+      out << "{\"build\":" << BuildJson() << ",\"seconds\":" << options.seconds
+          << ",\"minIterations\":" << options.iterations << ",\"results\":[";
+      for (size_t i = 0; i < results.size(); ++i) {
+        const BenchResult& r = results[i];
+        const double seconds = r.total / 1e9;
+        out << (i == 0 ? "" : ",") << "{\"stage\":" << JsonString(r.stage) << ",\"image\":" << JsonString(r.image)
+            << ",\"width\":" << r.width << ",\"height\":" << r.height << ",\"iterations\":" << r.iterations
+            << ",\"callsPerSecond\":" << r.iterations / seconds
+            << ",\"megapixelsPerSecond\":" << r.iterations * r.width * r.height / seconds / 1e6
+            << ",\"latency\":{\"min\":" << r.min << ",\"mean\":" << r.total / r.iterations << ",\"p50\":" << r.p50
+            << ",\"p90\":" << r.p90 << ",\"p99\":" << r.p99 << ",\"max\":" << r.max << "}"
+            << ",\"allocationsPerCall\":" << r.allocations << ",\"allocatedBytesPerCall\":" << r.allocatedBytes
+            << "}";
+      }
+      out << "]}\n";
+      return out.str();
+    }
+
+    std::vector<std::string> Split(const std::string& list) {
+      std::vector<std::string> items;
+      std::istringstream in(list);
+      std::string item;
+      while (std::getline(in, item, ',')) {
+        if (!item.empty()) {
+          items.push_back(item);
+        }
+      }
+      return items;
+    }
+
+    void Usage() {
+      fprintf(stderr,
+              "Usage: object-detector-bench [options]\n"
+              "  --seconds S        time each stage for at least S seconds (default 1)\n"
+              "  --iterations N     and for at least N calls (default 3)\n"
+              "  --sizes LIST       comma separated, of vga,720p,1080p,4k,12mp,24mp (default all)\n"
+              "  --stages LIST      comma separated, of load_jpeg,load_png,pyramid_down,fhog,\n"
+              "                     apply_filters_to_fhog,detect,shape_predictor (default all)\n"
+              "  --image PATH       also run on this image, scaled to every size (repeatable)\n"
+              "  --no-synthetic     only run on the --image files\n"
+              "  --detector PATH    a detector saved by dlib (default the frontal face detector)\n"
+              "  --predictor PATH   a shape predictor saved by dlib (default a random one the\n"
+              "                     size of the 68 point face landmark model)\n"
+              "  --json PATH        write the results as JSON to PATH\n");
+    }
+
+    bool ParseOptions(int argc, char** argv, BenchOptions& options) {
+      for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--no-synthetic") {
+          options.synthetic = false;
+          continue;
+        }
+        if (i + 1 == argc) {
+          return false;
+        }
+
+        const std::string value = argv[++i];
+        if (arg == "--seconds") {
+          options.seconds = atof(value.c_str());
+        } else if (arg == "--iterations") {
+          options.iterations = std::max(1, atoi(value.c_str()));
+        } else if (arg == "--sizes") {
+          options.sizes = Split(value);
+        } else if (arg == "--stages") {
+          options.stages = Split(value);
+        } else if (arg == "--image") {
+          options.images.push_back(value);
+        } else if (arg == "--detector") {
+          options.detectorPath = value;
+        } else if (arg == "--predictor") {
+          options.predictorPath = value;
+        } else if (arg == "--json") {
+          options.jsonPath = value;
+        } else {
+          return false;
+        }
+      }
+
+      for (size_t i = 0; i < options.stages.size(); ++i) {
+        if (!Wants(std::vector<std::string>(kStages, kStages + sizeof(kStages) / sizeof(kStages[0])),
+                   options.stages[i])) {
+          fprintf(stderr, "Unknown stage %s\n", options.stages[i].c_str());
+          return false;
+        }
+      }
+      return true;
+    }
+
+    int Main(int argc, char** argv) {
+      BenchOptions options;
+      if (!ParseOptions(argc, argv, options)) {
+        Usage();
+        return 2;
+      }
+
+      std::vector<const BenchSize*> sizes;
+      for (size_t i = 0; i < options.sizes.size(); ++i) {
+        const BenchSize* size = NULL;
+        for (size_t j = 0; j < sizeof(kSizes) / sizeof(kSizes[0]); ++j) {
+          if (options.sizes[i] == kSizes[j].name) {
+            size = &kSizes[j];
+          }
+        }
+        if (!size) {
+          fprintf(stderr, "Unknown size %s\n", options.sizes[i].c_str());
+          Usage();
+          return 2;
+        }
+        sizes.push_back(size);
+      }
+
+      object_detector_type detector;
+      if (options.detectorPath.empty()) {
+        detector = dlib::get_frontal_face_detector();
+      } else {
+        dlib::deserialize(options.detectorPath) >> detector;
+      }
+
+      dlib::shape_predictor predictor;
+      if (options.predictorPath.empty()) {
+        predictor = SyntheticPredictor();
+      } else {
+        dlib::deserialize(options.predictorPath) >> predictor;
+      }
+
+      std::vector<std::pair<std::string, dlib::array2d<dlib::rgb_pixel> > > fixtures(options.images.size());
+      for (size_t i = 0; i < options.images.size(); ++i) {
+        const std::string& path = options.images[i];
+        fixtures[i].first = path.substr(path.find_last_of('/') + 1);
+        dlib::load_image(fixtures[i].second, path);
+      }
+
+      printf("%-12s %-11s %-22s %8s  %10s  %10s  %10s  %10s  %10s  %12s\n", "image", "size", "stage", "calls",
+             "p50 ms", "p90 ms", "p99 ms", "calls/s", "MP/s", "allocs/call");
+
+      std::vector<BenchResult> results;
+      for (size_t s = 0; s < sizes.size(); ++s) {
+        dlib::array2d<dlib::rgb_pixel> img;
+        if (options.synthetic) {
+          SyntheticImage(sizes[s]->width, sizes[s]->height, img);
+          Run(options, "synthetic", img, detector, predictor, results);
+        }
+
+        for (size_t i = 0; i < fixtures.size(); ++i) {
+          img.set_size(sizes[s]->height, sizes[s]->width);
+          dlib::resize_image(fixtures[i].second, img);
+          Run(options, fixtures[i].first, img, detector, predictor, results);
+        }
+      }
+
+      if (!options.jsonPath.empty()) {
+        std::ofstream out(options.jsonPath.c_str());
+        out << ToJson(options, results);
+        if (!out) {
+          fprintf(stderr, "Unable to write %s\n", options.jsonPath.c_str());
+          return 1;
+        }
+      }
+      return 0;
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  try {
+    return ObjectDetector::Main(argc, argv);
+  } catch (std::exception& e) {
+    fprintf(stderr, "%s\n", e.what());
+    return 1;
+  }
+}
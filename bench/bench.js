@@ -0,0 +1,350 @@
+'use strict';
+
+// End-to-end benchmark of the JS API: sync and async detection from files,
+// async detection from Buffers and batched detection, at every concurrency
+// from 1 up to --max-concurrency, with the built-in face detector and,
+// given --model or --train, a custom model.
+//
+//   node bench/bench.js --images DIR_OR_FILE... [options]
+//
+// For every run it reports images per second, p50/p99 latency, the event
+// loop delay while the run was going and the peak RSS, as a table and, with
+// --json, as JSON to compare versions of the addon.
+
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+
+const USAGE = `Usage: node bench/bench.js --images PATH... [options]
+  --images PATH...        image files, or directories of them, to detect in
+  --model PATH            also bench this saved detector
+  --train XML             also bench a detector trained on this imglab XML
+  --modes LIST            comma separated, of sync,async,buffer,batch (default all)
+  --max-concurrency N     sweep concurrency 1, 2, 4, ... up to N (default the CPU count)
+  --duration S            seconds per run (default 5)
+  --warmup N              detections before every run (default 3)
+  --json PATH             write the results as JSON to PATH`;
+
+function parseArgs(argv) {
+  const options = {
+    images: [],
+    model: null,
+    train: null,
+    modes: ['sync', 'async', 'buffer', 'batch'],
+    maxConcurrency: os.cpus().length,
+    duration: 5,
+    warmup: 3,
+    json: null
+  };
+
+  for (let i = 0; i < argv.length; ++i) {
+    const arg = argv[i];
+    const next = () => {
+      if (i + 1 >= argv.length) {
+        throw new Error(`${arg} needs a value`);
+      }
+      return argv[++i];
+    };
+
+    if (arg === '--images') {
+      while (i + 1 < argv.length && !argv[i + 1].startsWith('--')) {
+        options.images.push(argv[++i]);
+      }
+    } else if (arg === '--model') {
+      options.model = next();
+    } else if (arg === '--train') {
+      options.train = next();
+    } else if (arg === '--modes') {
+      options.modes = next().split(',').filter(Boolean);
+    } else if (arg === '--max-concurrency') {
+      options.maxConcurrency = Math.max(1, parseInt(next(), 10));
+    } else if (arg === '--duration') {
+      options.duration = parseFloat(next());
+    } else if (arg === '--warmup') {
+      options.warmup = Math.max(0, parseInt(next(), 10));
+    } else if (arg === '--json') {
+      options.json = next();
+    } else if (arg === '--help' || arg === '-h') {
+      console.log(USAGE);
+      process.exit(0);
+    } else {
+      throw new Error(`Unknown option ${arg}`);
+    }
+  }
+
+  for (const mode of options.modes) {
+    if (['sync', 'async', 'buffer', 'batch'].indexOf(mode) < 0) {
+      throw new Error(`Unknown mode ${mode}`);
+    }
+  }
+  if (!(options.duration > 0) || !(options.maxConcurrency >= 1)) {
+    throw new Error('--duration and --max-concurrency must be positive');
+  }
+  return options;
+}
+
+function findImages(paths) {
+  const images = [];
+  for (const p of paths) {
+    if (fs.statSync(p).isDirectory()) {
+      for (const name of fs.readdirSync(p).sort()) {
+        if (/\.(jpe?g|png)$/i.test(name)) {
+          images.push(path.join(p, name));
+        }
+      }
+    } else {
+      images.push(p);
+    }
+  }
+  return images;
+}
+
+// 1, 2, 4, ... and max itself.
+function concurrencyLevels(max) {
+  const levels = [];
+  for (let c = 1; c < max; c *= 2) {
+    levels.push(c);
+  }
+  levels.push(max);
+  return levels;
+}
+
+function percentile(sorted, q) {
+  if (sorted.length === 0) {
+    return 0;
+  }
+  const rank = Math.min(sorted.length, Math.max(1, Math.round(q * sorted.length)));
+  return sorted[rank - 1];
+}
+
+function nowMs() {
+  const [seconds, nanoseconds] = process.hrtime();
+  return seconds * 1e3 + nanoseconds / 1e6;
+}
+
+// How often the event loop delay and the RSS are sampled, in ms.
+const SAMPLE_INTERVAL = 10;
+
+// Watches the event loop and the RSS for the length of one run. The delay
+// comes from perf_hooks where Node.js has it, and from the drift of a timer
+// otherwise.
+class Monitor {
+  constructor() {
+    this.peakRss = process.memoryUsage().rss;
+    this.drift = [];
+
+    let histogram = null;
+    try {
+      histogram = require('perf_hooks').monitorEventLoopDelay({ resolution: SAMPLE_INTERVAL });
+    } catch (e) {
+      histogram = null;
+    }
+    this.histogram = histogram;
+    if (histogram) {
+      histogram.enable();
+    }
+
+    let expected = nowMs() + SAMPLE_INTERVAL;
+    this.timer = setInterval(() => {
+      const now = nowMs();
+      this.drift.push(Math.max(0, now - expected));
+      expected = now + SAMPLE_INTERVAL;
+      this.peakRss = Math.max(this.peakRss, process.memoryUsage().rss);
+    }, SAMPLE_INTERVAL);
+  }
+
+  stop() {
+    clearInterval(this.timer);
+    this.peakRss = Math.max(this.peakRss, process.memoryUsage().rss);
+
+    if (this.histogram) {
+      // The histogram measures the time between samples, which includes
+      // the interval itself.
+      this.histogram.disable();
+      const delay = (ns) => Math.max(0, ns / 1e6 - SAMPLE_INTERVAL);
+      return {
+        p50: delay(this.histogram.percentile(50)),
+        p99: delay(this.histogram.percentile(99)),
+        max: delay(this.histogram.max),
+        peakRss: this.peakRss
+      };
+    }
+
+    const sorted = this.drift.slice().sort((a, b) => a - b);
+    return {
+      p50: percentile(sorted, 0.5),
+      p99: percentile(sorted, 0.99),
+      max: sorted.length ? sorted[sorted.length - 1] : 0,
+      peakRss: this.peakRss
+    };
+  }
+}
+
+// Keeps `concurrency` calls of detectOne in flight until the time is up,
+// recording the latency of each. After a sync call the event loop is let
+// run once, as a server would between requests, so that the delay the call
+// caused gets measured.
+async function closedLoop(detectOne, count, concurrency, durationMs) {
+  const latencies = [];
+  const end = nowMs() + durationMs;
+  let next = 0;
+
+  async function lane() {
+    while (nowMs() < end) {
+      const index = next++ % count;
+      const start = nowMs();
+      const pending = detectOne(index);
+      if (pending instanceof Promise) {
+        await pending;
+        latencies.push(nowMs() - start);
+      } else {
+        latencies.push(nowMs() - start);
+        await new Promise((resolve) => setImmediate(resolve));
+      }
+    }
+  }
+
+  const lanes = [];
+  for (let i = 0; i < concurrency; ++i) {
+    lanes.push(lane());
+  }
+  await Promise.all(lanes);
+  return { images: latencies.length, latencies };
+}
+
+// Runs batches of every image with the given concurrency until the time is
+// up. Latency is per image, from the start of its batch to its onResult.
+async function batchLoop(detector, images, concurrency, durationMs) {
+  const latencies = [];
+  const end = nowMs() + durationMs;
+
+  while (nowMs() < end) {
+    const start = nowMs();
+    await detector.detectInImageFiles(images, {
+      concurrency,
+      onResult: () => latencies.push(nowMs() - start)
+    });
+  }
+  return { images: latencies.length, latencies };
+}
+
+async function run(detector, modelName, mode, concurrency, images, buffers, options) {
+  const detectOne = {
+    sync: (i) => detector.detectInImageFile(images[i]),
+    async: (i) => detector.detectInImageFileAsync(images[i]),
+    buffer: (i) => detector.detectInBufferAsync(buffers[i]),
+    batch: null
+  }[mode];
+
+  for (let i = 0; i < options.warmup; ++i) {
+    await detector.detectInImageFileAsync(images[i % images.length]);
+  }
+  if (global.gc) {
+    global.gc();
+  }
+
+  const monitor = new Monitor();
+  const start = nowMs();
+  const durationMs = options.duration * 1e3;
+  const result = mode === 'batch'
+    ? await batchLoop(detector, images, concurrency, durationMs)
+    : await closedLoop(detectOne, images.length, concurrency, durationMs);
+  const elapsed = nowMs() - start;
+  const loop = monitor.stop();
+
+  const sorted = result.latencies.sort((a, b) => a - b);
+  return {
+    model: modelName,
+    mode,
+    concurrency,
+    images: result.images,
+    seconds: elapsed / 1e3,
+    imagesPerSecond: result.images / (elapsed / 1e3),
+    latencyMs: { p50: percentile(sorted, 0.5), p99: percentile(sorted, 0.99), max: sorted[sorted.length - 1] || 0 },
+    eventLoopDelayMs: { p50: loop.p50, p99: loop.p99, max: loop.max },
+    peakRssBytes: loop.peakRss
+  };
+}
+
+function printRow(r) {
+  const cells = [
+    r.model.padEnd(14), r.mode.padEnd(7), String(r.concurrency).padStart(4),
+    String(r.images).padStart(7), r.imagesPerSecond.toFixed(1).padStart(9),
+    r.latencyMs.p50.toFixed(1).padStart(9), r.latencyMs.p99.toFixed(1).padStart(9),
+    r.eventLoopDelayMs.p50.toFixed(1).padStart(9), r.eventLoopDelayMs.p99.toFixed(1).padStart(9),
+    (r.peakRssBytes / 1048576).toFixed(0).padStart(8)
+  ];
+  console.log(cells.join(' '));
+}
+
+async function main() {
+  let options;
+  try {
+    options = parseArgs(process.argv.slice(2));
+  } catch (err) {
+    console.error(`${err.message}\n${USAGE}`);
+    process.exit(2);
+  }
+
+  const images = findImages(options.images);
+  if (images.length === 0) {
+    console.error(`No images to detect in.\n${USAGE}`);
+    process.exit(2);
+  }
+
+  // libuv sizes its thread pool on first use, and the scheduler reads the
+  // same variable, so it has to be set before the addon is loaded.
+  if (!process.env.UV_THREADPOOL_SIZE) {
+    process.env.UV_THREADPOOL_SIZE = String(options.maxConcurrency);
+  }
+  const addon = require('..');
+  addon.configureScheduler({ concurrency: options.maxConcurrency });
+
+  const models = [{ name: 'frontal_face', detector: addon.createDetector() }];
+  if (options.model) {
+    models.push({ name: path.basename(options.model), detector: addon.createDetector(options.model) });
+  }
+  if (options.train) {
+    console.error(`Training on ${options.train}...`);
+    models.push({ name: 'trained', detector: await addon.trainFromXMLAsync(options.train) });
+  }
+
+  const buffers = images.map((image) => fs.readFileSync(image));
+  const results = [];
+
+  console.log(['model'.padEnd(14), 'mode'.padEnd(7), 'conc'.padStart(4), 'images'.padStart(7),
+    'img/s'.padStart(9), 'p50 ms'.padStart(9), 'p99 ms'.padStart(9), 'loop p50'.padStart(9),
+    'loop p99'.padStart(9), 'rss MB'.padStart(8)].join(' '));
+
+  for (const model of models) {
+    for (const mode of options.modes) {
+      // Sync calls block the event loop, so only one can be in flight.
+      const levels = mode === 'sync' ? [1] : concurrencyLevels(options.maxConcurrency);
+      for (const concurrency of levels) {
+        const result = await run(model.detector, model.name, mode, concurrency, images, buffers, options);
+        printRow(result);
+        results.push(result);
+      }
+    }
+  }
+
+  if (options.json) {
+    const report = {
+      node: process.version,
+      addon: require('../package.json').version,
+      platform: `${os.platform()} ${os.arch()}`,
+      cpus: os.cpus().length,
+      cpuModel: os.cpus()[0] ? os.cpus()[0].model : null,
+      threadPoolSize: parseInt(process.env.UV_THREADPOOL_SIZE, 10),
+      images: images.map((image) => path.basename(image)),
+      duration: options.duration,
+      results
+    };
+    fs.writeFileSync(options.json, JSON.stringify(report, null, 2) + '\n');
+  }
+}
+
+main().catch((err) => {
+  console.error(err.message);
+  process.exit(1);
+});
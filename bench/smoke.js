@@ -0,0 +1,115 @@
+'use strict';
+
+// Smoke test run by `npm test`: checks a few results of the addon on a
+// generated image, then runs bench/bench.js on it briefly in every mode, so
+// that sync, async, Buffer and batched detection all get exercised.
+
+const assert = require('assert');
+const childProcess = require('child_process');
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+const zlib = require('zlib');
+
+const WIDTH = 640;
+const HEIGHT = 480;
+
+const CRC_TABLE = [];
+for (let n = 0; n < 256; ++n) {
+  let c = n;
+  for (let k = 0; k < 8; ++k) {
+    c = c & 1 ? 0xedb88320 ^ (c >>> 1) : c >>> 1;
+  }
+  CRC_TABLE.push(c >>> 0);
+}
+
+function crc32(bytes) {
+  let c = 0xffffffff;
+  for (const byte of bytes) {
+    c = CRC_TABLE[(c ^ byte) & 0xff] ^ (c >>> 8);
+  }
+  return (c ^ 0xffffffff) >>> 0;
+}
+
+function pngChunk(type, data) {
+  const length = Buffer.alloc(4);
+  length.writeUInt32BE(data.length, 0);
+  const body = Buffer.concat([Buffer.from(type, 'latin1'), data]);
+  const crc = Buffer.alloc(4);
+  crc.writeUInt32BE(crc32(body), 0);
+  return Buffer.concat([length, body, crc]);
+}
+
+// Rings and stripes, so that the features have edges of every orientation.
+function makePixels() {
+  const pixels = new Uint8Array(WIDTH * HEIGHT);
+  for (let y = 0; y < HEIGHT; ++y) {
+    for (let x = 0; x < WIDTH; ++x) {
+      const r = Math.hypot(x - WIDTH / 2, y - HEIGHT / 2);
+      pixels[y * WIDTH + x] = 128 + 60 * Math.sin(r / 6) + 60 * Math.sin((x + 2 * y) / 11);
+    }
+  }
+  return pixels;
+}
+
+// An 8-bit grayscale PNG of the pixels.
+function encodePng(pixels) {
+  const header = Buffer.alloc(13);
+  header.writeUInt32BE(WIDTH, 0);
+  header.writeUInt32BE(HEIGHT, 4);
+  header[8] = 8;
+  const rows = Buffer.alloc((WIDTH + 1) * HEIGHT);
+  for (let y = 0; y < HEIGHT; ++y) {
+    rows.set(pixels.subarray(y * WIDTH, (y + 1) * WIDTH), y * (WIDTH + 1) + 1);
+  }
+  return Buffer.concat([
+    Buffer.from([0x89, 0x50, 0x4e, 0x47, 0x0d, 0x0a, 0x1a, 0x0a]),
+    pngChunk('IHDR', header),
+    pngChunk('IDAT', zlib.deflateSync(rows)),
+    pngChunk('IEND', Buffer.alloc(0))
+  ]);
+}
+
+async function main() {
+  const addon = require('..');
+  const pixels = makePixels();
+  const png = encodePng(pixels);
+  const dir = fs.mkdtempSync(path.join(os.tmpdir(), 'object-detector-'));
+  const image = path.join(dir, 'smoke.png');
+  fs.writeFileSync(image, png);
+
+  try {
+    const info = addon.probeImage(image);
+    assert.deepStrictEqual(
+      [info.format, info.width, info.height, info.channels, info.bitDepth], ['png', WIDTH, HEIGHT, 1, 8]);
+    assert.strictEqual(addon.probeImage(png).width, WIDTH);
+
+    // The same image from a file, a Buffer and raw pixels, synchronously and
+    // not, finds the same detections.
+    const detector = addon.createDetector();
+    const options = { adjustThreshold: -1.5 };
+    const expected = detector.detectInImageFile(image, options);
+    assert(Array.isArray(expected));
+    assert.deepStrictEqual(detector.detectInBuffer(png, options), expected);
+    assert.deepStrictEqual(detector.detectInPixels({ data: pixels, width: WIDTH, height: HEIGHT }, options), expected);
+    assert.deepStrictEqual(await detector.detectInImageFileAsync(image, options), expected);
+    assert.deepStrictEqual(await detector.detectInBufferAsync(png, options), expected);
+    assert.deepStrictEqual(
+      detector.detectInImageFile(image, Object.assign({ memoryBudget: 2.4e6, tileThreads: 2 }, options)), expected);
+
+    childProcess.execFileSync(process.execPath, [
+      path.join(__dirname, 'bench.js'), '--images', image, '--duration', '0.2', '--warmup', '1',
+      '--max-concurrency', '2'
+    ], { stdio: 'inherit' });
+  } finally {
+    fs.unlinkSync(image);
+    fs.rmdirSync(dir);
+  }
+
+  console.log('ok');
+}
+
+main().catch((err) => {
+  console.error(err.stack || err.message);
+  process.exit(1);
+});
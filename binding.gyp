@@ -2,7 +2,7 @@
   'targets': [
     {
       'target_name': 'object-detector',
-      'sources': [ 'src/addon.cpp', 'src/detector.cpp', 'src/predictor.cpp', 'dlib/all/source.cpp' ],
+      'sources': [ 'src/addon.cpp', 'src/addon_data.cpp', 'src/detector.cpp', 'src/predictor.cpp', 'src/worker.cpp', 'src/scheduler.cpp', 'src/training.cpp', 'src/metrics.cpp', 'src/model_file.cpp', 'src/mapped_file.cpp', 'src/mapped_shape_predictor.cpp', 'src/image_source.cpp', 'src/image_probe.cpp', 'src/trace.cpp', 'src/property_names.cpp', 'dlib/all/source.cpp' ],
       'libraries': [ '-lpng', '-ljpeg'],
       'include_dirs': [ './' ],
       'defines': [ 'DLIB_JPEG_SUPPORT', 'DLIB_PNG_SUPPORT', 'DLIB_NO_GUI_SUPPORT' ],
@@ -21,6 +21,39 @@
         }]
       ]
     }
+  ],
+  'variables': {
+    # GYP_DEFINES=build_bench=1 also builds object-detector-bench, which
+    # times every stage of detection (see bench/bench.cpp).
+    'build_bench%': 0
+  },
+  'conditions': [
+    ['build_bench==1', {
+      'targets': [
+        {
+          'target_name': 'object-detector-bench',
+          'type': 'executable',
+          'sources': [ 'bench/bench.cpp', 'src/metrics.cpp', 'src/trace.cpp', 'dlib/all/source.cpp' ],
+          'libraries': [ '-lpng', '-ljpeg', '-lpthread' ],
+          'include_dirs': [ './' ],
+          'defines': [ 'DLIB_JPEG_SUPPORT', 'DLIB_PNG_SUPPORT', 'DLIB_NO_GUI_SUPPORT' ],
+          'cflags!': [ '-fno-exceptions', '-fno-rtti' ],
+          'cflags_cc!': [ '-fno-exceptions', '-fno-rtti' ],
+          'conditions': [
+            ['OS=="mac"', {
+              'xcode_settings': {
+                'GCC_ENABLE_CPP_EXCEPTIONS': 'YES',
+                'GCC_ENABLE_CPP_RTTI': 'YES'
+              },
+              'include_dirs': [
+                'include', '/usr/local/include'
+              ],
+              'libraries': [ '-L/usr/local/lib'],
+            }]
+          ]
+        }
+      ]
+    }]
   ]
 }
 
@@ -16,34 +16,133 @@
 #else
 #   include <jpeglib.h>
 #endif
+#include <algorithm>
 #include <sstream>
 #include <setjmp.h>
 
 namespace dlib
 {
 
+// ----------------------------------------------------------------------------------------
+
+    static std::FILE* jpeg_loader_open_file( const char* filename )
+    {
+        if ( filename == NULL )
+        {
+            throw image_load_error("jpeg_loader: invalid filename, it is NULL");
+        }
+        std::FILE *fp = fopen( filename, "rb" );
+        if ( !fp )
+        {
+            throw image_load_error(std::string("jpeg_loader: unable to open file ") + filename);
+        }
+        return fp;
+    }
+
 // ----------------------------------------------------------------------------------------
 
     jpeg_loader::
-    jpeg_loader( const char* filename ) : height_( 0 ), width_( 0 ), output_components_(0)
+    jpeg_loader( const char* filename ) : height_( 0 ), width_( 0 ), output_components_(0), original_height_(0), original_width_(0), scale_denom_(1)
     {
-        read_image( filename );
+        std::FILE *fp = jpeg_loader_open_file( filename );
+        read_image( fp, NULL, 0, std::string("file ") + filename );
+        fclose( fp );
     }
 
 // ----------------------------------------------------------------------------------------
 
     jpeg_loader::
-    jpeg_loader( const std::string& filename ) : height_( 0 ), width_( 0 ), output_components_(0)
+    jpeg_loader( const std::string& filename ) : height_( 0 ), width_( 0 ), output_components_(0), original_height_(0), original_width_(0), scale_denom_(1)
     {
-        read_image( filename.c_str() );
+        std::FILE *fp = jpeg_loader_open_file( filename.c_str() );
+        read_image( fp, NULL, 0, "file " + filename );
+        fclose( fp );
     }
 
 // ----------------------------------------------------------------------------------------
 
     jpeg_loader::
-    jpeg_loader( const dlib::file& f ) : height_( 0 ), width_( 0 ), output_components_(0)
+    jpeg_loader( const dlib::file& f ) : height_( 0 ), width_( 0 ), output_components_(0), original_height_(0), original_width_(0), scale_denom_(1)
     {
-        read_image( f.full_name().c_str() );
+        std::FILE *fp = jpeg_loader_open_file( f.full_name().c_str() );
+        read_image( fp, NULL, 0, "file " + f.full_name() );
+        fclose( fp );
+    }
+
+// ----------------------------------------------------------------------------------------
+
+    jpeg_loader::
+    jpeg_loader( const unsigned char* imgbuffer, size_t buffersize ) : height_( 0 ), width_( 0 ), output_components_(0), original_height_(0), original_width_(0), scale_denom_(1)
+    {
+        if ( imgbuffer == NULL || buffersize == 0 )
+        {
+            throw image_load_error("jpeg_loader: invalid buffer, it is empty");
+        }
+        read_image( NULL, imgbuffer, buffersize, "memory buffer" );
+    }
+
+// ----------------------------------------------------------------------------------------
+
+    jpeg_loader::
+    jpeg_loader( 
+        const std::string& filename,
+        unsigned long max_scale_denom,
+        unsigned long min_size
+    ) : height_( 0 ), width_( 0 ), output_components_(0), original_height_(0), original_width_(0), scale_denom_(1)
+    {
+        std::FILE *fp = jpeg_loader_open_file( filename.c_str() );
+        read_image( fp, NULL, 0, "file " + filename, max_scale_denom, min_size );
+        fclose( fp );
+    }
+
+// ----------------------------------------------------------------------------------------
+
+    jpeg_loader::
+    jpeg_loader( 
+        const unsigned char* imgbuffer,
+        size_t buffersize,
+        unsigned long max_scale_denom,
+        unsigned long min_size
+    ) : height_( 0 ), width_( 0 ), output_components_(0), original_height_(0), original_width_(0), scale_denom_(1)
+    {
+        if ( imgbuffer == NULL || buffersize == 0 )
+        {
+            throw image_load_error("jpeg_loader: invalid buffer, it is empty");
+        }
+        read_image( NULL, imgbuffer, buffersize, "memory buffer", max_scale_denom, min_size );
+    }
+
+// ----------------------------------------------------------------------------------------
+
+    jpeg_loader::
+    jpeg_loader( 
+        const std::string& filename,
+        unsigned long max_scale_denom,
+        unsigned long min_size,
+        array2d<unsigned char>& gray_image
+    ) : height_( 0 ), width_( 0 ), output_components_(0), original_height_(0), original_width_(0), scale_denom_(1)
+    {
+        std::FILE *fp = jpeg_loader_open_file( filename.c_str() );
+        read_image( fp, NULL, 0, "file " + filename, max_scale_denom, min_size, &gray_image );
+        fclose( fp );
+    }
+
+// ----------------------------------------------------------------------------------------
+
+    jpeg_loader::
+    jpeg_loader( 
+        const unsigned char* imgbuffer,
+        size_t buffersize,
+        unsigned long max_scale_denom,
+        unsigned long min_size,
+        array2d<unsigned char>& gray_image
+    ) : height_( 0 ), width_( 0 ), output_components_(0), original_height_(0), original_width_(0), scale_denom_(1)
+    {
+        if ( imgbuffer == NULL || buffersize == 0 )
+        {
+            throw image_load_error("jpeg_loader: invalid buffer, it is empty");
+        }
+        read_image( NULL, imgbuffer, buffersize, "memory buffer", max_scale_denom, min_size, &gray_image );
     }
 
 // ----------------------------------------------------------------------------------------
@@ -79,18 +178,10 @@ namespace dlib
 
 // ----------------------------------------------------------------------------------------
 
-    void jpeg_loader::read_image( const char* filename )
+    void jpeg_loader::read_image( std::FILE* file, const unsigned char* imgbuffer, size_t buffersize, const std::string& source,
+                                  unsigned long max_scale_denom, unsigned long min_size,
+                                  array2d<unsigned char>* gray_image )
     {
-        if ( filename == NULL )
-        {
-            throw image_load_error("jpeg_loader: invalid filename, it is NULL");
-        }
-        FILE *fp = fopen( filename, "rb" );
-        if ( !fp )
-        {
-            throw image_load_error(std::string("jpeg_loader: unable to open file ") + filename);
-        }
-
         jpeg_decompress_struct cinfo;
         jpeg_loader_error_mgr jerr;
 
@@ -105,17 +196,46 @@ namespace dlib
              * We need to clean up the JPEG object, close the input file, and return.
              */
             jpeg_destroy_decompress(&cinfo);
-            fclose(fp);
-            throw image_load_error(std::string("jpeg_loader: error while reading ") + filename);
+            if (file != NULL)
+                fclose(file);
+            throw image_load_error("jpeg_loader: error while reading " + source);
         }
 
 
         jpeg_create_decompress(&cinfo);
 
-        jpeg_stdio_src(&cinfo, fp);
+        if (file != NULL)
+            jpeg_stdio_src(&cinfo, file);
+        else
+            jpeg_mem_src(&cinfo, const_cast<unsigned char*>(imgbuffer), buffersize);
 
         jpeg_read_header(&cinfo, TRUE);
 
+        original_width_ = cinfo.image_width;
+        original_height_ = cinfo.image_height;
+
+        // libjpeg scales by 1/2, 1/4 and 1/8 while computing the inverse DCT,
+        // which skips most of the decoding work.  Pick the smallest of those
+        // that keeps the larger side at least min_size pixels long.
+        const unsigned long larger_side = std::max(original_width_, original_height_);
+        scale_denom_ = 1;
+        while (scale_denom_*2 <= max_scale_denom && scale_denom_*2 <= 8 &&
+               (larger_side + scale_denom_*2 - 1)/(scale_denom_*2) >= min_size)
+        {
+            scale_denom_ *= 2;
+        }
+        cinfo.scale_num = 1;
+        cinfo.scale_denom = scale_denom_;
+
+        // Asking for luminance only lets libjpeg skip the inverse DCT and
+        // upsampling of the chroma components, and the color conversion.
+        // libjpeg only derives grayscale from YCbCr and grayscale images.
+        if (gray_image != NULL &&
+            (cinfo.jpeg_color_space == JCS_YCbCr || cinfo.jpeg_color_space == JCS_GRAYSCALE))
+        {
+            cinfo.out_color_space = JCS_GRAYSCALE;
+        }
+
         jpeg_start_decompress(&cinfo);
 
         height_ = cinfo.output_height;
@@ -125,33 +245,85 @@ namespace dlib
         if (output_components_ != 1 && 
             output_components_ != 3)
         {
-            fclose( fp );
             jpeg_destroy_decompress(&cinfo);
+            if (file != NULL)
+                fclose(file);
             std::ostringstream sout;
-            sout << "jpeg_loader: Unsupported number of colors (" << output_components_ << ") in file " << filename;
+            sout << "jpeg_loader: Unsupported number of colors (" << output_components_ << ") in " << source;
             throw image_load_error(sout.str());
         }
 
-        std::vector<unsigned char*> rows;
-        rows.resize(height_);
-
-        // size the image buffer
-        data.resize(height_*width_*output_components_);
-
-        // setup pointers to each row
-        for (unsigned long i = 0; i < rows.size(); ++i)
-            rows[i] = &data[i*width_*output_components_];
-
-        // read the data into the buffer
-        while (cinfo.output_scanline < cinfo.output_height)
+        if (gray_image != NULL)
         {
-            jpeg_read_scanlines(&cinfo, &rows[cinfo.output_scanline], 100);
+            read_gray_rows(&cinfo, *gray_image);
+        }
+        else
+        {
+            // size the image buffer
+            data.resize(height_*width_*output_components_);
+
+            // read the data into the buffer, a few rows at a time
+            JSAMPROW rows[16];
+            while (cinfo.output_scanline < cinfo.output_height)
+            {
+                const unsigned long first = cinfo.output_scanline;
+                const unsigned long count = std::min<unsigned long>(16, height_ - first);
+                for (unsigned long i = 0; i < count; ++i)
+                    rows[i] = &data[(first + i)*width_*output_components_];
+                jpeg_read_scanlines(&cinfo, rows, count);
+            }
         }
 
         jpeg_finish_decompress(&cinfo);
         jpeg_destroy_decompress(&cinfo);
+    }
 
-        fclose( fp );
+// ----------------------------------------------------------------------------------------
+
+    void jpeg_loader::read_gray_rows( void* decompress, array2d<unsigned char>& gray_image )
+    {
+        jpeg_decompress_struct& cinfo = *static_cast<jpeg_decompress_struct*>(decompress);
+
+        gray_image.set_size(height_, width_);
+        if (output_components_ == 1)
+        {
+            // Scanlines go straight into the rows of the image.
+            JSAMPROW rows[16];
+            while (cinfo.output_scanline < cinfo.output_height)
+            {
+                const unsigned long first = cinfo.output_scanline;
+                const unsigned long count = std::min<unsigned long>(16, height_ - first);
+                for (unsigned long i = 0; i < count; ++i)
+                    rows[i] = &gray_image[first + i][0];
+                jpeg_read_scanlines(&cinfo, rows, count);
+            }
+        }
+        else
+        {
+            // Images libjpeg can't turn gray are converted one row at a time,
+            // the same way get_image() does.
+            data.resize(width_*output_components_);
+            JSAMPROW row = &data[0];
+            while (cinfo.output_scanline < cinfo.output_height)
+            {
+                const unsigned long r = cinfo.output_scanline;
+                jpeg_read_scanlines(&cinfo, &row, 1);
+                for (unsigned long c = 0; c < width_; ++c)
+                {
+                    rgb_pixel p;
+                    p.red = data[c*3];
+                    p.green = data[c*3+1];
+                    p.blue = data[c*3+2];
+                    assign_pixel(gray_image[r][c], p);
+                }
+            }
+        }
+
+        // Nothing is kept in this object, so get_image() gives an empty image.
+        data.clear();
+        height_ = 0;
+        width_ = 0;
+        output_components_ = 1;
     }
 
 // ----------------------------------------------------------------------------------------
@@ -8,7 +8,9 @@
 #include "image_loader.h"
 #include "../pixel.h"
 #include "../dir_nav.h"
+#include "../array2d.h"
 #include <vector>
+#include <cstdio>
 
 namespace dlib
 {
@@ -20,10 +22,21 @@ namespace dlib
         jpeg_loader( const char* filename );
         jpeg_loader( const std::string& filename );
         jpeg_loader( const dlib::file& f );
+        jpeg_loader( const unsigned char* imgbuffer, size_t buffersize );
+        jpeg_loader( const std::string& filename, unsigned long max_scale_denom, unsigned long min_size );
+        jpeg_loader( const unsigned char* imgbuffer, size_t buffersize, unsigned long max_scale_denom, unsigned long min_size );
+        jpeg_loader( const std::string& filename, unsigned long max_scale_denom, unsigned long min_size,
+                     array2d<unsigned char>& gray_image );
+        jpeg_loader( const unsigned char* imgbuffer, size_t buffersize, unsigned long max_scale_denom, unsigned long min_size,
+                     array2d<unsigned char>& gray_image );
 
         bool is_gray() const;
         bool is_rgb() const;
 
+        unsigned long original_width() const { return original_width_; }
+        unsigned long original_height() const { return original_height_; }
+        unsigned long scale_denom() const { return scale_denom_; }
+
         template<typename T>
         void get_image( T& t_) const
         {
@@ -67,10 +80,16 @@ namespace dlib
             return &data[i*width_*output_components_];
         }
 
-        void read_image( const char* filename );
+        void read_image( std::FILE* file, const unsigned char* imgbuffer, size_t buffersize, const std::string& source,
+                         unsigned long max_scale_denom = 1, unsigned long min_size = 0,
+                         array2d<unsigned char>* gray_image = NULL );
+        void read_gray_rows( void* cinfo, array2d<unsigned char>& gray_image );
         unsigned long height_; 
         unsigned long width_;
         unsigned long output_components_;
+        unsigned long original_height_;
+        unsigned long original_width_;
+        unsigned long scale_denom_;
         std::vector<unsigned char> data;
     };
 
@@ -87,6 +106,41 @@ namespace dlib
         jpeg_loader(file_name).get_image(image);
     }
 
+// ----------------------------------------------------------------------------------------
+
+    template <
+        typename image_type
+        >
+    void load_jpeg (
+        image_type& image,
+        const unsigned char* imgbuffer,
+        size_t buffersize
+    )
+    {
+        jpeg_loader(imgbuffer, buffersize).get_image(image);
+    }
+
+// ----------------------------------------------------------------------------------------
+
+    inline void load_jpeg (
+        array2d<unsigned char>& image,
+        const std::string& file_name
+    )
+    {
+        jpeg_loader(file_name, 1, 0, image);
+    }
+
+// ----------------------------------------------------------------------------------------
+
+    inline void load_jpeg (
+        array2d<unsigned char>& image,
+        const unsigned char* imgbuffer,
+        size_t buffersize
+    )
+    {
+        jpeg_loader(imgbuffer, buffersize, 1, 0, image);
+    }
+
 // ----------------------------------------------------------------------------------------
 
 }
@@ -65,6 +65,106 @@ namespace dlib
                   us from loading the given JPEG file.
         !*/
 
+        jpeg_loader( 
+            const unsigned char* imgbuffer,
+            size_t buffersize
+        );
+        /*!
+            requires
+                - imgbuffer points to buffersize bytes holding an encoded JPEG image
+            ensures
+                - decodes the JPEG image held in imgbuffer into this object.  The
+                  buffer is read in place and is not needed after this call returns.
+            throws
+                - std::bad_alloc
+                - image_load_error
+                  This exception is thrown if there is some error that prevents
+                  us from decoding the given JPEG image.
+        !*/
+
+        jpeg_loader( 
+            const std::string& filename,
+            unsigned long max_scale_denom,
+            unsigned long min_size
+        );
+        /*!
+            ensures
+                - loads the JPEG file with the given file name into this object,
+                  shrunk while decoding by the largest of 1, 2, 4 or 8 that is no
+                  more than max_scale_denom and leaves the larger side of the
+                  image at least min_size pixels long.  libjpeg does the shrinking
+                  in the DCT domain, so it is much cheaper than a full decode.
+                - #scale_denom() == the factor the image was shrunk by
+            throws
+                - std::bad_alloc
+                - image_load_error
+                  This exception is thrown if there is some error that prevents
+                  us from loading the given JPEG file.
+        !*/
+
+        jpeg_loader( 
+            const unsigned char* imgbuffer,
+            size_t buffersize,
+            unsigned long max_scale_denom,
+            unsigned long min_size
+        );
+        /*!
+            requires
+                - imgbuffer points to buffersize bytes holding an encoded JPEG image
+            ensures
+                - decodes the JPEG image held in imgbuffer into this object, shrunk
+                  in the same way as the constructor above.  The buffer is read in
+                  place and is not needed after this call returns.
+            throws
+                - std::bad_alloc
+                - image_load_error
+                  This exception is thrown if there is some error that prevents
+                  us from decoding the given JPEG image.
+        !*/
+
+        jpeg_loader( 
+            const std::string& filename,
+            unsigned long max_scale_denom,
+            unsigned long min_size,
+            array2d<unsigned char>& gray_image
+        );
+        /*!
+            ensures
+                - decodes the JPEG file with the given file name straight into
+                  gray_image, shrunk as by the constructors above.  For YCbCr and
+                  grayscale JPEGs only the luminance is decoded, so gray_image
+                  holds the luma of the image rather than the average of its
+                  color channels.  Other JPEGs are converted one row at a time.
+                  No copy of the image is kept in this object, so get_image()
+                  returns an empty image.
+                - is_gray() == true
+            throws
+                - std::bad_alloc
+                - image_load_error
+                  This exception is thrown if there is some error that prevents
+                  us from loading the given JPEG file.
+        !*/
+
+        jpeg_loader( 
+            const unsigned char* imgbuffer,
+            size_t buffersize,
+            unsigned long max_scale_denom,
+            unsigned long min_size,
+            array2d<unsigned char>& gray_image
+        );
+        /*!
+            requires
+                - imgbuffer points to buffersize bytes holding an encoded JPEG image
+            ensures
+                - decodes the JPEG image held in imgbuffer straight into
+                  gray_image, in the same way as the constructor above.
+            throws
+                - std::bad_alloc
+                - image_load_error
+                  This exception is thrown if there is some error that prevents
+                  us from decoding the given JPEG image.
+        !*/
+
         ~jpeg_loader(
         );
         /*!
@@ -92,6 +192,30 @@ namespace dlib
                     - returns false
         !*/
 
+        unsigned long original_width(
+        ) const;
+        /*!
+            ensures
+                - returns the width of the JPEG image before it was shrunk
+        !*/
+
+        unsigned long original_height(
+        ) const;
+        /*!
+            ensures
+                - returns the height of the JPEG image before it was shrunk
+        !*/
+
+        unsigned long scale_denom(
+        ) const;
+        /*!
+            ensures
+                - returns the factor the image was shrunk by while decoding: 1, 2,
+                  4 or 8.  The image held in this object is
+                  ceil(original_width()/scale_denom()) pixels wide and
+                  ceil(original_height()/scale_denom()) pixels tall.
+        !*/
+
         template<
             typename image_type 
             >
@@ -125,6 +249,52 @@ namespace dlib
             - performs: jpeg_loader(file_name).get_image(image);
     !*/
 
+// ----------------------------------------------------------------------------------------
+
+    template <
+        typename image_type
+        >
+    void load_jpeg (
+        image_type& image,
+        const unsigned char* imgbuffer,
+        size_t buffersize
+    );
+    /*!
+        requires
+            - image_type == an image object that implements the interface defined in
+              dlib/image_processing/generic_image.h 
+            - imgbuffer points to buffersize bytes holding an encoded JPEG image
+        ensures
+            - performs: jpeg_loader(imgbuffer, buffersize).get_image(image);
+    !*/
+
+// ----------------------------------------------------------------------------------------
+
+    void load_jpeg (
+        array2d<unsigned char>& image,
+        const std::string& file_name
+    );
+    /*!
+        ensures
+            - performs: jpeg_loader(file_name, 1, 0, image);
+              That is, grayscale images are decoded straight into image without
+              decoding their chroma.
+    !*/
+
+// ----------------------------------------------------------------------------------------
+
+    void load_jpeg (
+        array2d<unsigned char>& image,
+        const unsigned char* imgbuffer,
+        size_t buffersize
+    );
+    /*!
+        requires
+            - imgbuffer points to buffersize bytes holding an encoded JPEG image
+        ensures
+            - performs: jpeg_loader(imgbuffer, buffersize, 1, 0, image);
+    !*/
+
 // ----------------------------------------------------------------------------------------
 
 }
@@ -9,6 +9,8 @@
 #include "jpeg_loader.h"
 #include "image_loader.h"
 #include <fstream>
+#include <algorithm>
+#include <cstring>
 
 namespace dlib
 {
@@ -23,15 +25,10 @@ namespace dlib
             UNKNOWN
         };
 
-        inline type read_type(const std::string& file_name) 
+        inline type read_type(const unsigned char* data, size_t size) 
         {
-            std::ifstream file(file_name.c_str(), std::ios::in|std::ios::binary);
-            if (!file)
-                throw image_load_error("Unable to open file: " + file_name);
-
-            char buffer[9];
-            file.read((char*)buffer, 8);
-            buffer[8] = 0;
+            char buffer[9] = {0};
+            memcpy(buffer, data, std::min<size_t>(size, 8));
 
             // Determine the true image type using link:
             // http://en.wikipedia.org/wiki/List_of_file_signatures
@@ -47,6 +44,18 @@ namespace dlib
 
             return UNKNOWN;
         }
+
+        inline type read_type(const std::string& file_name) 
+        {
+            std::ifstream file(file_name.c_str(), std::ios::in|std::ios::binary);
+            if (!file)
+                throw image_load_error("Unable to open file: " + file_name);
+
+            char buffer[8];
+            file.read(buffer, 8);
+
+            return read_type((const unsigned char*)buffer, file.gcount());
+        }
     };
 
     template <typename image_type>
@@ -87,6 +96,43 @@ namespace dlib
         }
     }
 
+    template <typename image_type>
+    void load_image (
+        image_type& image,
+        const unsigned char* buffer,
+        size_t buffer_size
+    )
+    {
+        const image_file_type::type im_type = image_file_type::read_type(buffer, buffer_size);
+        switch (im_type)
+        {
+#ifdef DLIB_PNG_SUPPORT
+            case image_file_type::PNG: load_png(image, buffer, buffer_size); return;
+#endif
+#ifdef DLIB_JPEG_SUPPORT
+            case image_file_type::JPG: load_jpeg(image, buffer, buffer_size); return;
+#endif
+            default:  ;
+        }
+
+        if (im_type == image_file_type::JPG)
+        {
+            throw image_load_error(std::string("Unable to load image from memory.\n") +
+                "You must #define DLIB_JPEG_SUPPORT and link to libjpeg to read JPEG files.\n" +
+                "Do this by following the instructions at http://dlib.net/compile.html.");
+        }
+        else if (im_type == image_file_type::PNG)
+        {
+            throw image_load_error(std::string("Unable to load image from memory.\n") +
+                "You must #define DLIB_PNG_SUPPORT and link to libpng to read PNG files.\n" +
+                "Do this by following the instructions at http://dlib.net/compile.html.");
+        }
+        else
+        {
+            throw image_load_error("Unsupported image format: only JPEG and PNG images can be loaded from memory");
+        }
+    }
+
 }
 
 #endif // DLIB_LOAd_IMAGE_Hh_ 
@@ -29,6 +29,28 @@ namespace dlib
                 us from loading the given image file.
     !*/
 
+    template <typename image_type>
+    void load_image (
+        image_type& image,
+        const unsigned char* buffer,
+        size_t buffer_size
+    );
+    /*!
+        requires
+            - image_type == an image object that implements the interface defined in
+              dlib/image_processing/generic_image.h 
+            - buffer points to buffer_size bytes holding an encoded image 
+        ensures
+            - This function looks at the header bytes in buffer to figure out what kind of
+              image format it holds.  It then calls load_png() or load_jpeg() on the buffer
+              as appropriate and stores the resulting image into #image.  The buffer is
+              decoded in place, it is never copied.
+        throws
+            - image_load_error
+                This exception is thrown if the buffer doesn't hold a PNG or JPEG image
+                or if there is some error that prevents us from decoding it.
+    !*/
+
 }
 
 #endif // DLIB_LOAd_IMAGE_ABSTRACT_ 
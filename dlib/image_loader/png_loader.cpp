@@ -13,6 +13,8 @@
 #include <png.h>
 #include "../string.h"
 #include "../byte_orderer.h"
+#include <cstring>
+#include <vector>
 
 namespace dlib
 {
@@ -25,14 +27,34 @@ namespace dlib
         png_structp png_ptr_;
         png_infop info_ptr_;
         png_infop end_info_;
+        // Decoded rows that are converted as they are written to a gray image.
+        // Only interlaced images need more than one row of them.
+        std::vector<unsigned char> image_;
+        std::vector<png_bytep> rows_;
     };
 
+// ----------------------------------------------------------------------------------------
+
+    static std::FILE* png_loader_open_file( const char* filename )
+    {
+        if ( filename == NULL )
+        {
+            throw image_load_error("png_loader: invalid filename, it is NULL");
+        }
+        std::FILE *fp = fopen( filename, "rb" );
+        if ( !fp )
+        {
+            throw image_load_error(std::string("png_loader: unable to open file ") + filename);
+        }
+        return fp;
+    }
+
 // ----------------------------------------------------------------------------------------
 
     png_loader::
     png_loader( const char* filename ) : height_( 0 ), width_( 0 )
     {
-        read_image( filename );
+        read_image( png_loader_open_file( filename ), NULL, 0, std::string("file ") + filename );
     }
 
 // ----------------------------------------------------------------------------------------
@@ -40,7 +62,7 @@ namespace dlib
     png_loader::
     png_loader( const std::string& filename ) : height_( 0 ), width_( 0 )
     {
-        read_image( filename.c_str() );
+        read_image( png_loader_open_file( filename.c_str() ), NULL, 0, "file " + filename );
     }
 
 // ----------------------------------------------------------------------------------------
@@ -48,7 +70,39 @@ namespace dlib
     png_loader::
     png_loader( const dlib::file& f ) : height_( 0 ), width_( 0 )
     {
-        read_image( f.full_name().c_str() );
+        read_image( png_loader_open_file( f.full_name().c_str() ), NULL, 0, "file " + f.full_name() );
+    }
+
+// ----------------------------------------------------------------------------------------
+
+    png_loader::
+    png_loader( const unsigned char* imgbuffer, size_t buffersize ) : height_( 0 ), width_( 0 )
+    {
+        if ( imgbuffer == NULL || buffersize == 0 )
+        {
+            throw image_load_error("png_loader: invalid buffer, it is empty");
+        }
+        read_image( NULL, imgbuffer, buffersize, "memory buffer" );
+    }
+
+// ----------------------------------------------------------------------------------------
+
+    png_loader::
+    png_loader( const std::string& filename, array2d<unsigned char>& gray_image ) : height_( 0 ), width_( 0 )
+    {
+        read_image( png_loader_open_file( filename.c_str() ), NULL, 0, "file " + filename, &gray_image );
+    }
+
+// ----------------------------------------------------------------------------------------
+
+    png_loader::
+    png_loader( const unsigned char* imgbuffer, size_t buffersize, array2d<unsigned char>& gray_image ) : height_( 0 ), width_( 0 )
+    {
+        if ( imgbuffer == NULL || buffersize == 0 )
+        {
+            throw image_load_error("png_loader: invalid buffer, it is empty");
+        }
+        read_image( NULL, imgbuffer, buffersize, "memory buffer", &gray_image );
     }
 
 // ----------------------------------------------------------------------------------------
@@ -106,68 +160,107 @@ namespace dlib
     {
     }
 
-    void png_loader::read_image( const char* filename )
+    struct png_buffer_reader
     {
-        ld_.reset(new LibpngData);
-        if ( filename == NULL )
+        const unsigned char* buffer;
+        size_t buffer_size;
+        size_t current_pos;
+    };
+
+    void png_buffer_read_data(png_structp png_ptr, png_bytep data, png_size_t length)
+    {
+        png_buffer_reader* reader = static_cast<png_buffer_reader*>(png_get_io_ptr(png_ptr));
+        if (reader->current_pos + length > reader->buffer_size)
         {
-            throw image_load_error("png_loader: invalid filename, it is NULL");
+            png_error(png_ptr, "png_loader: read past the end of the buffer");
         }
-        FILE *fp = fopen( filename, "rb" );
-        if ( !fp )
+        memcpy(data, reader->buffer + reader->current_pos, length);
+        reader->current_pos += length;
+    }
+
+    void png_loader::read_image( std::FILE* fp, const unsigned char* imgbuffer, size_t buffersize, const std::string& source,
+                                 array2d<unsigned char>* gray_image )
+    {
+        // When reading from memory fp is NULL and closing it is a no-op.
+        struct file_closer
         {
-            throw image_load_error(std::string("png_loader: unable to open file ") + filename);
-        }
+            std::FILE* fp;
+            ~file_closer() { if (fp) fclose(fp); }
+        } closer = { fp };
+
+        ld_.reset(new LibpngData());
+        png_buffer_reader reader = { imgbuffer, buffersize, 0 };
+
         png_byte sig[8];
-        if (fread( sig, 1, 8, fp ) != 8)
+        if (fp != NULL)
         {
-            fclose( fp );
-            throw image_load_error(std::string("png_loader: error reading file ") + filename);
+            if (fread( sig, 1, 8, fp ) != 8)
+                throw image_load_error("png_loader: error reading " + source);
+        }
+        else
+        {
+            if (buffersize < 8)
+                throw image_load_error("png_loader: error reading " + source);
+            memcpy(sig, imgbuffer, 8);
+            reader.current_pos = 8;
         }
         if ( png_sig_cmp( sig, 0, 8 ) != 0 )
         {
-            fclose( fp );
-            throw image_load_error(std::string("png_loader: format error in file ") + filename);
+            throw image_load_error("png_loader: format error in " + source);
         }
         ld_->png_ptr_ = png_create_read_struct( PNG_LIBPNG_VER_STRING, NULL, &png_loader_user_error_fn_silent, &png_loader_user_warning_fn_silent );
         if ( ld_->png_ptr_ == NULL )
         {
-            fclose( fp );
-            throw image_load_error(std::string("png_loader: parse error in file ") + filename);
+            throw image_load_error("png_loader: parse error in " + source);
         }
         ld_->info_ptr_ = png_create_info_struct( ld_->png_ptr_ );
         if ( ld_->info_ptr_ == NULL )
         {
-            fclose( fp );
             png_destroy_read_struct( &( ld_->png_ptr_ ), ( png_infopp )NULL, ( png_infopp )NULL );
-            throw image_load_error(std::string("png_loader: parse error in file ") + filename);
+            throw image_load_error("png_loader: parse error in " + source);
         }
         ld_->end_info_ = png_create_info_struct( ld_->png_ptr_ );
         if ( ld_->end_info_ == NULL )
         {
-            fclose( fp );
             png_destroy_read_struct( &( ld_->png_ptr_ ), &( ld_->info_ptr_ ), ( png_infopp )NULL );
-            throw image_load_error(std::string("png_loader: parse error in file ") + filename);
+            throw image_load_error("png_loader: parse error in " + source);
         }
 
         if (setjmp(png_jmpbuf(ld_->png_ptr_)))
         {
-            // If we get here, we had a problem writing the file 
-            fclose(fp);
+            // If we get here, we had a problem reading the file 
             png_destroy_read_struct( &( ld_->png_ptr_ ), &( ld_->info_ptr_ ), &( ld_->end_info_ ) );
-            throw image_load_error(std::string("png_loader: parse error in file ") + filename);
+            throw image_load_error("png_loader: parse error in " + source);
         }
 
         png_set_palette_to_rgb(ld_->png_ptr_);
 
-        png_init_io( ld_->png_ptr_, fp );
+        if (fp != NULL)
+            png_init_io( ld_->png_ptr_, fp );
+        else
+            png_set_read_fn( ld_->png_ptr_, &reader, png_buffer_read_data );
         png_set_sig_bytes( ld_->png_ptr_, 8 );
         // flags force one byte per channel output
         byte_orderer bo;
-        int png_transforms = PNG_TRANSFORM_PACKING;
-        if (bo.host_is_little_endian())
-            png_transforms |= PNG_TRANSFORM_SWAP_ENDIAN;
-        png_read_png( ld_->png_ptr_, ld_->info_ptr_, png_transforms, NULL );
+        int passes = 1;
+        if (gray_image == NULL)
+        {
+            int png_transforms = PNG_TRANSFORM_PACKING;
+            if (bo.host_is_little_endian())
+                png_transforms |= PNG_TRANSFORM_SWAP_ENDIAN;
+            png_read_png( ld_->png_ptr_, ld_->info_ptr_, png_transforms, NULL );
+        }
+        else
+        {
+            // The same transforms as above, but the rows are read one at a time
+            // by read_gray_rows() rather than all at once by png_read_png().
+            png_read_info( ld_->png_ptr_, ld_->info_ptr_ );
+            png_set_packing( ld_->png_ptr_ );
+            if (bo.host_is_little_endian())
+                png_set_swap( ld_->png_ptr_ );
+            passes = png_set_interlace_handling( ld_->png_ptr_ );
+            png_read_update_info( ld_->png_ptr_, ld_->info_ptr_ );
+        }
         height_ = png_get_image_height( ld_->png_ptr_, ld_->info_ptr_ );
         width_ = png_get_image_width( ld_->png_ptr_, ld_->info_ptr_ );
         bit_depth_ = png_get_bit_depth( ld_->png_ptr_, ld_->info_ptr_ );
@@ -179,25 +272,121 @@ namespace dlib
             color_type_ != PNG_COLOR_TYPE_RGB_ALPHA &&
             color_type_ != PNG_COLOR_TYPE_GRAY_ALPHA)
         {
-            fclose( fp );
             png_destroy_read_struct( &( ld_->png_ptr_ ), &( ld_->info_ptr_ ), &( ld_->end_info_ ) );
-            throw image_load_error(std::string("png_loader: unsupported color type in file ") + filename);
+            throw image_load_error("png_loader: unsupported color type in " + source);
         }
 
         if (bit_depth_ != 8 && bit_depth_ != 16)
         {
-            fclose( fp );
             png_destroy_read_struct( &( ld_->png_ptr_ ), &( ld_->info_ptr_ ), &( ld_->end_info_ ) );
-            throw image_load_error("png_loader: unsupported bit depth of " + cast_to_string(bit_depth_) + " in file " + std::string(filename));
+            throw image_load_error("png_loader: unsupported bit depth of " + cast_to_string(bit_depth_) + " in " + source);
+        }
+
+        if (gray_image != NULL)
+        {
+            read_gray_rows( *gray_image, passes );
+            png_read_end( ld_->png_ptr_, ld_->end_info_ );
+            png_destroy_read_struct( &( ld_->png_ptr_ ), &( ld_->info_ptr_ ), &( ld_->end_info_ ) );
+            ld_.reset();
+            height_ = 0;
+            width_ = 0;
+            return;
         }
 
         ld_->row_pointers_ = png_get_rows( ld_->png_ptr_, ld_->info_ptr_ );
 
-        fclose( fp );
         if ( ld_->row_pointers_ == NULL )
         {
             png_destroy_read_struct( &( ld_->png_ptr_ ), &( ld_->info_ptr_ ), &( ld_->end_info_ ) );
-            throw image_load_error(std::string("png_loader: parse error in file ") + filename);
+            throw image_load_error("png_loader: parse error in " + source);
+        }
+    }
+
+// ----------------------------------------------------------------------------------------
+
+    // Converts a row of decoded pixels to gray the same way get_image() does
+    // for an array2d<unsigned char>.
+    static void png_loader_convert_gray_row(
+        const unsigned char* v,
+        unsigned char* gray,
+        unsigned width,
+        unsigned channels,
+        unsigned bit_depth
+    )
+    {
+        const uint16* v16 = (const uint16*)v;
+        for ( unsigned m = 0; m < width; m++ )
+        {
+            if (channels <= 2)
+            {
+                if (bit_depth == 8)
+                    gray[m] = v[m*channels];
+                else
+                    assign_pixel( gray[m], v16[m*channels] );
+            }
+            else if (channels == 3)
+            {
+                rgb_pixel p;
+                if (bit_depth == 8)
+                    p = rgb_pixel( v[m*3], v[m*3+1], v[m*3+2] );
+                else
+                    p = rgb_pixel( static_cast<uint8>(v16[m*3]), static_cast<uint8>(v16[m*3+1]),
+                                   static_cast<uint8>(v16[m*3+2]) );
+                assign_pixel( gray[m], p );
+            }
+            else
+            {
+                rgb_alpha_pixel p;
+                if (bit_depth == 8)
+                    p = rgb_alpha_pixel( v[m*4], v[m*4+1], v[m*4+2], v[m*4+3] );
+                else
+                    p = rgb_alpha_pixel( static_cast<uint8>(v16[m*4]), static_cast<uint8>(v16[m*4+1]),
+                                         static_cast<uint8>(v16[m*4+2]), static_cast<uint8>(v16[m*4+3]) );
+                // Blended over black.
+                gray[m] = 0;
+                assign_pixel( gray[m], p );
+            }
+        }
+    }
+
+    void png_loader::read_gray_rows( array2d<unsigned char>& gray_image, int passes )
+    {
+        gray_image.set_size( height_, width_ );
+
+        // 8-bit gray rows are decoded in place.  An interlaced image fills them
+        // in over several passes.
+        if (is_gray() && bit_depth_ == 8)
+        {
+            for ( int pass = 0; pass < passes; pass++ )
+            {
+                for ( unsigned n = 0; n < height_; n++ )
+                    png_read_row( ld_->png_ptr_, &gray_image[n][0], NULL );
+            }
+            return;
+        }
+
+        const unsigned channels = png_get_channels( ld_->png_ptr_, ld_->info_ptr_ );
+        const size_t row_bytes = png_get_rowbytes( ld_->png_ptr_, ld_->info_ptr_ );
+        if (passes == 1)
+        {
+            ld_->image_.resize( row_bytes );
+            for ( unsigned n = 0; n < height_; n++ )
+            {
+                png_read_row( ld_->png_ptr_, &ld_->image_[0], NULL );
+                png_loader_convert_gray_row( &ld_->image_[0], &gray_image[n][0], width_, channels, bit_depth_ );
+            }
+        }
+        else
+        {
+            // Every pass touches every row, so an interlaced image has to be
+            // decoded whole before it can be converted.
+            ld_->image_.resize( row_bytes * height_ );
+            ld_->rows_.resize( height_ );
+            for ( unsigned n = 0; n < height_; n++ )
+                ld_->rows_[n] = &ld_->image_[row_bytes * n];
+            png_read_image( ld_->png_ptr_, &ld_->rows_[0] );
+            for ( unsigned n = 0; n < height_; n++ )
+                png_loader_convert_gray_row( ld_->rows_[n], &gray_image[n][0], width_, channels, bit_depth_ );
         }
     }
 
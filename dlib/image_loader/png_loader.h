@@ -5,9 +5,11 @@
 
 #include "png_loader_abstract.h"
 #include "../smart_pointers.h"
+#include "../array2d.h"
 #include "image_loader.h"
 #include "../pixel.h"
 #include "../dir_nav.h"
+#include <cstdio>
 
 namespace dlib
 {
@@ -20,6 +22,9 @@ namespace dlib
         png_loader( const char* filename );
         png_loader( const std::string& filename );
         png_loader( const dlib::file& f );
+        png_loader( const unsigned char* imgbuffer, size_t buffersize );
+        png_loader( const std::string& filename, array2d<unsigned char>& gray_image );
+        png_loader( const unsigned char* imgbuffer, size_t buffersize, array2d<unsigned char>& gray_image );
         ~png_loader();
 
         bool is_gray() const;
@@ -189,7 +194,9 @@ namespace dlib
 
     private:
         const unsigned char* get_row( unsigned i ) const;
-        void read_image( const char* filename );
+        void read_image( std::FILE* file, const unsigned char* imgbuffer, size_t buffersize, const std::string& source,
+                         array2d<unsigned char>* gray_image = NULL );
+        void read_gray_rows( array2d<unsigned char>& gray_image, int passes );
         unsigned height_, width_;
         unsigned bit_depth_;
         int color_type_;
@@ -209,6 +216,41 @@ namespace dlib
         png_loader(file_name).get_image(image);
     }
 
+// ----------------------------------------------------------------------------------------
+
+    template <
+        typename image_type
+        >
+    void load_png (
+        image_type& image,
+        const unsigned char* imgbuffer,
+        size_t buffersize
+    )
+    {
+        png_loader(imgbuffer, buffersize).get_image(image);
+    }
+
+// ----------------------------------------------------------------------------------------
+
+    inline void load_png (
+        array2d<unsigned char>& image,
+        const std::string& file_name
+    )
+    {
+        png_loader(file_name, image);
+    }
+
+// ----------------------------------------------------------------------------------------
+
+    inline void load_png (
+        array2d<unsigned char>& image,
+        const unsigned char* imgbuffer,
+        size_t buffersize
+    )
+    {
+        png_loader(imgbuffer, buffersize, image);
+    }
+
 // ----------------------------------------------------------------------------------------
 
 }
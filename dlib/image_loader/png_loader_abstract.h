@@ -65,6 +65,60 @@ namespace dlib
                   us from loading the given PNG file.
         !*/
 
+        png_loader( 
+            const unsigned char* imgbuffer,
+            size_t buffersize
+        );
+        /*!
+            requires
+                - imgbuffer points to buffersize bytes holding an encoded PNG image
+            ensures
+                - decodes the PNG image held in imgbuffer into this object.  The
+                  buffer is read in place and is not needed after this call returns.
+            throws
+                - std::bad_alloc
+                - image_load_error
+                  This exception is thrown if there is some error that prevents
+                  us from decoding the given PNG image.
+        !*/
+
+        png_loader( 
+            const std::string& filename,
+            array2d<unsigned char>& gray_image
+        );
+        /*!
+            ensures
+                - decodes the PNG file with the given file name straight into
+                  gray_image, converting each row as it is decoded.  The pixels are
+                  the same as those get_image(gray_image) would give, but no copy of
+                  the image is kept in this object, so get_image() returns an empty
+                  image.  Only interlaced images other than 8-bit grayscale are
+                  decoded whole before they are converted.
+            throws
+                - std::bad_alloc
+                - image_load_error
+                  This exception is thrown if there is some error that prevents
+                  us from loading the given PNG file.
+        !*/
+
+        png_loader( 
+            const unsigned char* imgbuffer,
+            size_t buffersize,
+            array2d<unsigned char>& gray_image
+        );
+        /*!
+            requires
+                - imgbuffer points to buffersize bytes holding an encoded PNG image
+            ensures
+                - decodes the PNG image held in imgbuffer straight into
+                  gray_image, in the same way as the constructor above.
+            throws
+                - std::bad_alloc
+                - image_load_error
+                  This exception is thrown if there is some error that prevents
+                  us from decoding the given PNG image.
+        !*/
+
         ~png_loader(
         );
         /*!
@@ -153,6 +207,52 @@ namespace dlib
             - performs: png_loader(file_name).get_image(image);
     !*/
 
+// ----------------------------------------------------------------------------------------
+
+    template <
+        typename image_type
+        >
+    void load_png (
+        image_type& image,
+        const unsigned char* imgbuffer,
+        size_t buffersize
+    );
+    /*!
+        requires
+            - image_type == an image object that implements the interface defined in
+              dlib/image_processing/generic_image.h 
+            - imgbuffer points to buffersize bytes holding an encoded PNG image
+        ensures
+            - performs: png_loader(imgbuffer, buffersize).get_image(image);
+    !*/
+
+// ----------------------------------------------------------------------------------------
+
+    void load_png (
+        array2d<unsigned char>& image,
+        const std::string& file_name
+    );
+    /*!
+        ensures
+            - performs: png_loader(file_name, image);
+              That is, grayscale images are decoded straight into image without
+              an intermediate copy of the whole image.
+    !*/
+
+// ----------------------------------------------------------------------------------------
+
+    void load_png (
+        array2d<unsigned char>& image,
+        const unsigned char* imgbuffer,
+        size_t buffersize
+    );
+    /*!
+        requires
+            - imgbuffer points to buffersize bytes holding an encoded PNG image
+        ensures
+            - performs: png_loader(imgbuffer, buffersize, image);
+    !*/
+
 // ----------------------------------------------------------------------------------------
 
 }
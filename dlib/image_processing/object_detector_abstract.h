@@ -143,6 +143,35 @@ namespace dlib
                   I.e. the copy is done using copy_configuration())
         !*/
 
+        object_detector (
+            const image_scanner_type& scanner, 
+            const test_box_overlap& overlap_tester,
+            const std::vector<processed_weight_vector<image_scanner_type> >& w 
+        );
+        /*!
+            requires
+                - for all valid i:
+                    - w[i].w.size() == scanner.get_num_dimensions() + 1
+                    - w[i] has already been initialized, i.e. w[i].get_detect_argument()
+                      holds what w[i].init(scanner) would compute from w[i].w
+                - scanner.get_num_detection_templates() > 0
+                - w.size() > 0
+            ensures
+                - This is the same as the constructor above taking a std::vector of
+                  feature_vector_type, except that the weight vectors are not processed
+                  again.  This lets weight vectors that were processed earlier and stored
+                  be loaded without repeating the work done by init(), e.g. the SVD of
+                  every fhog filter.
+                - for all valid i:
+                    - #get_w(i) == w[i].w
+                    - #get_processed_w(i) == w[i]
+                - #num_detectors() == w.size()
+                - #get_overlap_tester() == overlap_tester
+                - #get_scanner() == scanner
+                  (note that only the "configuration" of scanner is copied.
+                  I.e. the copy is done using copy_configuration())
+        !*/
+
         explicit object_detector (
             const std::vector<object_detector>& detectors
         );
@@ -11,6 +11,7 @@
 #include "../pixel.h"
 #include "../console_progress_indicator.h"
 #include <utility>
+#include <functional>
 
 namespace dlib
 {
@@ -600,6 +601,15 @@ namespace dlib
             _verbose = false;
         }
 
+        typedef std::function<void(unsigned long trees_fit, unsigned long samples_processed)> status_callback;
+
+        void set_status_callback (
+            const status_callback& callback
+        )
+        {
+            _status_callback = callback;
+        }
+
         template <typename image_array>
         shape_predictor train (
             const image_array& images,
@@ -667,6 +677,8 @@ namespace dlib
             const std::vector<std::vector<dlib::vector<float,2> > > pixel_coordinates = randomly_sample_pixel_coordinates(initial_shape);
 
             unsigned long trees_fit_so_far = 0;
+            unsigned long trees_fit = 0;
+            unsigned long samples_processed = 0;
             console_progress_indicator pbar(get_cascade_depth()*get_num_trees_per_cascade_level());
             if (_verbose)
                 std::cout << "Fitting trees..." << std::endl;
@@ -698,6 +710,10 @@ namespace dlib
                         samples[i].current_shape, initial_shape, anchor_idx,
                         deltas, samples[i].feature_pixel_values);
 
+                    ++samples_processed;
+                    if (_status_callback)
+                        _status_callback(trees_fit, samples_processed);
+
                     if (_verbose)
                     {
                         std::cout << "\rSample " << i + 1 << " / " << samples.size() << std::flush;
@@ -712,6 +728,10 @@ namespace dlib
                 {
                     forests[cascade].push_back(make_regression_tree(samples, pixel_coordinates[cascade]));
 
+                    ++trees_fit;
+                    if (_status_callback)
+                        _status_callback(trees_fit, samples_processed);
+
                     if (_verbose)
                     {
                         ++trees_fit_so_far;
@@ -1115,6 +1135,7 @@ namespace dlib
         unsigned long _num_test_splits;
         double _feature_pool_region_padding;
         bool _verbose;
+        status_callback _status_callback;
     };
 
 // ----------------------------------------------------------------------------------------
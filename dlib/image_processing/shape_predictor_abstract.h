@@ -382,6 +382,23 @@ namespace dlib
                 - This object will not print anything to standard out
         !*/
 
+        typedef std::function<void(unsigned long trees_fit, unsigned long samples_processed)> status_callback;
+
+        void set_status_callback (
+            const status_callback& callback
+        );
+        /*!
+            ensures
+                - train() will call callback(trees_fit, samples_processed) each time it
+                  has computed the feature values of a training sample and each time it
+                  has fit a tree.  trees_fit counts the trees fit so far over all cascade
+                  levels, and samples_processed the feature values computed so far over
+                  all cascade levels.
+                - If callback throws, train() stops and the exception propagates out of
+                  it.  This can be used to cancel training.
+                - An empty callback (the default) is never called.
+        !*/
+
         template <typename image_array>
         shape_predictor train (
             const image_array& images,
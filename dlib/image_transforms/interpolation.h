@@ -749,12 +749,19 @@ namespace dlib
 
 // ----------------------------------------------------------------------------------------
 
+    // The input and output images may be different image types (e.g. an image view over
+    // external memory and an array2d) so long as they hold the same kind of grayscale
+    // pixel.  This way every such pair gets the same, SIMD accelerated, results.
     template <
-        typename image_type
+        typename image_type1,
+        typename image_type2
         >
-    typename enable_if<is_grayscale_image<image_type> >::type resize_image (
-        const image_type& in_img_,
-        image_type& out_img_,
+    typename enable_if_c<is_grayscale_image<image_type1>::value &&
+                         is_same_type<typename image_traits<image_type1>::pixel_type,
+                                      typename image_traits<image_type2>::pixel_type>::value>::type 
+    resize_image (
+        const image_type1& in_img_,
+        image_type2& out_img_,
         interpolate_bilinear
     )
     {
@@ -765,8 +772,8 @@ namespace dlib
             << "\n\t is_same_object(in_img_, out_img_):  " << is_same_object(in_img_, out_img_)
             );
 
-        const_image_view<image_type> in_img(in_img_);
-        image_view<image_type> out_img(out_img_);
+        const_image_view<image_type1> in_img(in_img_);
+        image_view<image_type2> out_img(out_img_);
 
         if (out_img.nr() <= 1 || out_img.nc() <= 1)
         {
@@ -774,7 +781,7 @@ namespace dlib
             return;
         }
 
-        typedef typename image_traits<image_type>::pixel_type T;
+        typedef typename image_traits<image_type2>::pixel_type T;
         const double x_scale = (in_img.nc()-1)/(double)std::max<long>((out_img.nc()-1),1);
         const double y_scale = (in_img.nr()-1)/(double)std::max<long>((out_img.nr()-1),1);
         double y = -y_scale;
@@ -1,13 +1,29 @@
 // addon.cpp
 #include <node.h>
+#include <node_buffer.h>
+#include "addon_data.h"
 #include "detector.h"
+#include "image_probe.h"
+#include "metrics.h"
 #include "predictor.h"
+#include "property_names.h"
+#include "scheduler.h"
+#include "trace.h"
+
+#include <stdint.h>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
 
 namespace ObjectDetector {
 
+  using v8::Exception;
   using v8::FunctionCallbackInfo;
+  using v8::Integer;
   using v8::Isolate;
+  using v8::JSON;
   using v8::Local;
+  using v8::Number;
   using v8::Object;
   using v8::String;
   using v8::Value;
@@ -20,18 +36,228 @@ namespace ObjectDetector {
     Detector::TrainFromXML(args);
   }
 
+  void TrainFromXMLAsync(const FunctionCallbackInfo<Value>& args) {
+    Detector::TrainFromXMLAsync(args);
+  }
+
   void TrainPredictorFromXML(const FunctionCallbackInfo<Value>& args) {
     Predictor::TrainFromXML(args);
   }
 
+  void TrainPredictorFromXMLAsync(const FunctionCallbackInfo<Value>& args) {
+    Predictor::TrainFromXMLAsync(args);
+  }
+
+  // probeImage(pathOrBuffer) reads the header of a JPEG, PNG or BMP image
+  // without decoding it and returns {format, width, height, channels,
+  // bitDepth}, so that callers can turn away or route large images before
+  // spending any time on them.
+  void ProbeImage(const FunctionCallbackInfo<Value>& args) {
+    Isolate* isolate = args.GetIsolate();
+
+    if (args.Length() != 1 || !(args[0]->IsString() || node::Buffer::HasInstance(args[0]))) {
+      isolate->ThrowException(Exception::TypeError(
+          String::NewFromUtf8(isolate, "Wrong number/type of arguments")));
+      return;
+    }
+
+    try {
+      ImageInfo info;
+      if (args[0]->IsString()) {
+        v8::String::Utf8Value path(args[0]);
+        info = ObjectDetector::ProbeImage(std::string(*path));
+      } else {
+        info = ObjectDetector::ProbeImage(reinterpret_cast<const unsigned char*>(node::Buffer::Data(args[0])),
+                                          node::Buffer::Length(args[0]));
+      }
+
+      Local<Object> result = Object::New(isolate);
+      result->Set(GetPropertyName(isolate, kFormat), String::NewFromUtf8(isolate, info.format));
+      result->Set(GetPropertyName(isolate, kWidth), Number::New(isolate, info.width));
+      result->Set(GetPropertyName(isolate, kHeight), Number::New(isolate, info.height));
+      result->Set(GetPropertyName(isolate, kChannels), Integer::New(isolate, info.channels));
+      result->Set(GetPropertyName(isolate, kBitDepth), Integer::New(isolate, info.bitDepth));
+      args.GetReturnValue().Set(result);
+    } catch (std::exception& e) {
+      isolate->ThrowException(Exception::Error(String::NewFromUtf8(isolate, e.what())));
+    }
+  }
+
+  // configureScheduler({concurrency, maxQueueDepth}) sets how many jobs run at
+  // once and how many may wait before new ones are refused, and returns the
+  // resulting settings. Omitted fields keep their current value; a
+  // maxQueueDepth of Infinity removes the limit.
+  void ConfigureScheduler(const FunctionCallbackInfo<Value>& args) {
+    Isolate* isolate = args.GetIsolate();
+    Scheduler* scheduler = Scheduler::Get(isolate);
+
+    if (args.Length() > 1 || (args.Length() == 1 && !args[0]->IsUndefined() && !args[0]->IsObject())) {
+      isolate->ThrowException(Exception::TypeError(
+          String::NewFromUtf8(isolate, "Wrong number/type of arguments")));
+      return;
+    }
+
+    try {
+      unsigned int concurrency = scheduler->GetConcurrency();
+      size_t maxQueueDepth = scheduler->GetMaxQueueDepth();
+
+      if (args.Length() == 1 && args[0]->IsObject()) {
+        Local<Object> options = args[0]->ToObject();
+
+        Local<Value> optConcurrency = options->Get(String::NewFromUtf8(isolate, "concurrency"));
+        if (!optConcurrency->IsUndefined()) {
+          double value = optConcurrency->NumberValue();
+          if (!(value >= 1)) {
+            isolate->ThrowException(Exception::RangeError(
+                String::NewFromUtf8(isolate, "concurrency must be at least 1")));
+            return;
+          }
+          concurrency = static_cast<unsigned int>(std::min(value, 1024.0));
+        }
+
+        Local<Value> optMaxQueueDepth = options->Get(String::NewFromUtf8(isolate, "maxQueueDepth"));
+        if (!optMaxQueueDepth->IsUndefined()) {
+          double value = optMaxQueueDepth->NumberValue();
+          if (!(value >= 0)) {
+            isolate->ThrowException(Exception::RangeError(
+                String::NewFromUtf8(isolate, "maxQueueDepth must not be negative")));
+            return;
+          }
+          maxQueueDepth = value >= static_cast<double>(SIZE_MAX) ? SIZE_MAX : static_cast<size_t>(value);
+        }
+      }
+
+      scheduler->Configure(concurrency, maxQueueDepth);
+
+      Local<Object> result = Object::New(isolate);
+      result->Set(String::NewFromUtf8(isolate, "concurrency"), Integer::NewFromUnsigned(isolate, scheduler->GetConcurrency()));
+      result->Set(String::NewFromUtf8(isolate, "maxQueueDepth"),
+                  Number::New(isolate, scheduler->GetMaxQueueDepth() == SIZE_MAX
+                                           ? std::numeric_limits<double>::infinity()
+                                           : static_cast<double>(scheduler->GetMaxQueueDepth())));
+      args.GetReturnValue().Set(result);
+    } catch (std::exception& e) {
+      isolate->ThrowException(Exception::Error(String::NewFromUtf8(isolate, e.what())));
+    }
+  }
+
+  // getMetrics([format]) returns what has been counted and timed since the
+  // process started, for every model: as an object by default, as JSON text
+  // with "json" or in the Prometheus text exposition format with
+  // "prometheus". Durations are in nanoseconds, except in Prometheus, which
+  // uses seconds.
+  void GetMetrics(const FunctionCallbackInfo<Value>& args) {
+    Isolate* isolate = args.GetIsolate();
+
+    if (args.Length() > 1 || (args.Length() == 1 && !args[0]->IsUndefined() && !args[0]->IsString())) {
+      isolate->ThrowException(Exception::TypeError(
+          String::NewFromUtf8(isolate, "Wrong number/type of arguments")));
+      return;
+    }
+
+    try {
+      std::string format = "object";
+      if (args.Length() == 1 && args[0]->IsString()) {
+        v8::String::Utf8Value value(args[0]);
+        format = *value;
+      }
+
+      if (format == "prometheus") {
+        args.GetReturnValue().Set(String::NewFromUtf8(isolate, ModelMetrics::ToPrometheus().c_str()));
+      } else if (format == "json") {
+        args.GetReturnValue().Set(String::NewFromUtf8(isolate, ModelMetrics::ToJson().c_str()));
+      } else if (format == "object") {
+        // Parsing the addon's own JSON only fails with an exception already
+        // thrown, such as running out of memory.
+        Local<Value> metrics;
+        if (JSON::Parse(isolate->GetCurrentContext(), String::NewFromUtf8(isolate, ModelMetrics::ToJson().c_str()))
+                .ToLocal(&metrics)) {
+          args.GetReturnValue().Set(metrics);
+        }
+      } else {
+        isolate->ThrowException(Exception::RangeError(
+            String::NewFromUtf8(isolate, "format must be \"object\", \"json\" or \"prometheus\"")));
+      }
+    } catch (std::exception& e) {
+      isolate->ThrowException(Exception::Error(String::NewFromUtf8(isolate, e.what())));
+    }
+  }
+
+  // startTracing([{eventsPerThread}]) starts recording the decoding,
+  // detection stages and shape predictions of every thread, dropping any
+  // earlier trace. Each thread keeps its latest eventsPerThread events
+  // (65536 by default).
+  void StartTracing(const FunctionCallbackInfo<Value>& args) {
+    Isolate* isolate = args.GetIsolate();
+
+    if (args.Length() > 1 || (args.Length() == 1 && !args[0]->IsUndefined() && !args[0]->IsObject())) {
+      isolate->ThrowException(Exception::TypeError(
+          String::NewFromUtf8(isolate, "Wrong number/type of arguments")));
+      return;
+    }
+
+    try {
+      size_t eventsPerThread = 65536;
+      if (args.Length() == 1 && args[0]->IsObject()) {
+        Local<Object> options = args[0]->ToObject();
+
+        Local<Value> optEvents = options->Get(String::NewFromUtf8(isolate, "eventsPerThread"));
+        if (!optEvents->IsUndefined()) {
+          double value = optEvents->NumberValue();
+          if (!(value >= 1 && value <= 16777216)) {
+            isolate->ThrowException(Exception::RangeError(
+                String::NewFromUtf8(isolate, "eventsPerThread must be from 1 to 16777216")));
+            return;
+          }
+          eventsPerThread = static_cast<size_t>(value);
+        }
+      }
+
+      Tracer::Start(eventsPerThread);
+    } catch (std::exception& e) {
+      isolate->ThrowException(Exception::Error(String::NewFromUtf8(isolate, e.what())));
+    }
+  }
+
+  void StopTracing(const FunctionCallbackInfo<Value>& args) {
+    Tracer::Stop();
+  }
+
+  // dumpTrace() returns the events recorded since startTracing() as JSON in
+  // the Trace Event Format, to be saved to a file and opened in
+  // chrome://tracing or Perfetto.
+  void DumpTrace(const FunctionCallbackInfo<Value>& args) {
+    Isolate* isolate = args.GetIsolate();
+    try {
+      args.GetReturnValue().Set(String::NewFromUtf8(isolate, Tracer::Dump().c_str()));
+    } catch (std::exception& e) {
+      isolate->ThrowException(Exception::Error(String::NewFromUtf8(isolate, e.what())));
+    }
+  }
+
   void InitAll(Local<Object> exports) {
+    AddonData::Create(exports->GetIsolate());
+    InitPropertyNames(exports->GetIsolate());
     Detector::Init(exports);
     Predictor::Init(exports);
 
     NODE_SET_METHOD(exports, "createDetector", CreateDetector);
     NODE_SET_METHOD(exports, "trainFromXML", TrainFromXML);
+    NODE_SET_METHOD(exports, "trainFromXMLAsync", TrainFromXMLAsync);
     NODE_SET_METHOD(exports, "trainPredictorFromXML", TrainPredictorFromXML);
+    NODE_SET_METHOD(exports, "trainPredictorFromXMLAsync", TrainPredictorFromXMLAsync);
+    NODE_SET_METHOD(exports, "probeImage", ProbeImage);
+    NODE_SET_METHOD(exports, "configureScheduler", ConfigureScheduler);
+    NODE_SET_METHOD(exports, "getMetrics", GetMetrics);
+    NODE_SET_METHOD(exports, "startTracing", StartTracing);
+    NODE_SET_METHOD(exports, "stopTracing", StopTracing);
+    NODE_SET_METHOD(exports, "dumpTrace", DumpTrace);
   }
 
-  NODE_MODULE(ObjectDetector, InitAll)
+}
+
+// Context aware, so the addon can be loaded by worker threads as well as the
+// main thread.
+NODE_MODULE_INIT() {
+  ObjectDetector::InitAll(exports);
 }
@@ -0,0 +1,45 @@
+// addon_data
+#include "addon_data.h"
+
+namespace ObjectDetector {
+
+  using v8::Isolate;
+
+  static thread_local AddonData* currentAddonData = NULL;
+
+  AddonData::AddonData(Isolate* isolate)
+    : scheduler(new Scheduler(node::GetCurrentEventLoop(isolate))), isolate(isolate) {
+  }
+
+  AddonData::~AddonData() {
+    detectorConstructor.Reset();
+    predictorConstructor.Reset();
+    predictorTemplate.Reset();
+    for (int i = 0; i < kPropertyNameCount; ++i) {
+      propertyNames[i].Reset();
+    }
+    scheduler->Close();
+  }
+
+  AddonData* AddonData::Create(Isolate* isolate) {
+    if (currentAddonData != NULL && currentAddonData->isolate == isolate) {
+      return currentAddonData;
+    }
+
+    currentAddonData = new AddonData(isolate);
+    node::AddEnvironmentCleanupHook(isolate, Cleanup, currentAddonData);
+    return currentAddonData;
+  }
+
+  AddonData* AddonData::Get(Isolate* isolate) {
+    return currentAddonData;
+  }
+
+  void AddonData::Cleanup(void* arg) {
+    AddonData* data = static_cast<AddonData*>(arg);
+    if (currentAddonData == data) {
+      currentAddonData = NULL;
+    }
+    delete data;
+  }
+}
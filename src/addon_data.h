@@ -0,0 +1,41 @@
+// addon_data.h
+#ifndef ADDON_DATA_H
+#define ADDON_DATA_H
+
+#include <node.h>
+
+#include "property_names.h"
+#include "scheduler.h"
+
+namespace ObjectDetector {
+  // Everything the addon keeps in V8 handles. Handles belong to one isolate,
+  // so every Node.js environment that loads the addon (the main thread and
+  // each worker thread) gets its own copy, freed when that environment is
+  // torn down.
+  class AddonData {
+   public:
+    static AddonData* Create(v8::Isolate* isolate);
+
+    // The data of the environment running on the calling thread. Node.js
+    // runs every environment on a thread of its own, and the addon only calls
+    // into V8 from that thread.
+    static AddonData* Get(v8::Isolate* isolate);
+
+    v8::Persistent<v8::Function> detectorConstructor;
+    v8::Persistent<v8::Function> predictorConstructor;
+    v8::Persistent<v8::FunctionTemplate> predictorTemplate;
+    v8::Persistent<v8::String> propertyNames[kPropertyNameCount];
+
+    Scheduler* scheduler;
+
+   private:
+    explicit AddonData(v8::Isolate* isolate);
+    ~AddonData();
+
+    static void Cleanup(void* arg);
+
+    v8::Isolate* isolate;
+  };
+}
+
+#endif
@@ -0,0 +1,284 @@
+// detection.h
+#ifndef DETECTION_H
+#define DETECTION_H
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "dlib/image_processing.h"
+
+#include "job_control.h"
+#include "metrics.h"
+#include "trace.h"
+
+namespace ObjectDetector {
+  typedef dlib::scan_fhog_pyramid<dlib::pyramid_down<6> > image_scanner_type;
+  typedef dlib::object_detector<image_scanner_type> object_detector_type;
+
+  // Working memory of one scan: the feature pyramid of the image and the
+  // saliency image the filters are applied into. dlib keeps these inside the
+  // object_detector, which is why it can't scan two images at once. Here the
+  // caller owns them, so any number of scans can share one const detector.
+  // A thread may reuse its scratch for consecutive scans to avoid
+  // reallocating when images have the same size.
+  struct DetectionScratch {
+    dlib::array<dlib::array<dlib::array2d<float> > > feats;
+    dlib::array2d<float> saliency;
+    std::vector<std::pair<double, dlib::rectangle> > candidates;
+  };
+
+  // Where the time of a detection call went, for callers that ask. Durations
+  // are in nanoseconds.
+  struct DetectionTimings {
+    // One level of the image pyramid. filter and threshold are summed over
+    // the detector's filters.
+    struct Level {
+      Level() : width(0), height(0), pyramid(0), fhog(0), filter(0), threshold(0) {
+      }
+
+      long width;
+      long height;
+      uint64_t pyramid;
+      uint64_t fhog;
+      uint64_t filter;
+      uint64_t threshold;
+    };
+
+    DetectionTimings()
+      : decode(0), pyramid(0), fhog(0), filter(0), threshold(0), nms(0), shapes(0), candidates(0), detections(0) {
+    }
+
+    // decode and shapes are only spent by calls that decode an image or
+    // predict shapes. pyramid, fhog, filter and threshold are the sums over
+    // the levels.
+    uint64_t decode;
+    uint64_t pyramid;
+    uint64_t fhog;
+    uint64_t filter;
+    uint64_t threshold;
+    uint64_t nms;
+    uint64_t shapes;
+    std::vector<Level> levels;
+
+    // Windows that scored above the threshold, and the detections left of
+    // them by non-max suppression.
+    uint64_t candidates;
+    uint64_t detections;
+  };
+
+  // Number of levels of the feature pyramid of an image of the given size, as
+  // dlib::impl::create_fhog_pyramid counts them.
+  inline unsigned long PyramidLevels(const image_scanner_type& scanner, dlib::rectangle rect) {
+    image_scanner_type::pyramid_type pyr;
+    unsigned long levels = 0;
+    do {
+      rect = pyr.rect_down(rect);
+      ++levels;
+    } while (rect.width() >= scanner.get_min_pyramid_layer_width() &&
+             rect.height() >= scanner.get_min_pyramid_layer_height() &&
+             levels < scanner.get_max_pyramid_levels());
+    return levels;
+  }
+
+  // Sorts the candidates of detector weightIndex by score, as
+  // scan_fhog_pyramid::detect() does, and appends them to accum.
+  inline void AppendCandidates(std::vector<std::pair<double, dlib::rectangle> >& candidates, double thresh,
+                               unsigned long weightIndex, std::vector<dlib::rect_detection>& accum) {
+    std::sort(candidates.rbegin(), candidates.rend(), dlib::impl::compare_pair_rect);
+    for (unsigned long j = 0; j < candidates.size(); ++j) {
+      dlib::rect_detection det;
+      det.detection_confidence = candidates[j].first - thresh;
+      det.weight_index = weightIndex;
+      det.rect = candidates[j].second;
+      accum.push_back(det);
+    }
+  }
+
+  // Non-max suppression of the candidates of every detector, as in
+  // object_detector.
+  inline void SuppressOverlaps(const object_detector_type& detector, std::vector<dlib::rect_detection>& accum,
+                               std::vector<dlib::rect_detection>& dets) {
+    const dlib::test_box_overlap& overlaps = detector.get_overlap_tester();
+    dets.clear();
+    if (detector.num_detectors() > 1) {
+      std::sort(accum.rbegin(), accum.rend());
+    }
+    for (unsigned long i = 0; i < accum.size(); ++i) {
+      bool suppressed = false;
+      for (unsigned long j = 0; j < dets.size() && !suppressed; ++j) {
+        suppressed = overlaps(dets[j].rect, accum[i].rect);
+      }
+
+      if (!suppressed) {
+        dets.push_back(accum[i]);
+      }
+    }
+  }
+
+  // Equivalent to detector(img, dets, adjustThreshold), without modifying
+  // detector. If control is given it is checked before every pyramid level
+  // is built and filtered, so a cancelled or expired scan stops with a
+  // JobError within one level. If timings is given, the time of every stage
+  // and level and the counts are written to it, leaving decode and shapes
+  // alone.
+  template <typename image_type>
+  void Detect(const object_detector_type& detector, const image_type& img, double adjustThreshold,
+              DetectionScratch& scratch, std::vector<dlib::rect_detection>& dets,
+              const JobControl* control = NULL, DetectionTimings* timings = NULL) {
+    typedef image_scanner_type::pyramid_type pyramid_type;
+
+    const image_scanner_type& scanner = detector.get_scanner();
+    const unsigned long windowWidth = scanner.get_fhog_window_width();
+    const unsigned long windowHeight = scanner.get_fhog_window_height();
+    const unsigned long boxWidth = windowWidth - 2 * scanner.get_padding();
+    const unsigned long boxHeight = windowHeight - 2 * scanner.get_padding();
+    const int cellSize = scanner.get_cell_size();
+    const image_scanner_type::feature_extractor_type& fe = scanner.get_feature_extractor();
+
+    // Build the feature pyramid, as dlib::impl::create_fhog_pyramid does.
+    pyramid_type pyr;
+    const unsigned long levels = PyramidLevels(scanner, dlib::get_rect(img));
+
+    if (scratch.feats.max_size() < levels) {
+      scratch.feats.set_max_size(levels);
+    }
+    scratch.feats.set_size(levels);
+
+    StageClock clock(timings != NULL);
+    if (timings) {
+      timings->levels.assign(levels, DetectionTimings::Level());
+      timings->levels[0].width = dlib::get_rect(img).width();
+      timings->levels[0].height = dlib::get_rect(img).height();
+    }
+
+    if (control) {
+      control->Check();
+    }
+    {
+      TraceScope trace("fhog", "level", 0);
+      fe(img, scratch.feats[0], cellSize, windowHeight, windowWidth);
+    }
+    if (timings) {
+      timings->levels[0].fhog = clock.Lap();
+    }
+
+    if (levels > 1) {
+      typedef typename dlib::image_traits<image_type>::pixel_type pixel_type;
+      dlib::array2d<pixel_type> temp1, temp2;
+      if (control) {
+        control->Check();
+      }
+      clock.Lap();
+      {
+        TraceScope trace("pyramid", "level", 1);
+        pyr(img, temp1);
+      }
+      if (timings) {
+        timings->levels[1].pyramid = clock.Lap();
+        timings->levels[1].width = temp1.nc();
+        timings->levels[1].height = temp1.nr();
+      }
+      {
+        TraceScope trace("fhog", "level", 1);
+        fe(temp1, scratch.feats[1], cellSize, windowHeight, windowWidth);
+      }
+      if (timings) {
+        timings->levels[1].fhog = clock.Lap();
+      }
+      swap(temp1, temp2);
+
+      for (unsigned long l = 2; l < levels; ++l) {
+        if (control) {
+          control->Check();
+        }
+        clock.Lap();
+        {
+          TraceScope trace("pyramid", "level", l);
+          pyr(temp2, temp1);
+        }
+        if (timings) {
+          timings->levels[l].pyramid = clock.Lap();
+          timings->levels[l].width = temp1.nc();
+          timings->levels[l].height = temp1.nr();
+        }
+        {
+          TraceScope trace("fhog", "level", l);
+          fe(temp1, scratch.feats[l], cellSize, windowHeight, windowWidth);
+        }
+        if (timings) {
+          timings->levels[l].fhog = clock.Lap();
+        }
+        swap(temp1, temp2);
+      }
+    }
+
+    uint64_t numCandidates = 0;
+    uint64_t nmsTime = 0;
+
+    std::vector<dlib::rect_detection> accum;
+    for (unsigned long i = 0; i < detector.num_detectors(); ++i) {
+      const dlib::processed_weight_vector<image_scanner_type>& w = detector.get_processed_w(i);
+      const double thresh = w.w(scanner.get_num_dimensions());
+
+      // Same as scan_fhog_pyramid::detect(), with the saliency image coming
+      // from the scratch.
+      std::vector<std::pair<double, dlib::rectangle> >& candidates = scratch.candidates;
+      candidates.clear();
+      for (unsigned long l = 0; l < scratch.feats.size(); ++l) {
+        if (control) {
+          control->Check();
+        }
+
+        clock.Lap();
+        dlib::rectangle area;
+        {
+          TraceScope trace("filter", "level", l);
+          area = dlib::impl::apply_filters_to_fhog(w.get_detect_argument(), scratch.feats[l], scratch.saliency);
+        }
+        if (timings) {
+          timings->levels[l].filter += clock.Lap();
+        }
+
+        TraceScope trace("threshold", "level", l);
+        for (long r = area.top(); r <= area.bottom(); ++r) {
+          for (long c = area.left(); c <= area.right(); ++c) {
+            if (scratch.saliency[r][c] >= thresh + adjustThreshold) {
+              dlib::rectangle box = fe.feats_to_image(
+                  dlib::centered_rect(dlib::point(c, r), boxWidth, boxHeight), cellSize, windowHeight, windowWidth);
+              candidates.push_back(std::make_pair(scratch.saliency[r][c], pyr.rect_up(box, l)));
+            }
+          }
+        }
+        if (timings) {
+          timings->levels[l].threshold += clock.Lap();
+        }
+      }
+
+      numCandidates += candidates.size();
+      AppendCandidates(candidates, thresh, i, accum);
+      // Sorting the candidates is counted with the suppression.
+      nmsTime += clock.Lap();
+    }
+
+    TraceScope trace("nms");
+    SuppressOverlaps(detector, accum, dets);
+
+    if (timings) {
+      timings->nms = nmsTime + clock.Lap();
+      timings->pyramid = timings->fhog = timings->filter = timings->threshold = 0;
+      for (unsigned long l = 0; l < levels; ++l) {
+        timings->pyramid += timings->levels[l].pyramid;
+        timings->fhog += timings->levels[l].fhog;
+        timings->filter += timings->levels[l].filter;
+        timings->threshold += timings->levels[l].threshold;
+      }
+      timings->candidates = numCandidates;
+      timings->detections = dets.size();
+    }
+  }
+}
+
+#endif
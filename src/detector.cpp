@@ -1,24 +1,43 @@
 // detector
 #include "detector.h"
+#include "addon_data.h"
+#include "memory_stream.h"
+#include "model_cache.h"
+#include "model_file.h"
+#include "property_names.h"
+#include "trace.h"
+#include "training.h"
+#include "worker.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <node_buffer.h>
+#include <sstream>
+#include <stdexcept>
 
 namespace ObjectDetector {
 
   using v8::Array;
+  using v8::ArrayBuffer;
   using v8::Exception;
+  using v8::Float32Array;
   using v8::Function;
   using v8::FunctionCallbackInfo;
   using v8::FunctionTemplate;
   using v8::HandleScope;
   using v8::Isolate;
   using v8::Local;
+  using v8::Null;
   using v8::Number;
   using v8::Object;
-  using v8::Persistent;
   using v8::String;
+  using v8::Undefined;
   using v8::Value;
 
-  Persistent<Function> Detector::constructor;
-
   void Detector::Init(Local<Object> exports) {
     Isolate* isolate = exports->GetIsolate();
 
@@ -29,10 +48,23 @@ namespace ObjectDetector {
 
     // Prototype
     NODE_SET_PROTOTYPE_METHOD(tpl, "detectInImageFile", DetectInImageFile);
+    NODE_SET_PROTOTYPE_METHOD(tpl, "detectInImageFileAsync", DetectInImageFileAsync);
+    NODE_SET_PROTOTYPE_METHOD(tpl, "detectInBuffer", DetectInBuffer);
+    NODE_SET_PROTOTYPE_METHOD(tpl, "detectInBufferAsync", DetectInBufferAsync);
+    NODE_SET_PROTOTYPE_METHOD(tpl, "detectInPixels", DetectInPixels);
+    NODE_SET_PROTOTYPE_METHOD(tpl, "detectInPixelsAsync", DetectInPixelsAsync);
+    NODE_SET_PROTOTYPE_METHOD(tpl, "detectInImageFiles", DetectInImageFiles);
+    NODE_SET_PROTOTYPE_METHOD(tpl, "detectWithShapes", DetectWithShapes);
+    NODE_SET_PROTOTYPE_METHOD(tpl, "detectWithShapesAsync", DetectWithShapesAsync);
     NODE_SET_PROTOTYPE_METHOD(tpl, "saveToFile", SaveToFile);
+    NODE_SET_PROTOTYPE_METHOD(tpl, "saveToBinaryFile", SaveToBinaryFile);
     NODE_SET_PROTOTYPE_METHOD(tpl, "saveImageRepresentation", SaveImageRepresentation);
 
-    constructor.Reset(isolate, tpl->GetFunction());
+    // Static methods
+    tpl->Set(String::NewFromUtf8(isolate, "fromBuffer"), FunctionTemplate::New(isolate, FromBuffer));
+    tpl->Set(String::NewFromUtf8(isolate, "fromBufferAsync"), FunctionTemplate::New(isolate, FromBufferAsync));
+
+    AddonData::Get(isolate)->detectorConstructor.Reset(isolate, tpl->GetFunction());
     exports->Set(String::NewFromUtf8(isolate, "Detector"), tpl->GetFunction());
   }
 
@@ -62,7 +94,7 @@ namespace ObjectDetector {
         // Invoked as plain function `Detector(...)`, turn into construct call.
         const int argc = 1;
         Local<Value> argv[argc] = { args[0] };
-        Local<Function> cons = Local<Function>::New(isolate, constructor);
+        Local<Function> cons = Local<Function>::New(isolate, AddonData::Get(isolate)->detectorConstructor);
         args.GetReturnValue().Set(cons->NewInstance(argc, argv));
       }
     } catch (std::exception& e) {
@@ -70,47 +102,1229 @@ namespace ObjectDetector {
     }
   }
 
+  std::shared_ptr<const DetectorModel> Detector::FrontalFaceModel() {
+    static std::shared_ptr<const DetectorModel> model;
+    static std::once_flag loaded;
+    std::call_once(loaded, []() {
+      std::shared_ptr<DetectorModel> face = std::make_shared<DetectorModel>();
+      face->detector = dlib::get_frontal_face_detector();
+      face->metrics = ModelMetrics::Get("detector", "frontal_face");
+      model = face;
+    });
+
+    return model;
+  }
+
+  std::shared_ptr<const DetectorModel> Detector::LoadModel(const std::string& path) {
+    static ModelCache<DetectorModel> cache;
+    return cache.Get(path, [](const std::string& path) {
+      std::shared_ptr<DetectorModel> model;
+      if (ModelFile::IsModelFile(path)) {
+        model = LoadModelFile(std::make_shared<MappedFile>(path));
+      } else {
+        std::ifstream in(path.c_str(), std::ios::binary);
+        if (!in) {
+          throw std::runtime_error("Unable to open " + path + " for reading.");
+        }
+        model = ReadModel(in);
+      }
+
+      model->metrics = ModelMetrics::Get("detector", path);
+      return std::shared_ptr<const DetectorModel>(model);
+    });
+  }
+
+  std::shared_ptr<DetectorModel> Detector::LoadModel(const char* data, size_t size) {
+    std::shared_ptr<DetectorModel> model;
+    if (ModelFile::IsModelFile(data, size)) {
+      model = LoadModelFile(std::make_shared<MappedFile>(data, size));
+    } else {
+      MemoryStream in(data, size);
+      model = ReadModel(in);
+    }
+
+    model->metrics = ModelMetrics::Get("detector", ModelMetrics::BufferName(data, size));
+    return model;
+  }
+
+  // Marks the filterbank block that WriteModel() appends to dlib's format.
+  static const char kFilterbankTag[] = "object-detector:filterbanks";
+  static const int kFilterbankVersion = 1;
+
+  void Detector::WriteModel(const object_detector_type& detector, std::ostream& out) {
+    dlib::serialize(detector, out);
+
+    dlib::serialize(std::string(kFilterbankTag), out);
+    dlib::serialize(kFilterbankVersion, out);
+    dlib::serialize(detector.num_detectors(), out);
+    for (unsigned long i = 0; i < detector.num_detectors(); ++i) {
+      const image_scanner_type::fhog_filterbank& fb = detector.get_processed_w(i).get_detect_argument();
+      dlib::serialize(fb.filters, out);
+      dlib::serialize(fb.row_filters, out);
+      dlib::serialize(fb.col_filters, out);
+    }
+  }
+
+  // True if fb has the layout dlib's build_fhog_filterbank() gives w.
+  static bool IsFilterbankOf(const image_scanner_type::fhog_filterbank& fb, const dlib::matrix<double, 0, 1>& w) {
+    if (fb.filters.empty() || fb.row_filters.size() != fb.filters.size() ||
+        fb.col_filters.size() != fb.filters.size()) {
+      return false;
+    }
+
+    const long rows = fb.filters[0].nr();
+    const long cols = fb.filters[0].nc();
+    if (static_cast<long>(fb.filters.size()) * rows * cols + 1 != w.size()) {
+      return false;
+    }
+
+    for (size_t p = 0; p < fb.filters.size(); ++p) {
+      if (fb.filters[p].nr() != rows || fb.filters[p].nc() != cols ||
+          fb.row_filters[p].size() != fb.col_filters[p].size()) {
+        return false;
+      }
+      for (size_t j = 0; j < fb.row_filters[p].size(); ++j) {
+        if (fb.row_filters[p][j].size() != cols || fb.col_filters[p][j].size() != rows) {
+          return false;
+        }
+      }
+    }
+
+    return true;
+  }
+
+  std::shared_ptr<DetectorModel> Detector::ReadModel(std::istream& in) {
+    // The same as dlib's deserialize(), up to building the filterbanks.
+    image_scanner_type scanner;
+    dlib::test_box_overlap overlapTester;
+    std::vector<dlib::processed_weight_vector<image_scanner_type> > processed;
+
+    int version = 0;
+    dlib::deserialize(version, in);
+    if (version == 1) {
+      dlib::deserialize(scanner, in);
+      processed.resize(1);
+      dlib::deserialize(processed[0].w, in);
+      dlib::deserialize(overlapTester, in);
+    } else if (version == 2) {
+      dlib::deserialize(scanner, in);
+      dlib::deserialize(overlapTester, in);
+      unsigned long numDetectors = 0;
+      dlib::deserialize(numDetectors, in);
+      processed.resize(numDetectors);
+      for (unsigned long i = 0; i < numDetectors; ++i) {
+        dlib::deserialize(processed[i].w, in);
+      }
+    } else {
+      throw dlib::serialization_error("Unexpected version encountered while deserializing a dlib::object_detector object.");
+    }
+
+    // Files written by dlib itself, or by earlier versions of saveToFile,
+    // end here. Anything after the detector that isn't a filterbank block of
+    // a known version, matching the weights read above, is ignored.
+    bool haveFilterbanks = false;
+    if (in.peek() != std::char_traits<char>::eof()) {
+      try {
+        std::string tag;
+        int filterbankVersion = 0;
+        unsigned long numDetectors = 0;
+        dlib::deserialize(tag, in);
+        if (tag == kFilterbankTag) {
+          dlib::deserialize(filterbankVersion, in);
+        }
+        if (filterbankVersion == kFilterbankVersion) {
+          dlib::deserialize(numDetectors, in);
+        }
+        if (numDetectors != 0 && numDetectors == processed.size()) {
+          haveFilterbanks = true;
+          for (size_t i = 0; i < processed.size(); ++i) {
+            image_scanner_type::fhog_filterbank& fb = processed[i].fb;
+            dlib::deserialize(fb.filters, in);
+            dlib::deserialize(fb.row_filters, in);
+            dlib::deserialize(fb.col_filters, in);
+            haveFilterbanks = haveFilterbanks && IsFilterbankOf(fb, processed[i].w);
+          }
+        }
+      } catch (std::exception&) {
+        haveFilterbanks = false;
+      }
+    }
+
+    std::shared_ptr<DetectorModel> model = std::make_shared<DetectorModel>();
+    if (haveFilterbanks) {
+      model->detector = object_detector_type(scanner, overlapTester, processed);
+    } else {
+      std::vector<dlib::matrix<double, 0, 1> > weights(processed.size());
+      for (size_t i = 0; i < processed.size(); ++i) {
+        weights[i] = processed[i].w;
+      }
+      model->detector = object_detector_type(scanner, overlapTester, weights);
+    }
+    return model;
+  }
+
+  enum DetectorSection {
+    kScannerSection = 1,
+    kOverlapTesterSection = 2,
+    kDimensionsSection = 3,
+    kWeightsSection = 4,
+    kFiltersSection = 5,
+    kSeparableCountsSection = 6,
+    kRowFiltersSection = 7,
+    kColFiltersSection = 8
+  };
+
+  // Indexes of the values of kDimensionsSection.
+  enum DetectorDimension {
+    kNumDetectors,
+    kNumWeights,
+    kNumPlanes,
+    kFilterRows,
+    kFilterCols,
+    kDimensionCount
+  };
+
+  void Detector::SaveModelFile(const object_detector_type& detector, const std::string& path) {
+    ModelFileWriter writer(ModelFile::kDetector);
+
+    // The scanner settings and overlap tester are a few bytes each, so they
+    // are kept in dlib's format.
+    std::ostringstream scanner;
+    image_scanner_type configuration;
+    configuration.copy_configuration(detector.get_scanner());
+    dlib::serialize(configuration, scanner);
+    writer.Add(kScannerSection, scanner.str().data(), scanner.str().size());
+
+    std::ostringstream overlapTester;
+    dlib::serialize(detector.get_overlap_tester(), overlapTester);
+    writer.Add(kOverlapTesterSection, overlapTester.str().data(), overlapTester.str().size());
+
+    const image_scanner_type::fhog_filterbank& first = detector.get_processed_w(0).get_detect_argument();
+    std::vector<uint32_t> dimensions(kDimensionCount);
+    dimensions[kNumDetectors] = detector.num_detectors();
+    dimensions[kNumWeights] = detector.get_w(0).size();
+    dimensions[kNumPlanes] = first.filters.size();
+    dimensions[kFilterRows] = first.filters[0].nr();
+    dimensions[kFilterCols] = first.filters[0].nc();
+
+    std::vector<double> weights;
+    std::vector<float> filters, rowFilters, colFilters;
+    std::vector<uint32_t> separableCounts;
+    for (unsigned long i = 0; i < detector.num_detectors(); ++i) {
+      const image_scanner_type::fhog_filterbank& fb = detector.get_processed_w(i).get_detect_argument();
+      weights.insert(weights.end(), detector.get_w(i).begin(), detector.get_w(i).end());
+
+      for (unsigned long p = 0; p < fb.filters.size(); ++p) {
+        if (fb.filters[p].nr() != dimensions[kFilterRows] || fb.filters[p].nc() != dimensions[kFilterCols]) {
+          throw std::runtime_error("Detector filters differ in size");
+        }
+        filters.insert(filters.end(), fb.filters[p].begin(), fb.filters[p].end());
+
+        separableCounts.push_back(fb.row_filters[p].size());
+        for (unsigned long j = 0; j < fb.row_filters[p].size(); ++j) {
+          rowFilters.insert(rowFilters.end(), fb.row_filters[p][j].begin(), fb.row_filters[p][j].end());
+          colFilters.insert(colFilters.end(), fb.col_filters[p][j].begin(), fb.col_filters[p][j].end());
+        }
+      }
+    }
+
+    writer.Add(kDimensionsSection, dimensions);
+    writer.Add(kWeightsSection, weights);
+    writer.Add(kFiltersSection, filters);
+    writer.Add(kSeparableCountsSection, separableCounts);
+    writer.Add(kRowFiltersSection, rowFilters);
+    writer.Add(kColFiltersSection, colFilters);
+    writer.Write(path);
+  }
+
+  std::shared_ptr<DetectorModel> Detector::LoadModelFile(const std::shared_ptr<const MappedFile>& file) {
+    ModelFileReader reader(file, ModelFile::kDetector);
+
+    image_scanner_type scanner;
+    std::istringstream scannerIn(reader.GetBytes(kScannerSection));
+    dlib::deserialize(scanner, scannerIn);
+
+    dlib::test_box_overlap overlapTester;
+    std::istringstream overlapTesterIn(reader.GetBytes(kOverlapTesterSection));
+    dlib::deserialize(overlapTester, overlapTesterIn);
+
+    const uint32_t* dimensions = reader.Get<uint32_t>(kDimensionsSection, kDimensionCount, "dimensions");
+    const size_t numDetectors = dimensions[kNumDetectors];
+    const size_t numWeights = dimensions[kNumWeights];
+    const size_t numPlanes = dimensions[kNumPlanes];
+    const long rows = dimensions[kFilterRows];
+    const long cols = dimensions[kFilterCols];
+    if (numDetectors == 0 || numWeights != static_cast<size_t>(scanner.get_num_dimensions()) + 1 ||
+        numPlanes * rows * cols != numWeights - 1) {
+      throw std::runtime_error("Model file doesn't match its detector settings");
+    }
+
+    const double* weights = reader.Get<double>(kWeightsSection, numDetectors * numWeights, "weights");
+    const float* filters = reader.Get<float>(kFiltersSection, numDetectors * numPlanes * rows * cols, "filters");
+    const uint32_t* separableCounts = reader.Get<uint32_t>(kSeparableCountsSection, numDetectors * numPlanes,
+                                                           "separable filter counts");
+    size_t numSeparable = 0;
+    for (size_t i = 0; i < numDetectors * numPlanes; ++i) {
+      numSeparable += separableCounts[i];
+    }
+    const float* rowFilters = reader.Get<float>(kRowFiltersSection, numSeparable * cols, "row filters");
+    const float* colFilters = reader.Get<float>(kColFiltersSection, numSeparable * rows, "column filters");
+
+    // The processed filterbanks are copied as they are, rather than
+    // recomputed from the weights by an SVD of every filter.
+    std::vector<dlib::processed_weight_vector<image_scanner_type> > processed(numDetectors);
+    for (size_t i = 0; i < numDetectors; ++i) {
+      processed[i].w = dlib::mat(weights + i * numWeights, numWeights);
+
+      image_scanner_type::fhog_filterbank& fb = processed[i].fb;
+      fb.filters.resize(numPlanes);
+      fb.row_filters.resize(numPlanes);
+      fb.col_filters.resize(numPlanes);
+      for (size_t p = 0; p < numPlanes; ++p) {
+        fb.filters[p] = dlib::mat(filters + (i * numPlanes + p) * rows * cols, rows, cols);
+
+        for (uint32_t j = 0; j < separableCounts[i * numPlanes + p]; ++j) {
+          fb.row_filters[p].push_back(dlib::mat(rowFilters, cols));
+          fb.col_filters[p].push_back(dlib::mat(colFilters, rows));
+          rowFilters += cols;
+          colFilters += rows;
+        }
+      }
+    }
+
+    std::shared_ptr<DetectorModel> model = std::make_shared<DetectorModel>();
+    model->detector = object_detector_type(scanner, overlapTester, processed);
+    return model;
+  }
+
+  std::vector<dlib::rect_detection> Detector::Detect(const ImageSource& source, const DetectOptions& options) const {
+    dlib::array2d<unsigned char> img;
+    DetectionScratch scratch;
+    return Detect(source, options, img, scratch);
+  }
+
+  std::vector<dlib::rect_detection> Detector::Detect(const ImageSource& source, const DetectOptions& options,
+                                                     dlib::array2d<unsigned char>& img,
+                                                     DetectionScratch& scratch) const {
+    DetectionTimings timings;
+    DetectOptions timed = options;
+    if (!timed.timings) {
+      timed.timings = &timings;
+    }
+
+    model->metrics->Api(kDetectApi).counters[kCallsCounter].Add();
+    StageClock clock(true);
+    TraceScope trace("detect");
+    try {
+      if (options.control) {
+        options.control->Check();
+      }
+
+      std::vector<dlib::rect_detection> dets;
+      if (source.IsGrayPixels()) {
+        // Scan the caller's pixels in place.
+        dets = Detect(source.GrayPixels(), timed, scratch);
+      } else {
+        ImageScale scale;
+        Load(source, LimitsFor(options), img, scale, *timed.timings);
+        dets = Detect(img, timed, scratch);
+        for (unsigned long i = 0; i < dets.size() && !scale.IsIdentity(); ++i) {
+          dets[i].rect = scale.Up(dets[i].rect);
+        }
+      }
+
+      Record(*timed.timings, clock.Lap(), !source.IsGrayPixels(), false);
+      return dets;
+    } catch (std::exception& e) {
+      model->metrics->Failed(kDetectApi, e);
+      throw;
+    }
+  }
+
+  std::vector<dlib::full_detection> Detector::DetectWithShapes(const ImageSource& source, const Predictor& predictor,
+                                                               const DetectOptions& options, long& cols, long& rows) const {
+    DetectionTimings timings;
+    DetectOptions timed = options;
+    if (!timed.timings) {
+      timed.timings = &timings;
+    }
+
+    model->metrics->Api(kDetectApi).counters[kCallsCounter].Add();
+    StageClock clock(true);
+    TraceScope trace("detect");
+    try {
+      std::vector<dlib::full_detection> dets;
+      if (source.IsGrayPixels()) {
+        RawImage<unsigned char> pixels = source.GrayPixels();
+        cols = pixels.cols;
+        rows = pixels.rows;
+        dets = DetectWithShapes(pixels, predictor, timed);
+      } else {
+        dlib::array2d<unsigned char> img;
+        ImageScale scale;
+        Load(source, LimitsFor(options), img, scale, *timed.timings);
+        cols = scale.cols;
+        rows = scale.rows;
+        dets = DetectWithShapes(img, predictor, timed);
+        for (unsigned long i = 0; i < dets.size() && !scale.IsIdentity(); ++i) {
+          dets[i].rect = scale.Up(dets[i].rect);
+        }
+      }
+
+      Record(*timed.timings, clock.Lap(), !source.IsGrayPixels(), true);
+      return dets;
+    } catch (std::exception& e) {
+      model->metrics->Failed(kDetectApi, e);
+      throw;
+    }
+  }
+
+  DecodeLimits Detector::LimitsFor(const DetectOptions& options) const {
+    DecodeLimits limits;
+    if (options.maxDimension == 0 && options.minObjectSize == 0) {
+      return limits;
+    }
+
+    limits.maxScaleDenom = 8;
+    limits.minSize = options.maxDimension;
+    if (options.minObjectSize > 0) {
+      // An object stays detectable as long as it is no smaller than the
+      // detection window once shrunk.
+      const image_scanner_type& scanner = model->detector.get_scanner();
+      const double window = std::max(scanner.get_detection_window_width(), scanner.get_detection_window_height());
+      while (limits.maxScaleDenom > 1 && options.minObjectSize < limits.maxScaleDenom * window) {
+        limits.maxScaleDenom /= 2;
+      }
+    }
+    return limits;
+  }
+
+  void Detector::Load(const ImageSource& source, const DecodeLimits& limits, dlib::array2d<unsigned char>& img,
+                      ImageScale& scale, DetectionTimings& timings) const {
+    StageClock clock(true);
+    try {
+      source.Load(img, limits, scale);
+    } catch (std::exception&) {
+      model->metrics->Api(kDetectApi).counters[kDecodeErrorsCounter].Add();
+      throw;
+    }
+    timings.decode = clock.Lap();
+  }
+
+  void Detector::Record(const DetectionTimings& timings, uint64_t latency, bool decoded, bool withShapes) const {
+    ModelMetrics& metrics = *model->metrics;
+    ApiMetrics& detect = metrics.Api(kDetectApi);
+    detect.latency.Record(latency);
+    detect.counters[kCandidatesCounter].Add(timings.candidates);
+    detect.counters[kDetectionsCounter].Add(timings.detections);
+
+    if (decoded) {
+      metrics.Stage(kDecodeStage).Record(timings.decode);
+    }
+    metrics.Stage(kPyramidStage).Record(timings.pyramid);
+    metrics.Stage(kFhogStage).Record(timings.fhog);
+    metrics.Stage(kFilterStage).Record(timings.filter);
+    metrics.Stage(kThresholdStage).Record(timings.threshold);
+    metrics.Stage(kNmsStage).Record(timings.nms);
+    if (withShapes) {
+      metrics.Stage(kShapesStage).Record(timings.shapes);
+    }
+  }
+
+  bool Detector::HasOptions(const FunctionCallbackInfo<Value>& args, int index) {
+    return args.Length() > index && args[index]->IsObject() && !args[index]->IsFunction();
+  }
+
+  Detector::DetectOptions Detector::ParseOptions(Isolate* isolate, Local<Value> value) {
+    DetectOptions detectOptions;
+    if (value->IsUndefined() || !value->IsObject()) {
+      return detectOptions;
+    }
+
+    Local<Object> options = value->ToObject();
+
+    Local<Value> optPacked = options->Get(String::NewFromUtf8(isolate, "packed"));
+    if (!optPacked->IsUndefined()) {
+      detectOptions.packed = optPacked->BooleanValue();
+    }
+
+    Local<Value> optAdjustThreshold = options->Get(String::NewFromUtf8(isolate, "adjustThreshold"));
+    if (!optAdjustThreshold->IsUndefined()) {
+      detectOptions.adjustThreshold = optAdjustThreshold->NumberValue();
+    }
+
+    Local<Value> optMaxDimension = options->Get(String::NewFromUtf8(isolate, "maxDimension"));
+    if (!optMaxDimension->IsUndefined()) {
+      const double maxDimension = optMaxDimension->NumberValue();
+      if (!(maxDimension >= 1)) {
+        throw std::invalid_argument("maxDimension must be at least 1");
+      }
+      detectOptions.maxDimension = static_cast<unsigned long>(std::min(maxDimension, 1e9));
+    }
+
+    Local<Value> optMinObjectSize = options->Get(String::NewFromUtf8(isolate, "minObjectSize"));
+    if (!optMinObjectSize->IsUndefined()) {
+      detectOptions.minObjectSize = optMinObjectSize->NumberValue();
+      if (!(detectOptions.minObjectSize >= 0)) {
+        throw std::invalid_argument("minObjectSize must not be negative");
+      }
+    }
+
+    Local<Value> optMemoryBudget = options->Get(String::NewFromUtf8(isolate, "memoryBudget"));
+    if (!optMemoryBudget->IsUndefined()) {
+      detectOptions.memoryBudget = optMemoryBudget->NumberValue();
+      if (!(detectOptions.memoryBudget > 0)) {
+        throw std::invalid_argument("memoryBudget must be positive");
+      }
+    }
+
+    Local<Value> optTileThreads = options->Get(String::NewFromUtf8(isolate, "tileThreads"));
+    if (!optTileThreads->IsUndefined()) {
+      const double tileThreads = optTileThreads->NumberValue();
+      if (!(tileThreads >= 1 && tileThreads <= 256) || tileThreads != std::floor(tileThreads)) {
+        throw std::invalid_argument("tileThreads must be an integer from 1 to 256");
+      }
+      detectOptions.tileThreads = static_cast<unsigned int>(tileThreads);
+    }
+
+    Local<Value> optTimings = options->Get(String::NewFromUtf8(isolate, "timings"));
+    if (!optTimings->IsUndefined()) {
+      detectOptions.reportTimings = optTimings->BooleanValue();
+    }
+
+    return detectOptions;
+  }
+
+  Local<Value> Detector::ToResult(Isolate* isolate, const std::vector<dlib::rect_detection>& dets,
+                                  const DetectOptions& options) {
+    Local<Object> result;
+    if (!options.packed) {
+      result = ToArray(isolate, dets);
+    } else {
+      const size_t length = dets.size() * kPackedDetectionSize;
+      Local<ArrayBuffer> buffer = ArrayBuffer::New(isolate, length * sizeof(float));
+      float* out = static_cast<float*>(buffer->GetContents().Data());
+      for (unsigned int i = 0; i < dets.size(); ++i) {
+        Pack(dets[i].rect, dets[i].detection_confidence, dets[i].weight_index, out + i * kPackedDetectionSize);
+      }
+      result = Float32Array::New(buffer, 0, length);
+    }
+
+    // The detections stay where they were, so callers that don't ask for
+    // timings see no difference.
+    if (options.timings) {
+      result->Set(String::NewFromUtf8(isolate, "timings"), ToObject(isolate, *options.timings, false));
+    }
+    return result;
+  }
+
+  Local<Value> Detector::ToResult(Isolate* isolate, const std::vector<dlib::full_detection>& dets,
+                                  long cols, long rows, const DetectOptions& options) {
+    if (!options.packed) {
+      Local<Array> rectangles = Array::New(isolate, dets.size());
+      for (unsigned int i = 0; i < dets.size(); ++i) {
+        HandleScope scope(isolate);
+        Local<Object> rectangle = ToObject(isolate, dets[i].rect.get_rect(), dets[i].detection_confidence,
+                                           dets[i].weight_index);
+        rectangle->Set(GetPropertyName(isolate, kShape), Predictor::ToArray(isolate, dets[i].rect, cols, rows));
+        rectangles->Set(i, rectangle);
+      }
+
+      if (options.timings) {
+        rectangles->Set(String::NewFromUtf8(isolate, "timings"), ToObject(isolate, *options.timings, true));
+      }
+      return rectangles;
+    }
+
+    // {detections, shapes}, with every shape packed as [x0, y0, x1, y1, ...]
+    // in the order of the detections.
+    const size_t shapeSize = dets.empty() ? 0 : 2 * dets[0].rect.num_parts();
+    const size_t detectionsLength = dets.size() * kPackedDetectionSize;
+    const size_t shapesLength = dets.size() * shapeSize;
+
+    Local<ArrayBuffer> detectionsBuffer = ArrayBuffer::New(isolate, detectionsLength * sizeof(float));
+    Local<ArrayBuffer> shapesBuffer = ArrayBuffer::New(isolate, shapesLength * sizeof(float));
+    float* detectionsOut = static_cast<float*>(detectionsBuffer->GetContents().Data());
+    float* shapesOut = static_cast<float*>(shapesBuffer->GetContents().Data());
+    for (unsigned int i = 0; i < dets.size(); ++i) {
+      Pack(dets[i].rect.get_rect(), dets[i].detection_confidence, dets[i].weight_index,
+           detectionsOut + i * kPackedDetectionSize);
+      Predictor::Pack(dets[i].rect, shapesOut + i * shapeSize);
+    }
+
+    Local<Object> result = Object::New(isolate);
+    result->Set(GetPropertyName(isolate, kDetections), Float32Array::New(detectionsBuffer, 0, detectionsLength));
+    result->Set(GetPropertyName(isolate, kShapes), Float32Array::New(shapesBuffer, 0, shapesLength));
+    if (options.timings) {
+      result->Set(String::NewFromUtf8(isolate, "timings"), ToObject(isolate, *options.timings, true));
+    }
+    return result;
+  }
+
+  Local<Object> Detector::ToObject(Isolate* isolate, const dlib::rectangle& det, double score,
+                                   unsigned long weightIndex) {
+    double left = det.left();
+    double top = det.top();
+    double width = det.right() - det.left();
+    double height = det.bottom() - det.top();
+
+    Local<Object> rectangle = Object::New(isolate);
+    rectangle->Set(GetPropertyName(isolate, kLeft), Number::New(isolate, left));
+    rectangle->Set(GetPropertyName(isolate, kTop), Number::New(isolate, top));
+    rectangle->Set(GetPropertyName(isolate, kWidth), Number::New(isolate, width));
+    rectangle->Set(GetPropertyName(isolate, kHeight), Number::New(isolate, height));
+    rectangle->Set(GetPropertyName(isolate, kScore), Number::New(isolate, score));
+    rectangle->Set(GetPropertyName(isolate, kDetectorIndex), Number::New(isolate, weightIndex));
+    return rectangle;
+  }
+
+  Local<Object> Detector::ToObject(Isolate* isolate, const DetectionTimings& timings, bool withShapes) {
+    Local<Array> levels = Array::New(isolate, timings.levels.size());
+    for (unsigned int i = 0; i < timings.levels.size(); ++i) {
+      const DetectionTimings::Level& level = timings.levels[i];
+      Local<Object> entry = Object::New(isolate);
+      entry->Set(GetPropertyName(isolate, kWidth), Number::New(isolate, level.width));
+      entry->Set(GetPropertyName(isolate, kHeight), Number::New(isolate, level.height));
+      entry->Set(String::NewFromUtf8(isolate, "pyramid"), Number::New(isolate, level.pyramid));
+      entry->Set(String::NewFromUtf8(isolate, "fhog"), Number::New(isolate, level.fhog));
+      entry->Set(String::NewFromUtf8(isolate, "filter"), Number::New(isolate, level.filter));
+      entry->Set(String::NewFromUtf8(isolate, "threshold"), Number::New(isolate, level.threshold));
+      levels->Set(i, entry);
+    }
+
+    Local<Object> result = Object::New(isolate);
+    result->Set(String::NewFromUtf8(isolate, "decode"), Number::New(isolate, timings.decode));
+    result->Set(String::NewFromUtf8(isolate, "pyramid"), Number::New(isolate, timings.pyramid));
+    result->Set(String::NewFromUtf8(isolate, "fhog"), Number::New(isolate, timings.fhog));
+    result->Set(String::NewFromUtf8(isolate, "filter"), Number::New(isolate, timings.filter));
+    result->Set(String::NewFromUtf8(isolate, "threshold"), Number::New(isolate, timings.threshold));
+    result->Set(String::NewFromUtf8(isolate, "nms"), Number::New(isolate, timings.nms));
+    if (withShapes) {
+      result->Set(String::NewFromUtf8(isolate, "shapes"), Number::New(isolate, timings.shapes));
+    }
+    result->Set(String::NewFromUtf8(isolate, "levels"), levels);
+    result->Set(String::NewFromUtf8(isolate, "pyramidLevels"), Number::New(isolate, timings.levels.size()));
+    result->Set(String::NewFromUtf8(isolate, "candidates"), Number::New(isolate, timings.candidates));
+    result->Set(GetPropertyName(isolate, kDetections), Number::New(isolate, timings.detections));
+    return result;
+  }
+
+  Local<Array> Detector::ToArray(Isolate* isolate, const std::vector<dlib::rect_detection>& dets) {
+    Local<Array> rectangles = Array::New(isolate, dets.size());
+    for (unsigned int i = 0; i < dets.size(); ++i) {
+      HandleScope scope(isolate);
+      rectangles->Set(i, ToObject(isolate, dets[i].rect, dets[i].detection_confidence, dets[i].weight_index));
+    }
+
+    return rectangles;
+  }
+
+  void Detector::Pack(const dlib::rectangle& rect, double score, unsigned long weightIndex, float* out) {
+    out[0] = rect.left();
+    out[1] = rect.top();
+    out[2] = rect.right() - rect.left();
+    out[3] = rect.bottom() - rect.top();
+    out[4] = score;
+    out[5] = weightIndex;
+  }
+
+  void Detector::DetectInImage(const FunctionCallbackInfo<Value>& args) {
+    Isolate* isolate = args.GetIsolate();
+
+    try {
+      Detector* obj = ObjectWrap::Unwrap<Detector>(args.Holder());
+      ImageSource source(isolate, args[0]);
+      DetectOptions options = ParseOptions(isolate, args[1]);
+      DetectionTimings timings;
+      if (options.reportTimings) {
+        options.timings = &timings;
+      }
+
+      std::vector<dlib::rect_detection> dets = obj->Detect(source, options);
+
+      HandleScope scope(isolate);
+      args.GetReturnValue().Set(ToResult(isolate, dets, options));
+    } catch (std::exception& e) {
+      isolate->ThrowException(Exception::Error(String::NewFromUtf8(isolate, e.what())));
+    }
+  }
+
+  // Decodes and scans an image on the thread pool.
+  class DetectWorker : public AsyncWorker {
+   public:
+    DetectWorker(Isolate* isolate, Detector* detector, const ImageSource& source,
+                 const Detector::DetectOptions& options)
+      : AsyncWorker(isolate), detector(detector), source(source), options(options) {
+      this->options.control = &Control();
+      if (options.reportTimings) {
+        this->options.timings = &timings;
+      }
+    }
+
+   protected:
+    void Execute() {
+      dets = detector->Detect(source, options);
+    }
+
+    Local<Value> Result() {
+      return Detector::ToResult(isolate, dets, options);
+    }
+
+   private:
+    Detector* detector;
+    ImageSource source;
+    Detector::DetectOptions options;
+    DetectionTimings timings;
+    std::vector<dlib::rect_detection> dets;
+  };
+
+  void Detector::DetectInImageAsync(const FunctionCallbackInfo<Value>& args) {
+    Isolate* isolate = args.GetIsolate();
+
+    try {
+      Detector* obj = ObjectWrap::Unwrap<Detector>(args.Holder());
+      bool hasOptions = HasOptions(args, 1);
+      DetectOptions options = hasOptions ? ParseOptions(isolate, args[1]) : DetectOptions();
+
+      // Owned here until queued, in case the job options are invalid.
+      std::unique_ptr<DetectWorker> worker(new DetectWorker(isolate, obj, ImageSource(isolate, args[0]), options));
+      if (hasOptions) {
+        worker->SetJobOptions(args[1]);
+      }
+      // Keep the detector and any Buffer or pixels being read from being
+      // collected while the scan is in flight.
+      worker->SaveToPersistent(0, args.Holder());
+      worker->SaveToPersistent(1, args[0]);
+      args.GetReturnValue().Set(worker.release()->Queue(args[hasOptions ? 2 : 1]));
+    } catch (std::exception& e) {
+      isolate->ThrowException(Exception::Error(String::NewFromUtf8(isolate, e.what())));
+    }
+  }
+
   void Detector::DetectInImageFile(const FunctionCallbackInfo<Value>& args) {
     Isolate* isolate = args.GetIsolate();
 
-    if (args.Length() != 1) {
+    if (args.Length() < 1 || args.Length() > 2) {
       isolate->ThrowException(Exception::TypeError(
           String::NewFromUtf8(isolate, "Wrong number of arguments")));
       return;
     }
 
+    DetectInImage(args);
+  }
+
+  void Detector::DetectInImageFileAsync(const FunctionCallbackInfo<Value>& args) {
+    Isolate* isolate = args.GetIsolate();
+
+    if (args.Length() < 1 || args.Length() > 3) {
+      isolate->ThrowException(Exception::TypeError(
+          String::NewFromUtf8(isolate, "Wrong number of arguments")));
+      return;
+    }
+
+    DetectInImageAsync(args);
+  }
+
+  void Detector::DetectInBuffer(const FunctionCallbackInfo<Value>& args) {
+    Isolate* isolate = args.GetIsolate();
+
+    if (args.Length() < 1 || args.Length() > 2 || !ImageSource::IsBuffer(args[0])) {
+      isolate->ThrowException(Exception::TypeError(
+          String::NewFromUtf8(isolate, "Wrong number/type of arguments")));
+      return;
+    }
+
+    DetectInImage(args);
+  }
+
+  void Detector::DetectInBufferAsync(const FunctionCallbackInfo<Value>& args) {
+    Isolate* isolate = args.GetIsolate();
+
+    if (args.Length() < 1 || args.Length() > 3 || !ImageSource::IsBuffer(args[0])) {
+      isolate->ThrowException(Exception::TypeError(
+          String::NewFromUtf8(isolate, "Wrong number/type of arguments")));
+      return;
+    }
+
+    DetectInImageAsync(args);
+  }
+
+  void Detector::DetectInPixels(const FunctionCallbackInfo<Value>& args) {
+    Isolate* isolate = args.GetIsolate();
+
+    if (args.Length() < 1 || args.Length() > 2 || !ImageSource::IsPixels(isolate, args[0])) {
+      isolate->ThrowException(Exception::TypeError(
+          String::NewFromUtf8(isolate, "Wrong number/type of arguments")));
+      return;
+    }
+
+    DetectInImage(args);
+  }
+
+  void Detector::DetectInPixelsAsync(const FunctionCallbackInfo<Value>& args) {
+    Isolate* isolate = args.GetIsolate();
+
+    if (args.Length() < 1 || args.Length() > 3 || !ImageSource::IsPixels(isolate, args[0])) {
+      isolate->ThrowException(Exception::TypeError(
+          String::NewFromUtf8(isolate, "Wrong number/type of arguments")));
+      return;
+    }
+
+    DetectInImageAsync(args);
+  }
+
+  // Decodes and scans a list of images on several thread pool threads at
+  // once. Each thread takes the next unclaimed image.
+  class BatchDetectWorker : public AsyncWorker {
+   public:
+    BatchDetectWorker(Isolate* isolate, Detector* detector, const std::vector<ImageSource>& sources,
+                      const Detector::DetectOptions& options, bool streaming)
+      : AsyncWorker(isolate), detector(detector), sources(sources), options(options), results(sources.size()),
+        next(0) {
+      this->options.control = &Control();
+      if (streaming) {
+        EnableProgress();
+      }
+    }
+
+   protected:
+    void Execute() {
+      // Reused for every image this thread decodes and scans.
+      dlib::array2d<unsigned char> img;
+      DetectionScratch scratch;
+
+      for (size_t i = next++; i < sources.size(); i = next++) {
+        try {
+          results[i].dets = detector->Detect(sources[i], OptionsFor(i), img, scratch);
+        } catch (JobError& e) {
+          // Cancellation and deadlines apply to the whole batch.
+          throw;
+        } catch (std::exception& e) {
+          // A bad image only fails its own entry, not the whole batch.
+          results[i].error = e.what();
+          if (results[i].error.empty()) {
+            results[i].error = "Unknown error";
+          }
+        }
+
+        {
+          std::lock_guard<std::mutex> lock(finishedMutex);
+          finished.push_back(i);
+        }
+        NotifyProgress();
+      }
+    }
+
+    // Calls onResult(err, detections, index) for every image that finished
+    // since the last call.
+    void HandleProgress() {
+      std::vector<size_t> ready;
+      {
+        std::lock_guard<std::mutex> lock(finishedMutex);
+        ready.swap(finished);
+      }
+
+      Local<Function> onResult = GetFromPersistent(2).As<Function>();
+      for (unsigned int i = 0; i < ready.size(); ++i) {
+        HandleScope scope(isolate);
+        const int argc = 3;
+        Local<Value> argv[argc] = { Null(isolate), Undefined(isolate), Number::New(isolate, ready[i]) };
+        if (results[ready[i]].error.empty()) {
+          argv[1] = Detector::ToResult(isolate, results[ready[i]].dets, OptionsFor(ready[i]));
+        } else {
+          argv[0] = Exception::Error(String::NewFromUtf8(isolate, results[ready[i]].error.c_str()));
+        }
+        node::MakeCallback(isolate, isolate->GetCurrentContext()->Global(), onResult, argc, argv);
+      }
+    }
+
+    // Detections in input order, with an Error in place of every image that
+    // could not be read.
+    Local<Value> Result() {
+      Local<Array> all = Array::New(isolate, results.size());
+      for (unsigned int i = 0; i < results.size(); ++i) {
+        HandleScope scope(isolate);
+        if (results[i].error.empty()) {
+          all->Set(i, Detector::ToResult(isolate, results[i].dets, OptionsFor(i)));
+        } else {
+          all->Set(i, Exception::Error(String::NewFromUtf8(isolate, results[i].error.c_str())));
+        }
+      }
+
+      return all;
+    }
+
+   private:
+    struct ImageResult {
+      std::vector<dlib::rect_detection> dets;
+      DetectionTimings timings;
+      std::string error;
+    };
+
+    // Every image is timed on its own.
+    Detector::DetectOptions OptionsFor(size_t index) {
+      Detector::DetectOptions imageOptions = options;
+      if (options.reportTimings) {
+        imageOptions.timings = &results[index].timings;
+      }
+      return imageOptions;
+    }
+
+    Detector* detector;
+    std::vector<ImageSource> sources;
+    Detector::DetectOptions options;
+    std::vector<ImageResult> results;
+    std::atomic<size_t> next;
+
+    std::mutex finishedMutex;
+    std::vector<size_t> finished;
+  };
+
+  void Detector::DetectInImageFiles(const FunctionCallbackInfo<Value>& args) {
+    Isolate* isolate = args.GetIsolate();
+
+    if (args.Length() < 1 || args.Length() > 3 || !args[0]->IsArray()) {
+      isolate->ThrowException(Exception::TypeError(
+          String::NewFromUtf8(isolate, "Wrong number/type of arguments")));
+      return;
+    }
+
     try {
       Detector* obj = ObjectWrap::Unwrap<Detector>(args.Holder());
-      v8::String::Utf8Value imgPath(args[0]->ToString());
+      Local<Array> inputs = args[0].As<Array>();
 
-      dlib::array2d<unsigned char> img;
-      dlib::load_image(img, std::string(*imgPath));
+      std::vector<ImageSource> sources;
+      sources.reserve(inputs->Length());
+      for (unsigned int i = 0; i < inputs->Length(); ++i) {
+        sources.push_back(ImageSource(isolate, inputs->Get(i)));
+      }
 
-      std::vector<dlib::rectangle> dets = obj->dlibObjectDetector(img);
+      // Matches the default size of the libuv thread pool.
+      unsigned int concurrency = 4;
+      Local<Value> onResult = Undefined(isolate);
+      Local<Value> callback = args[1];
+      DetectOptions detectOptions;
+      if (HasOptions(args, 1)) {
+        Local<Object> options = args[1]->ToObject();
+        callback = args[2];
+        detectOptions = ParseOptions(isolate, options);
+
+        Local<Value> optConcurrency = options->Get(String::NewFromUtf8(isolate, "concurrency"));
+        if (!optConcurrency->IsUndefined()) {
+          if (optConcurrency->IntegerValue() < 1) {
+            isolate->ThrowException(Exception::RangeError(
+                String::NewFromUtf8(isolate, "concurrency must be at least 1")));
+            return;
+          }
+          concurrency = optConcurrency->IntegerValue();
+        }
+
+        onResult = options->Get(String::NewFromUtf8(isolate, "onResult"));
+        if (!onResult->IsUndefined() && !onResult->IsFunction()) {
+          isolate->ThrowException(Exception::TypeError(
+              String::NewFromUtf8(isolate, "onResult must be a function")));
+          return;
+        }
+      }
+
+      if (concurrency > sources.size()) {
+        concurrency = sources.size();
+      }
+
+      // Owned here until queued, in case the job options are invalid.
+      std::unique_ptr<BatchDetectWorker> worker(new BatchDetectWorker(isolate, obj, sources, detectOptions, onResult->IsFunction()));
+      if (HasOptions(args, 1)) {
+        worker->SetJobOptions(args[1]);
+      }
+      // Keeps the detector, the input Buffers and pixels and the onResult
+      // callback alive until the batch is done.
+      worker->SaveToPersistent(0, args.Holder());
+      worker->SaveToPersistent(1, inputs);
+      worker->SaveToPersistent(2, onResult);
+      args.GetReturnValue().Set(worker.release()->Queue(callback, concurrency));
+    } catch (std::exception& e) {
+      isolate->ThrowException(Exception::Error(String::NewFromUtf8(isolate, e.what())));
+    }
+  }
+
+  void Detector::DetectWithShapes(const FunctionCallbackInfo<Value>& args) {
+    Isolate* isolate = args.GetIsolate();
+
+    if (args.Length() < 2 || args.Length() > 3 || !Predictor::HasInstance(isolate, args[1])) {
+      isolate->ThrowException(Exception::TypeError(
+          String::NewFromUtf8(isolate, "Wrong number/type of arguments")));
+      return;
+    }
+
+    try {
+      Detector* obj = ObjectWrap::Unwrap<Detector>(args.Holder());
+      Predictor* predictor = ObjectWrap::Unwrap<Predictor>(args[1]->ToObject());
+      ImageSource source(isolate, args[0]);
+      DetectOptions options = ParseOptions(isolate, args[2]);
+      DetectionTimings timings;
+      if (options.reportTimings) {
+        options.timings = &timings;
+      }
+
+      long cols, rows;
+      std::vector<dlib::full_detection> dets = obj->DetectWithShapes(source, *predictor, options, cols, rows);
 
       HandleScope scope(isolate);
-      Local<Array> rectangles = Array::New(isolate);
-      for (unsigned int i = 0; i < dets.size(); ++i) {
-        double left = dets[i].left();
-        double top = dets[i].top();
-        double width = dets[i].right() - dets[i].left();
-        double height = dets[i].bottom() - dets[i].top();
+      args.GetReturnValue().Set(ToResult(isolate, dets, cols, rows, options));
+    } catch (std::exception& e) {
+      isolate->ThrowException(Exception::Error(String::NewFromUtf8(isolate, e.what())));
+    }
+  }
 
-        HandleScope scope(isolate);
-        Local<Object> rectangle = Object::New(isolate);
-        rectangle->Set(String::NewFromUtf8(isolate, "left"), Number::New(isolate, left));
-        rectangle->Set(String::NewFromUtf8(isolate, "top"), Number::New(isolate, top));
-        rectangle->Set(String::NewFromUtf8(isolate, "width"), Number::New(isolate, width));
-        rectangle->Set(String::NewFromUtf8(isolate, "height"), Number::New(isolate, height));
-        rectangles->Set(i, rectangle);
+  // Decodes an image, scans it and predicts a shape for every detection on
+  // the thread pool.
+  class ShapesWorker : public AsyncWorker {
+   public:
+    ShapesWorker(Isolate* isolate, Detector* detector, Predictor* predictor, const ImageSource& source,
+                 const Detector::DetectOptions& options)
+      : AsyncWorker(isolate), detector(detector), predictor(predictor), source(source), options(options),
+        cols(0), rows(0) {
+      this->options.control = &Control();
+      if (options.reportTimings) {
+        this->options.timings = &timings;
       }
+    }
+
+   protected:
+    void Execute() {
+      dets = detector->DetectWithShapes(source, *predictor, options, cols, rows);
+    }
+
+    Local<Value> Result() {
+      return Detector::ToResult(isolate, dets, cols, rows, options);
+    }
+
+   private:
+    Detector* detector;
+    Predictor* predictor;
+    ImageSource source;
+    Detector::DetectOptions options;
+    DetectionTimings timings;
+    std::vector<dlib::full_detection> dets;
+    long cols;
+    long rows;
+  };
 
-      args.GetReturnValue().Set(rectangles);
+  void Detector::DetectWithShapesAsync(const FunctionCallbackInfo<Value>& args) {
+    Isolate* isolate = args.GetIsolate();
+
+    if (args.Length() < 2 || args.Length() > 4 || !Predictor::HasInstance(isolate, args[1])) {
+      isolate->ThrowException(Exception::TypeError(
+          String::NewFromUtf8(isolate, "Wrong number/type of arguments")));
+      return;
+    }
+
+    try {
+      Detector* obj = ObjectWrap::Unwrap<Detector>(args.Holder());
+      Predictor* predictor = ObjectWrap::Unwrap<Predictor>(args[1]->ToObject());
+      bool hasOptions = HasOptions(args, 2);
+      DetectOptions options = hasOptions ? ParseOptions(isolate, args[2]) : DetectOptions();
+
+      // Owned here until queued, in case the job options are invalid.
+      std::unique_ptr<ShapesWorker> worker(new ShapesWorker(isolate, obj, predictor, ImageSource(isolate, args[0]), options));
+      if (hasOptions) {
+        worker->SetJobOptions(args[2]);
+      }
+      worker->SaveToPersistent(0, args.Holder());
+      worker->SaveToPersistent(1, args[0]);
+      worker->SaveToPersistent(2, args[1]);
+      args.GetReturnValue().Set(worker.release()->Queue(args[hasOptions ? 3 : 2]));
     } catch (std::exception& e) {
       isolate->ThrowException(Exception::Error(String::NewFromUtf8(isolate, e.what())));
     }
   }
 
+  Detector::TrainOptions Detector::ParseTrainOptions(Isolate* isolate, Local<Value> value, TrainOptions options) {
+    if (value->IsUndefined() || !value->IsObject()) {
+      return options;
+    }
+
+    Local<Object> opts = value->ToObject();
+
+    Local<Value> optC = opts->Get(String::NewFromUtf8(isolate, "c"));
+    if (!optC->IsUndefined()) {
+      options.c = optC->NumberValue();
+    }
+
+    Local<Value> optWindowWidth = opts->Get(String::NewFromUtf8(isolate, "windowWidth"));
+    if (!optWindowWidth->IsUndefined()) {
+      options.windowWidth = optWindowWidth->NumberValue();
+    }
+
+    Local<Value> optWindowHeight = opts->Get(String::NewFromUtf8(isolate, "windowHeight"));
+    if (!optWindowHeight->IsUndefined()) {
+      options.windowHeight = optWindowHeight->NumberValue();
+    }
+
+    Local<Value> optEpsilon = opts->Get(String::NewFromUtf8(isolate, "epsilon"));
+    if (!optEpsilon->IsUndefined()) {
+      options.epsilon = optEpsilon->NumberValue();
+    }
+
+    Local<Value> optVerbose = opts->Get(String::NewFromUtf8(isolate, "verbose"));
+    if (!optVerbose->IsUndefined()) {
+      options.verbose = optVerbose->BooleanValue();
+    }
+
+    Local<Value> optScale = opts->Get(String::NewFromUtf8(isolate, "scaleUpImages"));
+    if (!optScale->IsUndefined()) {
+      options.scaleUpImages = optScale->BooleanValue();
+    }
+
+    Local<Value> optMirrors = opts->Get(String::NewFromUtf8(isolate, "includeMirrors"));
+    if (!optMirrors->IsUndefined()) {
+      options.includeMirrors = optMirrors->BooleanValue();
+    }
+
+    Local<Value> optThreads = opts->Get(String::NewFromUtf8(isolate, "threads"));
+    if (!optThreads->IsUndefined()) {
+      options.threads = optThreads->IntegerValue();
+    }
+
+    return options;
+  }
+
+  // Stands in for dlib's SVM problem when training a detector, reporting
+  // every iteration of the optimizer. Throwing from optimization_status()
+  // ends training, which is how cancellation gets in.
+  class MonitoredProblem : public dlib::oca_problem<dlib::matrix<double, 0, 1> > {
+   public:
+    typedef dlib::matrix<double, 0, 1> matrix_type;
+
+    // problem must outlive this object.
+    MonitoredProblem(const dlib::oca_problem<matrix_type>& problem, unsigned long numSamples,
+                     const TrainingReporter& report)
+      : problem(problem), numSamples(numSamples), report(report), samplesProcessed(0) {
+    }
+
+    bool risk_has_lower_bound(scalar_type& lowerBound) const {
+      return problem.risk_has_lower_bound(lowerBound);
+    }
+
+    bool optimization_status(scalar_type currentObjectiveValue, scalar_type currentErrorGap,
+                             scalar_type currentRiskValue, scalar_type currentRiskGap,
+                             unsigned long numCuttingPlanes, unsigned long numIterations) const {
+      TrainingStatus status;
+      status.iteration = numIterations;
+      status.riskGap = currentRiskGap;
+      status.samplesProcessed = samplesProcessed;
+      report(status);
+
+      return problem.optimization_status(currentObjectiveValue, currentErrorGap, currentRiskValue, currentRiskGap,
+                                         numCuttingPlanes, numIterations);
+    }
+
+    scalar_type get_c() const {
+      return problem.get_c();
+    }
+
+    long get_num_dimensions() const {
+      return problem.get_num_dimensions();
+    }
+
+    // Every evaluation of the risk runs the separation oracle over the whole
+    // training set, some of it answered from dlib's cache.
+    void get_risk(matrix_type& currentSolution, scalar_type& riskValue, matrix_type& riskSubgradient) const {
+      problem.get_risk(currentSolution, riskValue, riskSubgradient);
+      samplesProcessed += numSamples;
+    }
+
+   private:
+    const dlib::oca_problem<matrix_type>& problem;
+    unsigned long numSamples;
+    TrainingReporter report;
+    mutable unsigned long samplesProcessed;
+  };
+
+  std::shared_ptr<DetectorModel> Detector::Train(const std::string& xmlPath, const TrainOptions& options,
+                                                 const TrainingReporter& report) {
+    // A trained model is known by the file it was trained on.
+    ModelMetrics* metrics = ModelMetrics::Get("detector", xmlPath);
+    metrics->Api(kTrainApi).counters[kCallsCounter].Add();
+    StageClock clock(true);
+    try {
+      std::shared_ptr<DetectorModel> model = TrainModel(xmlPath, options, report);
+      model->metrics = metrics;
+      metrics->Api(kTrainApi).latency.Record(clock.Lap());
+      return model;
+    } catch (std::exception& e) {
+      metrics->Failed(kTrainApi, e);
+      throw;
+    }
+  }
+
+  std::shared_ptr<DetectorModel> Detector::TrainModel(const std::string& xmlPath, const TrainOptions& options,
+                                                      const TrainingReporter& report) {
+    dlib::array<dlib::array2d<unsigned char> > images_train;
+    std::vector<std::vector<dlib::rectangle> > face_boxes_train;
+    dlib::load_image_dataset(images_train, face_boxes_train, xmlPath);
+
+    if (options.scaleUpImages) {
+      // Double image size
+      dlib::upsample_image_dataset<dlib::pyramid_down<2> >(images_train, face_boxes_train);
+    }
+
+    if (options.includeMirrors) {
+      // Add mirror images
+      dlib::add_image_left_right_flips(images_train, face_boxes_train);
+    }
+
+    image_scanner_type scanner;
+    scanner.set_detection_window_size(options.windowWidth, options.windowHeight);
+    dlib::structural_object_detection_trainer<image_scanner_type> trainer(scanner);
+    trainer.set_num_threads(options.threads);
+    trainer.set_c(options.c);
+    trainer.set_epsilon(options.epsilon);
+
+    if (options.verbose) {
+      trainer.be_verbose();
+    }
+
+    std::shared_ptr<DetectorModel> model = std::make_shared<DetectorModel>();
+    if (!report) {
+      model->detector = trainer.train(images_train, face_boxes_train);
+      return model;
+    }
+
+    // What trainer.train() does, with a problem that reports its progress.
+    report(TrainingStatus());
+
+    std::vector<std::vector<dlib::full_object_detection> > truth(face_boxes_train.size());
+    for (unsigned long i = 0; i < face_boxes_train.size(); ++i) {
+      for (unsigned long j = 0; j < face_boxes_train[i].size(); ++j) {
+        truth[i].push_back(dlib::full_object_detection(face_boxes_train[i][j]));
+      }
+    }
+    std::vector<std::vector<dlib::rectangle> > ignore(images_train.size());
+
+    dlib::structural_svm_object_detection_problem<image_scanner_type, dlib::array<dlib::array2d<unsigned char> > >
+        problem(trainer.get_scanner(), trainer.get_overlap_tester(), trainer.auto_set_overlap_tester(), images_train,
+                truth, ignore, dlib::test_box_overlap(), trainer.get_num_threads());
+
+    if (options.verbose) {
+      problem.be_verbose();
+    }
+
+    problem.set_c(trainer.get_c());
+    problem.set_epsilon(trainer.get_epsilon());
+    problem.set_max_cache_size(trainer.get_max_cache_size());
+    problem.set_match_eps(trainer.get_match_eps());
+    problem.set_loss_per_missed_target(trainer.get_loss_per_missed_target());
+    problem.set_loss_per_false_alarm(trainer.get_loss_per_false_alarm());
+    dlib::configure_nuclear_norm_regularizer(trainer.get_scanner(), problem);
+
+    dlib::matrix<double, 0, 1> w;
+    trainer.get_oca()(MonitoredProblem(problem, images_train.size(), report), w);
+
+    model->detector = object_detector_type(trainer.get_scanner(), problem.get_overlap_tester(), w);
+    return model;
+  }
+
   void Detector::TrainFromXML(const FunctionCallbackInfo<Value>& args) {
     Isolate* isolate = args.GetIsolate();
 
@@ -121,86 +1335,154 @@ namespace ObjectDetector {
     }
 
     try {
-      Local<Function> cons = Local<Function>::New(isolate, constructor);
+      Local<Function> cons = Local<Function>::New(isolate, AddonData::Get(isolate)->detectorConstructor);
       Local<Object> inst = cons->NewInstance(0, 0);
       args.GetReturnValue().Set(inst);
 
       Detector* obj = ObjectWrap::Unwrap<Detector>(inst);
       v8::String::Utf8Value xmlPath(args[0]->ToString());
 
-      double c = 1, windowWidth = 80, windowHeight = 80, epsilon = 0.01;
-      bool verbose = true, scaleUpImages = false, includeMirrors = false;
-      int nThreads = 4;
-      if (args.Length() == 2 && !args[1]->IsUndefined() && args[1]->IsObject()) {
-        Local<Object> options = args[1]->ToObject();
+      TrainOptions options = ParseTrainOptions(isolate, args.Length() == 2 ? args[1] : Local<Value>(Undefined(isolate)),
+                                               TrainOptions());
+      obj->model = Train(*xmlPath, options, TrainingReporter());
+    } catch (std::exception& e) {
+      isolate->ThrowException(Exception::Error(String::NewFromUtf8(isolate, e.what())));
+    }
+  }
 
-        Local<Value> optC = options->Get(String::NewFromUtf8(isolate, "c"));
-        if (!optC->IsUndefined()) {
-          c = optC->NumberValue();
-        }
+  // Trains a detector on the thread pool and settles with a new Detector.
+  class DetectorTrainWorker : public TrainingWorker {
+   public:
+    DetectorTrainWorker(Isolate* isolate, const std::string& xmlPath, const Detector::TrainOptions& options,
+                        Local<Value> onProgress)
+      : TrainingWorker(isolate, onProgress), xmlPath(xmlPath), options(options) {
+    }
 
-        Local<Value> optWindowWidth = options->Get(String::NewFromUtf8(isolate, "windowWidth"));
-        if (!optWindowWidth->IsUndefined()) {
-          windowWidth = optWindowWidth->NumberValue();
-        }
+   protected:
+    void Execute() {
+      StartClock();
+      model = Detector::Train(xmlPath, options, Reporter());
+    }
 
-        Local<Value> optWindowHeight = options->Get(String::NewFromUtf8(isolate, "windowHeight"));
-        if (!optWindowHeight->IsUndefined()) {
-          windowHeight = optWindowHeight->NumberValue();
-        }
+    Local<Value> Result() {
+      Local<Function> cons = Local<Function>::New(isolate, AddonData::Get(isolate)->detectorConstructor);
+      Local<Object> inst = cons->NewInstance(0, 0);
+      node::ObjectWrap::Unwrap<Detector>(inst)->model = model;
+      return inst;
+    }
 
-        Local<Value> optEpsilon = options->Get(String::NewFromUtf8(isolate, "epsilon"));
-        if (!optEpsilon->IsUndefined()) {
-          epsilon = optEpsilon->NumberValue();
-        }
+   private:
+    std::string xmlPath;
+    Detector::TrainOptions options;
+    std::shared_ptr<DetectorModel> model;
+  };
 
-        Local<Value> optVerbose = options->Get(String::NewFromUtf8(isolate, "verbose"));
-        if (!optVerbose->IsUndefined()) {
-          verbose = optVerbose->BooleanValue();
-        }
+  void Detector::TrainFromXMLAsync(const FunctionCallbackInfo<Value>& args) {
+    Isolate* isolate = args.GetIsolate();
 
-        Local<Value> optScale = options->Get(String::NewFromUtf8(isolate, "scaleUpImages"));
-        if (!optScale->IsUndefined()) {
-          scaleUpImages = optScale->BooleanValue();
-        }
+    if (args.Length() < 1 || args.Length() > 3) {
+      isolate->ThrowException(Exception::TypeError(
+          String::NewFromUtf8(isolate, "Wrong number of arguments")));
+      return;
+    }
 
-        Local<Value> optMirrors = options->Get(String::NewFromUtf8(isolate, "includeMirrors"));
-        if (!optMirrors->IsUndefined()) {
-          includeMirrors = optMirrors->BooleanValue();
-        }
+    try {
+      v8::String::Utf8Value xmlPath(args[0]->ToString());
+
+      // Progress goes to onProgress rather than standard out unless asked for.
+      TrainOptions options;
+      options.verbose = false;
+      Local<Value> onProgress = Undefined(isolate);
+      bool hasOptions = HasOptions(args, 1);
+      if (hasOptions) {
+        options = ParseTrainOptions(isolate, args[1], options);
 
-        Local<Value> optThreads = options->Get(String::NewFromUtf8(isolate, "threads"));
-        if (!optThreads->IsUndefined()) {
-          nThreads = optThreads->IntegerValue();
+        onProgress = args[1]->ToObject()->Get(String::NewFromUtf8(isolate, "onProgress"));
+        if (!onProgress->IsUndefined() && !onProgress->IsFunction()) {
+          isolate->ThrowException(Exception::TypeError(
+              String::NewFromUtf8(isolate, "onProgress must be a function")));
+          return;
         }
       }
 
-      dlib::array<dlib::array2d<unsigned char> > images_train;
-      std::vector<std::vector<dlib::rectangle> > face_boxes_train;
-      dlib::load_image_dataset(images_train, face_boxes_train, *xmlPath);
-
-      if (scaleUpImages) {
-        // Double image size
-        dlib::upsample_image_dataset<dlib::pyramid_down<2> >(images_train, face_boxes_train);
+      // Owned here until queued, in case the job options are invalid.
+      std::unique_ptr<DetectorTrainWorker> worker(new DetectorTrainWorker(isolate, *xmlPath, options, onProgress));
+      if (hasOptions) {
+        worker->SetJobOptions(args[1]);
       }
+      args.GetReturnValue().Set(worker.release()->Queue(args[hasOptions ? 2 : 1]));
+    } catch (std::exception& e) {
+      isolate->ThrowException(Exception::Error(String::NewFromUtf8(isolate, e.what())));
+    }
+  }
 
-      if (includeMirrors) {
-        // Add mirror images
-        dlib::add_image_left_right_flips(images_train, face_boxes_train);
-      }
+  void Detector::FromBuffer(const FunctionCallbackInfo<Value>& args) {
+    Isolate* isolate = args.GetIsolate();
+
+    if (args.Length() != 1 || !node::Buffer::HasInstance(args[0])) {
+      isolate->ThrowException(Exception::TypeError(
+          String::NewFromUtf8(isolate, "Wrong number/type of arguments")));
+      return;
+    }
 
-      image_scanner_type scanner;
-      scanner.set_detection_window_size(windowWidth, windowHeight);
-      dlib::structural_object_detection_trainer<image_scanner_type> trainer(scanner);
-      trainer.set_num_threads(nThreads);
-      trainer.set_c(c);
-      trainer.set_epsilon(epsilon);
+    try {
+      std::shared_ptr<const DetectorModel> model = LoadModel(node::Buffer::Data(args[0]), node::Buffer::Length(args[0]));
 
-      if (verbose) {
-        trainer.be_verbose();
-      }
+      Local<Function> cons = Local<Function>::New(isolate, AddonData::Get(isolate)->detectorConstructor);
+      Local<Object> inst = cons->NewInstance(0, 0);
+      ObjectWrap::Unwrap<Detector>(inst)->model = model;
+      args.GetReturnValue().Set(inst);
+    } catch (std::exception& e) {
+      isolate->ThrowException(Exception::Error(String::NewFromUtf8(isolate, e.what())));
+    }
+  }
+
+  // Parses a model held in a Buffer on the thread pool.
+  class DetectorLoadWorker : public AsyncWorker {
+   public:
+    DetectorLoadWorker(Isolate* isolate, Local<Value> buffer)
+      : AsyncWorker(isolate), data(node::Buffer::Data(buffer)), size(node::Buffer::Length(buffer)) {
+    }
+
+   protected:
+    void Execute() {
+      Control().Check();
+      model = Detector::LoadModel(data, size);
+    }
+
+    Local<Value> Result() {
+      Local<Function> cons = Local<Function>::New(isolate, AddonData::Get(isolate)->detectorConstructor);
+      Local<Object> inst = cons->NewInstance(0, 0);
+      node::ObjectWrap::Unwrap<Detector>(inst)->model = model;
+      return inst;
+    }
+
+   private:
+    const char* data;
+    size_t size;
+    std::shared_ptr<const DetectorModel> model;
+  };
+
+  void Detector::FromBufferAsync(const FunctionCallbackInfo<Value>& args) {
+    Isolate* isolate = args.GetIsolate();
 
-      obj->dlibObjectDetector = trainer.train(images_train, face_boxes_train);
+    if (args.Length() < 1 || args.Length() > 3 || !node::Buffer::HasInstance(args[0])) {
+      isolate->ThrowException(Exception::TypeError(
+          String::NewFromUtf8(isolate, "Wrong number/type of arguments")));
+      return;
+    }
+
+    try {
+      bool hasOptions = HasOptions(args, 1);
+
+      // Owned here until queued, in case the job options are invalid.
+      std::unique_ptr<DetectorLoadWorker> worker(new DetectorLoadWorker(isolate, args[0]));
+      if (hasOptions) {
+        worker->SetJobOptions(args[1]);
+      }
+      // The Buffer is read in place, so keep it from being collected.
+      worker->SaveToPersistent(0, args[0]);
+      args.GetReturnValue().Set(worker.release()->Queue(args[hasOptions ? 2 : 1]));
     } catch (std::exception& e) {
       isolate->ThrowException(Exception::Error(String::NewFromUtf8(isolate, e.what())));
     }
@@ -218,7 +1500,32 @@ namespace ObjectDetector {
     try {
       Detector* obj = ObjectWrap::Unwrap<Detector>(args.Holder());
       v8::String::Utf8Value filePath(args[0]->ToString());
-      dlib::serialize(std::string(*filePath)) << obj->dlibObjectDetector;
+      std::ofstream out(*filePath, std::ios::binary | std::ios::trunc);
+      if (!out) {
+        throw std::runtime_error(std::string("Unable to open ") + *filePath + " for writing.");
+      }
+      WriteModel(obj->model->detector, out);
+      if (!out.flush()) {
+        throw std::runtime_error(std::string("Unable to write ") + *filePath);
+      }
+    } catch (std::exception& e) {
+      isolate->ThrowException(Exception::Error(String::NewFromUtf8(isolate, e.what())));
+    }
+  }
+
+  void Detector::SaveToBinaryFile(const FunctionCallbackInfo<Value>& args) {
+    Isolate* isolate = args.GetIsolate();
+
+    if (args.Length() != 1) {
+      isolate->ThrowException(Exception::TypeError(
+          String::NewFromUtf8(isolate, "Wrong number of arguments")));
+      return;
+    }
+
+    try {
+      Detector* obj = ObjectWrap::Unwrap<Detector>(args.Holder());
+      v8::String::Utf8Value filePath(args[0]->ToString());
+      SaveModelFile(obj->model->detector, *filePath);
     } catch (std::exception& e) {
       isolate->ThrowException(Exception::Error(String::NewFromUtf8(isolate, e.what())));
     }
@@ -236,7 +1543,7 @@ namespace ObjectDetector {
     try {
       Detector* obj = ObjectWrap::Unwrap<Detector>(args.Holder());
       v8::String::Utf8Value filePath(args[0]->ToString());
-      dlib::save_png(draw_fhog(obj->dlibObjectDetector), std::string(*filePath));
+      dlib::save_png(draw_fhog(obj->model->detector), std::string(*filePath));
     } catch (std::exception& e) {
       isolate->ThrowException(Exception::Error(String::NewFromUtf8(isolate, e.what())));
     }
@@ -5,34 +5,249 @@
 #include <node.h>
 #include <node_object_wrap.h>
 
+#include <iosfwd>
+#include <memory>
+#include <vector>
+
 #include "dlib/image_processing.h"
 #include "dlib/image_processing/frontal_face_detector.h"
 #include "dlib/data_io.h"
 
+#include "detection.h"
+#include "image_source.h"
+#include "mapped_file.h"
+#include "metrics.h"
+#include "predictor.h"
+#include "tiled_detection.h"
+#include "training.h"
+
 namespace ObjectDetector {
-  typedef dlib::scan_fhog_pyramid<dlib::pyramid_down<6> > image_scanner_type;
+  // A trained detector. It is never modified once loaded, and all scans
+  // bring their own DetectionScratch, so Detectors made from the same model
+  // share one copy of it and scan with it concurrently, including across
+  // worker threads.
+  struct DetectorModel {
+    DetectorModel() : metrics(ModelMetrics::Get("detector", "unnamed")) {
+    }
+
+    object_detector_type detector;
+
+    // Where calls using the model are counted. Set to a name for the model
+    // by whatever loads or trains it.
+    ModelMetrics* metrics;
+  };
 
   class Detector : public node::ObjectWrap {
    public:
     static void Init(v8::Local<v8::Object> exports);
     static void New(const v8::FunctionCallbackInfo<v8::Value>& args);
     static void TrainFromXML(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void TrainFromXMLAsync(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void FromBuffer(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void FromBufferAsync(const v8::FunctionCallbackInfo<v8::Value>& args);
 
    private:
-    explicit Detector() {
-      this->dlibObjectDetector = dlib::get_frontal_face_detector();
+    explicit Detector() : model(FrontalFaceModel()) {
     }
 
-    explicit Detector(std::string xmlFile) {
-      dlib::deserialize(xmlFile) >> this->dlibObjectDetector;
+    explicit Detector(std::string xmlFile) : model(LoadModel(xmlFile)) {
     }
 
+    // dlib's frontal face detector, built once per process and kept for its
+    // lifetime.
+    static std::shared_ptr<const DetectorModel> FrontalFaceModel();
+    // Reads either dlib's serialization format or a model file (see
+    // model_file.h). Detectors loaded from the same file share one copy of it
+    // for as long as any of them is alive.
+    static std::shared_ptr<const DetectorModel> LoadModel(const std::string& path);
+    // Like LoadModel(), for the size bytes of a model at data, which are
+    // parsed in place and not cached.
+    static std::shared_ptr<DetectorModel> LoadModel(const char* data, size_t size);
+
+    // dlib's serialization format, followed by a block holding the processed
+    // filterbanks, which dlib doesn't read. ReadModel() uses the block when it
+    // is there and valid, and otherwise runs dlib's SVD of every filter.
+    static void WriteModel(const object_detector_type& detector, std::ostream& out);
+    static std::shared_ptr<DetectorModel> ReadModel(std::istream& in);
+
+    // Model files hold the processed filterbanks next to the weights. A
+    // detector is small enough to be copied out of the mapping, which then
+    // isn't kept.
+    static void SaveModelFile(const object_detector_type& detector, const std::string& path);
+    static std::shared_ptr<DetectorModel> LoadModelFile(const std::shared_ptr<const MappedFile>& file);
+
+    friend class DetectWorker;
+    friend class BatchDetectWorker;
+    friend class ShapesWorker;
+    friend class DetectorTrainWorker;
+    friend class DetectorLoadWorker;
+
+    // Options accepted by trainFromXML.
+    struct TrainOptions {
+      TrainOptions()
+        : c(1), windowWidth(80), windowHeight(80), epsilon(0.01), verbose(true), scaleUpImages(false),
+          includeMirrors(false), threads(4) {
+      }
+
+      double c;
+      double windowWidth;
+      double windowHeight;
+      double epsilon;
+      bool verbose;
+      bool scaleUpImages;
+      bool includeMirrors;
+      int threads;
+    };
+
+    // Fields missing from value keep their value in options.
+    static TrainOptions ParseTrainOptions(v8::Isolate* isolate, v8::Local<v8::Value> value, TrainOptions options);
+
+    // Trains a detector on the images and boxes listed in an imglab XML file.
+    // If report is set it is called once the data set is loaded and after
+    // every optimizer iteration, and training stops if it throws.
+    static std::shared_ptr<DetectorModel> Train(const std::string& xmlPath, const TrainOptions& options,
+                                                const TrainingReporter& report);
+    // Train() without the metrics.
+    static std::shared_ptr<DetectorModel> TrainModel(const std::string& xmlPath, const TrainOptions& options,
+                                                     const TrainingReporter& report);
+
+    // Options accepted by the detect calls.
+    struct DetectOptions {
+      DetectOptions()
+        : packed(false), adjustThreshold(0), maxDimension(0), minObjectSize(0), memoryBudget(0), tileThreads(1),
+          reportTimings(false), control(NULL), timings(NULL) {
+      }
+
+      // Return the detections as a single Float32Array.
+      bool packed;
+
+      // Added to the detection threshold. Positive values return fewer, more
+      // confident detections; negative values find more objects.
+      double adjustThreshold;
+
+      // Let JPEGs be decoded at 1/2, 1/4 or 1/8 size, as long as their larger
+      // side stays at least maxDimension pixels long and objects of
+      // minObjectSize pixels can still be found. 0 leaves either out.
+      // Detections and shapes are still in the coordinates of the full image.
+      unsigned long maxDimension;
+      double minObjectSize;
+
+      // Bytes the features of a scan may take. Images whose scan would take
+      // more are scanned in tiles of at most memoryBudget / tileThreads bytes,
+      // tileThreads at a time, with the same detections. 0 never tiles. Tile
+      // threads are started by the scan itself, outside the libuv pool, so
+      // configureScheduler's concurrency doesn't limit them.
+      double memoryBudget;
+      unsigned int tileThreads;
+
+      // Add a timings object to the result, breaking the call down by stage
+      // and pyramid level.
+      bool reportTimings;
+
+      // Set for scheduled jobs, which stop when it is cancelled or expires.
+      const JobControl* control;
+
+      // Set by calls with reportTimings to where the timings of the scan go.
+      DetectionTimings* timings;
+    };
+
+    // Safe to call from several threads at once, as long as each brings its
+    // own scratch.
+    template <typename image_type>
+    std::vector<dlib::rect_detection> Detect(const image_type& img, const DetectOptions& options,
+                                             DetectionScratch& scratch) const {
+      std::vector<dlib::rect_detection> dets;
+      const dlib::rectangle rect = dlib::get_rect(img);
+      if (options.memoryBudget > 0 && ScanMemory(model->detector, rect.height(), rect.width()) > options.memoryBudget) {
+        const TileGrid grid = PlanTiles(model->detector, options.memoryBudget, options.tileThreads);
+        DetectTiled(model->detector, img, options.adjustThreshold, grid, options.tileThreads, scratch, dets,
+                    options.control, options.timings);
+      } else {
+        ObjectDetector::Detect(model->detector, img, options.adjustThreshold, scratch, dets, options.control,
+                               options.timings);
+      }
+      return dets;
+    }
+
+    // Detections from these and DetectWithShapes() below are counted in the
+    // model's metrics, timed whether or not options asks for timings.
+    std::vector<dlib::rect_detection> Detect(const ImageSource& source, const DetectOptions& options) const;
+    // Decodes into img, which callers scanning many images can reuse along
+    // with the scratch so their storage is only reallocated when the image
+    // size changes.
+    std::vector<dlib::rect_detection> Detect(const ImageSource& source, const DetectOptions& options,
+                                             dlib::array2d<unsigned char>& img, DetectionScratch& scratch) const;
+
+    template <typename image_type>
+    std::vector<dlib::full_detection> DetectWithShapes(const image_type& img, const Predictor& predictor,
+                                                       const DetectOptions& options) const {
+      DetectionScratch scratch;
+      std::vector<dlib::rect_detection> dets = Detect(img, options, scratch);
+
+      StageClock clock(options.timings != NULL);
+      std::vector<dlib::full_detection> shapes(dets.size());
+      for (unsigned int i = 0; i < dets.size(); ++i) {
+        shapes[i].detection_confidence = dets[i].detection_confidence;
+        shapes[i].weight_index = dets[i].weight_index;
+        shapes[i].rect = predictor.Predict(img, dets[i].rect);
+      }
+      if (options.timings) {
+        options.timings->shapes = clock.Lap();
+      }
+
+      return shapes;
+    }
+
+    // Decodes the image once for both the scan and the shape predictor, and
+    // reports its size for scaling the shapes.
+    std::vector<dlib::full_detection> DetectWithShapes(const ImageSource& source, const Predictor& predictor,
+                                                       const DetectOptions& options, long& cols, long& rows) const;
+
+    // Options are optional wherever they are accepted, so a function in their
+    // place is the callback.
+    static bool HasOptions(const v8::FunctionCallbackInfo<v8::Value>& args, int index);
+
+    // How far options let a JPEG be shrunk for this detector.
+    DecodeLimits LimitsFor(const DetectOptions& options) const;
+    // Decodes source into img within limits, counting decode failures.
+    void Load(const ImageSource& source, const DecodeLimits& limits, dlib::array2d<unsigned char>& img,
+              ImageScale& scale, DetectionTimings& timings) const;
+    // Adds a detection that succeeded to the metrics. decoded is false for
+    // pixels that were scanned in place.
+    void Record(const DetectionTimings& timings, uint64_t latency, bool decoded, bool withShapes) const;
+    static DetectOptions ParseOptions(v8::Isolate* isolate, v8::Local<v8::Value> value);
+
+    static v8::Local<v8::Value> ToResult(v8::Isolate* isolate, const std::vector<dlib::rect_detection>& dets,
+                                        const DetectOptions& options);
+    static v8::Local<v8::Value> ToResult(v8::Isolate* isolate, const std::vector<dlib::full_detection>& dets,
+                                        long cols, long rows, const DetectOptions& options);
+    static v8::Local<v8::Object> ToObject(v8::Isolate* isolate, const dlib::rectangle& det, double score,
+                                          unsigned long weightIndex);
+    static v8::Local<v8::Object> ToObject(v8::Isolate* isolate, const DetectionTimings& timings, bool withShapes);
+    static v8::Local<v8::Array> ToArray(v8::Isolate* isolate, const std::vector<dlib::rect_detection>& dets);
+
+    // Packed results hold one [left, top, width, height, score, detectorIndex]
+    // record per detection.
+    static const size_t kPackedDetectionSize = 6;
+    static void Pack(const dlib::rectangle& rect, double score, unsigned long weightIndex, float* out);
+
+    static void DetectInImage(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void DetectInImageAsync(const v8::FunctionCallbackInfo<v8::Value>& args);
+
     static void DetectInImageFile(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void DetectInImageFileAsync(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void DetectInBuffer(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void DetectInBufferAsync(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void DetectInPixels(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void DetectInPixelsAsync(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void DetectInImageFiles(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void DetectWithShapes(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void DetectWithShapesAsync(const v8::FunctionCallbackInfo<v8::Value>& args);
     static void SaveToFile(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void SaveToBinaryFile(const v8::FunctionCallbackInfo<v8::Value>& args);
     static void SaveImageRepresentation(const v8::FunctionCallbackInfo<v8::Value>& args);
 
-    static v8::Persistent<v8::Function> constructor;
-    dlib::object_detector<image_scanner_type> dlibObjectDetector;
+    std::shared_ptr<const DetectorModel> model;
   };
 }
 
@@ -0,0 +1,233 @@
+// image_probe
+#include "image_probe.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fstream>
+#include <stdexcept>
+
+#include "dlib/image_loader/load_image.h"
+
+namespace ObjectDetector {
+
+  // Reads bytes at any offset of a file or buffer. A file is only read
+  // where asked, so skipping a chunk or segment doesn't read it.
+  class ProbeReader {
+   public:
+    explicit ProbeReader(const std::string& path) : data(NULL), size(0), in(path.c_str(), std::ios::binary) {
+      if (!in) {
+        throw std::runtime_error("Unable to open " + path);
+      }
+    }
+
+    ProbeReader(const unsigned char* data, size_t size) : data(data), size(size) {
+    }
+
+    // False if the image ends first.
+    bool Read(uint64_t offset, unsigned char* out, size_t count) {
+      if (data) {
+        if (offset > size || count > size - offset) {
+          return false;
+        }
+        memcpy(out, data + offset, count);
+        return true;
+      }
+
+      in.clear();
+      in.seekg(offset);
+      return in.read(reinterpret_cast<char*>(out), count) && static_cast<size_t>(in.gcount()) == count;
+    }
+
+    void MustRead(uint64_t offset, unsigned char* out, size_t count, const char* format) {
+      if (!Read(offset, out, count)) {
+        throw std::runtime_error(std::string("Truncated ") + format + " header");
+      }
+    }
+
+   private:
+    const unsigned char* data;
+    size_t size;
+    std::ifstream in;
+  };
+
+  static uint32_t ProbeBigEndian(const unsigned char* bytes, int count) {
+    uint32_t value = 0;
+    for (int i = 0; i < count; ++i) {
+      value = (value << 8) | bytes[i];
+    }
+    return value;
+  }
+
+  static uint32_t ProbeLittleEndian(const unsigned char* bytes, int count) {
+    uint32_t value = 0;
+    for (int i = count - 1; i >= 0; --i) {
+      value = (value << 8) | bytes[i];
+    }
+    return value;
+  }
+
+  // The IHDR chunk comes first. Palette, gray and RGB images with a tRNS chunk
+  // decode with an alpha channel, so the chunks before the image data are
+  // skipped through looking for one.
+  static ImageInfo ProbePng(ProbeReader& reader) {
+    unsigned char ihdr[8 + 13];
+    reader.MustRead(8, ihdr, sizeof(ihdr), "PNG");
+    if (ProbeBigEndian(ihdr, 4) != 13 || memcmp(ihdr + 4, "IHDR", 4) != 0) {
+      throw std::runtime_error("Malformed PNG header");
+    }
+
+    ImageInfo info;
+    info.format = "png";
+    info.width = ProbeBigEndian(ihdr + 8, 4);
+    info.height = ProbeBigEndian(ihdr + 12, 4);
+    info.bitDepth = ihdr[16];
+    const int colorType = ihdr[17];
+    switch (colorType) {
+      case 0: info.channels = 1; break;
+      case 2: info.channels = 3; break;
+      case 3: info.channels = 3; info.bitDepth = 8; break;
+      case 4: info.channels = 2; break;
+      case 6: info.channels = 4; break;
+      default: throw std::runtime_error("Malformed PNG header");
+    }
+    if (info.width <= 0 || info.height <= 0 || info.width > 0x7fffffff || info.height > 0x7fffffff) {
+      throw std::runtime_error("Malformed PNG header");
+    }
+
+    if (colorType == 0 || colorType == 2 || colorType == 3) {
+      // Past the signature, IHDR and its CRC.
+      uint64_t offset = 8 + 8 + 13 + 4;
+      unsigned char chunk[8];
+      while (reader.Read(offset, chunk, sizeof(chunk))) {
+        if (memcmp(chunk + 4, "IDAT", 4) == 0 || memcmp(chunk + 4, "IEND", 4) == 0) {
+          break;
+        }
+        if (memcmp(chunk + 4, "tRNS", 4) == 0) {
+          ++info.channels;
+          break;
+        }
+        offset += 8 + static_cast<uint64_t>(ProbeBigEndian(chunk, 4)) + 4;
+      }
+    }
+    return info;
+  }
+
+  // Walks the marker segments after SOI up to the first start of frame.
+  static ImageInfo ProbeJpeg(ProbeReader& reader) {
+    uint64_t offset = 2;
+    for (;;) {
+      unsigned char byte;
+      reader.MustRead(offset++, &byte, 1, "JPEG");
+      if (byte != 0xff) {
+        throw std::runtime_error("Malformed JPEG header");
+      }
+      // Any number of 0xff bytes may pad a marker.
+      do {
+        reader.MustRead(offset++, &byte, 1, "JPEG");
+      } while (byte == 0xff);
+
+      const int marker = byte;
+      if (marker == 0xd8 || marker == 0x01 || (marker >= 0xd0 && marker <= 0xd7)) {
+        continue;
+      }
+      if (marker == 0xd9 || marker == 0xda) {
+        throw std::runtime_error("JPEG has no frame header");
+      }
+
+      unsigned char length[2];
+      reader.MustRead(offset, length, sizeof(length), "JPEG");
+      const uint32_t segmentLength = ProbeBigEndian(length, 2);
+      if (segmentLength < 2) {
+        throw std::runtime_error("Malformed JPEG header");
+      }
+
+      // Every SOFn but DHT, JPG and DAC, which share their range.
+      if (marker >= 0xc0 && marker <= 0xcf && marker != 0xc4 && marker != 0xc8 && marker != 0xcc) {
+        unsigned char frame[6];
+        if (segmentLength < 2 + sizeof(frame)) {
+          throw std::runtime_error("Malformed JPEG header");
+        }
+        reader.MustRead(offset + 2, frame, sizeof(frame), "JPEG");
+
+        ImageInfo info;
+        info.format = "jpeg";
+        info.bitDepth = frame[0];
+        info.height = ProbeBigEndian(frame + 1, 2);
+        info.width = ProbeBigEndian(frame + 3, 2);
+        info.channels = frame[5];
+        if (info.height == 0) {
+          throw std::runtime_error("JPEGs that give their height in a DNL marker are not supported");
+        }
+        if (info.width == 0 || info.channels == 0) {
+          throw std::runtime_error("Malformed JPEG header");
+        }
+        return info;
+      }
+
+      offset += segmentLength;
+    }
+  }
+
+  // Both the OS/2 header and the Windows headers of 40 bytes and more.
+  static ImageInfo ProbeBmp(ProbeReader& reader) {
+    unsigned char header[14 + 16];
+    reader.MustRead(0, header, 14 + 4, "BMP");
+    const uint32_t headerSize = ProbeLittleEndian(header + 14, 4);
+
+    ImageInfo info;
+    info.format = "bmp";
+    int bitsPerPixel;
+    if (headerSize == 12) {
+      reader.MustRead(0, header, 14 + 12, "BMP");
+      info.width = ProbeLittleEndian(header + 18, 2);
+      info.height = ProbeLittleEndian(header + 20, 2);
+      bitsPerPixel = ProbeLittleEndian(header + 24, 2);
+    } else if (headerSize >= 40) {
+      reader.MustRead(0, header, 14 + 16, "BMP");
+      info.width = static_cast<int32_t>(ProbeLittleEndian(header + 18, 4));
+      // Negative for images stored top down.
+      info.height = labs(static_cast<int32_t>(ProbeLittleEndian(header + 22, 4)));
+      bitsPerPixel = ProbeLittleEndian(header + 28, 2);
+    } else {
+      throw std::runtime_error("Malformed BMP header");
+    }
+
+    if (info.width <= 0 || info.height <= 0 || bitsPerPixel == 0) {
+      throw std::runtime_error("Malformed BMP header");
+    }
+    info.channels = bitsPerPixel == 32 ? 4 : 3;
+    info.bitDepth = bitsPerPixel == 16 ? 5 : 8;
+    return info;
+  }
+
+  static ImageInfo ProbeImage(ProbeReader& reader) {
+    unsigned char magic[8] = { 0 };
+    size_t length = sizeof(magic);
+    while (length > 0 && !reader.Read(0, magic, length)) {
+      --length;
+    }
+
+    switch (dlib::image_file_type::read_type(magic, length)) {
+      case dlib::image_file_type::PNG:
+        return ProbePng(reader);
+      case dlib::image_file_type::JPG:
+        return ProbeJpeg(reader);
+      case dlib::image_file_type::BMP:
+        return ProbeBmp(reader);
+      default:
+        throw std::runtime_error("Unknown image format, expected a JPEG, PNG or BMP image");
+    }
+  }
+
+  ImageInfo ProbeImage(const std::string& path) {
+    ProbeReader reader(path);
+    return ProbeImage(reader);
+  }
+
+  ImageInfo ProbeImage(const unsigned char* data, size_t size) {
+    ProbeReader reader(data, size);
+    return ProbeImage(reader);
+  }
+}
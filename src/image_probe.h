@@ -0,0 +1,35 @@
+// image_probe.h
+#ifndef IMAGE_PROBE_H
+#define IMAGE_PROBE_H
+
+#include <stddef.h>
+
+#include <string>
+
+namespace ObjectDetector {
+  // What the header of an encoded image says about it.
+  struct ImageInfo {
+    ImageInfo() : format(NULL), width(0), height(0), channels(0), bitDepth(0) {
+    }
+
+    // "jpeg", "png" or "bmp".
+    const char* format;
+    long width;
+    long height;
+    // 1 for gray, 2 for gray and alpha, 3 for RGB or YCbCr, and 4 for RGBA or
+    // CMYK. Palettes count as RGB, and transparency in a PNG without an alpha
+    // channel counts as one, as they do when the image is decoded.
+    int channels;
+    // Bits per channel as stored in the file.
+    int bitDepth;
+  };
+
+  // Reads just the headers of a JPEG, PNG or BMP image, which is usually the
+  // first few KB of it, skipping over any metadata before them. Throws
+  // std::runtime_error if the image can't be read, is in another format or
+  // its header is truncated or malformed.
+  ImageInfo ProbeImage(const std::string& path);
+  ImageInfo ProbeImage(const unsigned char* data, size_t size);
+}
+
+#endif
@@ -0,0 +1,158 @@
+// image_source
+#include "image_source.h"
+
+#include <node_buffer.h>
+#include <stdint.h>
+
+#include <memory>
+
+#include "dlib/image_io.h"
+
+#include "trace.h"
+
+namespace ObjectDetector {
+
+  using v8::ArrayBuffer;
+  using v8::ArrayBufferView;
+  using v8::Isolate;
+  using v8::Local;
+  using v8::Object;
+  using v8::String;
+  using v8::Value;
+
+  // Largest width, height and stride of pixels, in pixels and bytes.
+  static const long kMaxPixelDimension = 0x7fffffff;
+
+  ImageSource::ImageSource(Isolate* isolate, Local<Value> value)
+    : kind(kPath), data(NULL), length(0), format(kGray), width(0), height(0), stride(0) {
+    if (IsBuffer(value)) {
+      kind = kBuffer;
+      data = reinterpret_cast<const unsigned char*>(node::Buffer::Data(value));
+      length = node::Buffer::Length(value);
+    } else if (IsPixels(isolate, value)) {
+      kind = kPixels;
+      ParsePixels(isolate, value->ToObject());
+    } else {
+      v8::String::Utf8Value imgPath(value->ToString());
+      path = std::string(*imgPath);
+    }
+  }
+
+  bool ImageSource::IsBuffer(Local<Value> value) {
+    return node::Buffer::HasInstance(value);
+  }
+
+  // Objects without data, such as String wrappers, are converted to paths.
+  bool ImageSource::IsPixels(Isolate* isolate, Local<Value> value) {
+    return value->IsObject() && !IsBuffer(value) &&
+           !value->ToObject()->Get(String::NewFromUtf8(isolate, "data"))->IsUndefined();
+  }
+
+  void ImageSource::ParsePixels(Isolate* isolate, Local<Object> pixels) {
+    Local<Value> pixelData = pixels->Get(String::NewFromUtf8(isolate, "data"));
+    if (pixelData->IsArrayBufferView()) {
+      Local<ArrayBufferView> view = pixelData.As<ArrayBufferView>();
+      data = static_cast<const unsigned char*>(view->Buffer()->GetContents().Data()) + view->ByteOffset();
+      length = view->ByteLength();
+    } else if (pixelData->IsArrayBuffer()) {
+      ArrayBuffer::Contents contents = pixelData.As<ArrayBuffer>()->GetContents();
+      data = static_cast<const unsigned char*>(contents.Data());
+      length = contents.ByteLength();
+    } else {
+      throw std::invalid_argument("Pixel data must be a TypedArray or an ArrayBuffer");
+    }
+
+    Local<Value> pixelFormat = pixels->Get(String::NewFromUtf8(isolate, "format"));
+    long channels = 1;
+    if (!pixelFormat->IsUndefined()) {
+      std::string name(*v8::String::Utf8Value(pixelFormat->ToString()));
+      if (name == "gray") {
+        format = kGray;
+      } else if (name == "rgb") {
+        format = kRGB;
+        channels = 3;
+      } else if (name == "rgba") {
+        format = kRGBA;
+        channels = 4;
+      } else {
+        throw std::invalid_argument("Pixel format must be one of gray, rgb or rgba");
+      }
+    }
+
+    width = pixels->Get(String::NewFromUtf8(isolate, "width"))->IntegerValue();
+    height = pixels->Get(String::NewFromUtf8(isolate, "height"))->IntegerValue();
+    Local<Value> pixelStride = pixels->Get(String::NewFromUtf8(isolate, "stride"));
+    stride = pixelStride->IsUndefined() ? 0 : pixelStride->IntegerValue();
+
+    if (width <= 0 || height <= 0) {
+      throw std::invalid_argument("Pixel width and height must be positive");
+    }
+    if (width > kMaxPixelDimension || height > kMaxPixelDimension || stride > kMaxPixelDimension) {
+      throw std::invalid_argument("Pixel width, height and stride must be at most 2147483647");
+    }
+
+    // With all three bounded, none of this can overflow.
+    const uint64_t rowBytes = static_cast<uint64_t>(width) * channels;
+    if (pixelStride->IsUndefined()) {
+      stride = rowBytes;
+    }
+    if (stride < 0 || static_cast<uint64_t>(stride) < rowBytes) {
+      throw std::invalid_argument("Pixel stride is smaller than a row of pixels");
+    }
+    if (static_cast<uint64_t>(height - 1) * stride + rowBytes > length) {
+      throw std::invalid_argument("Pixel data is smaller than width, height and stride require");
+    }
+  }
+
+  RawImage<unsigned char> ImageSource::GrayPixels() const {
+    return RawImage<unsigned char>(data, height, width, stride);
+  }
+
+  void ImageSource::Load(dlib::array2d<unsigned char>& img, const DecodeLimits& limits, ImageScale& scale) const {
+    if (limits.maxScaleDenom > 1 && kind != kPixels) {
+      const dlib::image_file_type::type type = kind == kBuffer ? dlib::image_file_type::read_type(data, length)
+                                                               : dlib::image_file_type::read_type(path);
+      if (type == dlib::image_file_type::JPG) {
+        TraceScope trace("decode");
+        std::unique_ptr<dlib::jpeg_loader> loader(
+            kind == kBuffer ? new dlib::jpeg_loader(data, length, limits.maxScaleDenom, limits.minSize, img)
+                            : new dlib::jpeg_loader(path, limits.maxScaleDenom, limits.minSize, img));
+
+        scale.cols = loader->original_width();
+        scale.rows = loader->original_height();
+        scale.x = static_cast<double>(scale.cols) / img.nc();
+        scale.y = static_cast<double>(scale.rows) / img.nr();
+        return;
+      }
+    }
+
+    Load(img);
+    scale = ImageScale();
+    scale.cols = img.nc();
+    scale.rows = img.nr();
+  }
+
+  void ImageSource::Load(dlib::array2d<unsigned char>& img) const {
+    TraceScope trace("decode");
+    if (kind == kBuffer) {
+      dlib::load_image(img, data, length);
+    } else if (kind == kPath) {
+      dlib::load_image(img, path);
+    } else if (format == kGray) {
+      dlib::assign_image(img, GrayPixels());
+    } else if (format == kRGB) {
+      dlib::assign_image(img, RawImage<dlib::rgb_pixel>(data, height, width, stride));
+    } else {
+      // Alpha is blended over black, the same as decoding an RGBA PNG.
+      img.set_size(height, width);
+      dlib::assign_all_pixels(img, 0);
+      RawImage<dlib::rgb_alpha_pixel> rgba(data, height, width, stride);
+      dlib::const_image_view<RawImage<dlib::rgb_alpha_pixel> > view(rgba);
+      for (long r = 0; r < height; ++r) {
+        for (long c = 0; c < width; ++c) {
+          dlib::assign_pixel(img[r][c], view[r][c]);
+        }
+      }
+    }
+  }
+}
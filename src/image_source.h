@@ -0,0 +1,108 @@
+// image_source.h
+#ifndef IMAGE_SOURCE_H
+#define IMAGE_SOURCE_H
+
+#include <node.h>
+
+#include <string>
+
+#include "dlib/array2d.h"
+#include "dlib/image_processing/full_object_detection.h"
+#include "raw_image.h"
+
+namespace ObjectDetector {
+  // How far a JPEG may be shrunk while it is decoded, which libjpeg does by
+  // 1/2, 1/4 or 1/8 in the DCT domain for a fraction of the time and memory
+  // of a full decode. The defaults decode at full size.
+  struct DecodeLimits {
+    DecodeLimits() : maxScaleDenom(1), minSize(0) {
+    }
+
+    // The most the image may be shrunk by.
+    unsigned long maxScaleDenom;
+    // The shortest the larger side of the image may become, in pixels.
+    unsigned long minSize;
+  };
+
+  // Maps coordinates in a decoded image back to the source image it was
+  // shrunk from.
+  struct ImageScale {
+    ImageScale() : x(1), y(1), cols(0), rows(0) {
+    }
+
+    bool IsIdentity() const { return x == 1 && y == 1; }
+
+    dlib::point Up(const dlib::point& p) const {
+      return dlib::point(static_cast<long>(p.x() * x + 0.5), static_cast<long>(p.y() * y + 0.5));
+    }
+
+    dlib::rectangle Up(const dlib::rectangle& rect) const {
+      return dlib::rectangle(static_cast<long>(rect.left() * x + 0.5), static_cast<long>(rect.top() * y + 0.5),
+                             static_cast<long>((rect.right() + 1) * x + 0.5) - 1,
+                             static_cast<long>((rect.bottom() + 1) * y + 0.5) - 1);
+    }
+
+    dlib::full_object_detection Up(const dlib::full_object_detection& shape) const {
+      std::vector<dlib::point> parts(shape.num_parts());
+      for (unsigned long i = 0; i < shape.num_parts(); ++i) {
+        parts[i] = shape.part(i) == dlib::OBJECT_PART_NOT_PRESENT ? shape.part(i) : Up(shape.part(i));
+      }
+      return dlib::full_object_detection(Up(shape.get_rect()), parts);
+    }
+
+    // Source pixels per decoded pixel.
+    double x;
+    double y;
+    // Size of the source image.
+    long cols;
+    long rows;
+  };
+
+  // The image a call operates on, given as one of:
+  //  - a path to a JPEG/PNG file,
+  //  - a Node Buffer holding an encoded JPEG/PNG image, or
+  //  - decoded pixels: { data, width, height, stride, format } where data is
+  //    a TypedArray or ArrayBuffer and format is "gray", "rgb" or "rgba".
+  // Any other value is converted to a string and taken as a path.
+  // Buffers and pixels are read in place, so the caller must keep them alive
+  // for as long as the source is used.
+  class ImageSource {
+   public:
+    ImageSource(v8::Isolate* isolate, v8::Local<v8::Value> value);
+
+    static bool IsBuffer(v8::Local<v8::Value> value);
+    static bool IsPixels(v8::Isolate* isolate, v8::Local<v8::Value> value);
+
+    // True if the source is 8-bit grayscale pixels that can be scanned in
+    // place through GrayPixels().
+    bool IsGrayPixels() const { return kind == kPixels && format == kGray; }
+    RawImage<unsigned char> GrayPixels() const;
+
+    // Decodes or converts the source into img. JPEGs and non-interlaced PNGs
+    // are decoded a row at a time straight into img without another copy of
+    // the image. Color JPEGs are decoded to their luminance only.
+    void Load(dlib::array2d<unsigned char>& img) const;
+    // Same, shrinking JPEGs within limits while they are decoded. Other
+    // images are loaded at full size. scale is set to map img back to the
+    // source.
+    void Load(dlib::array2d<unsigned char>& img, const DecodeLimits& limits, ImageScale& scale) const;
+
+   private:
+    enum Kind { kPath, kBuffer, kPixels };
+    enum Format { kGray, kRGB, kRGBA };
+
+    void ParsePixels(v8::Isolate* isolate, v8::Local<v8::Object> pixels);
+
+    Kind kind;
+    std::string path;
+    const unsigned char* data;
+    size_t length;
+
+    Format format;
+    long width;
+    long height;
+    long stride;
+  };
+}
+
+#endif
@@ -0,0 +1,83 @@
+// job_control.h
+#ifndef JOB_CONTROL_H
+#define JOB_CONTROL_H
+
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+
+namespace ObjectDetector {
+  // Why a job stopped without a result. Reported to JS as an Error with the
+  // given name and code.
+  class JobError : public std::runtime_error {
+   public:
+    JobError(const std::string& name, const std::string& code, const std::string& message)
+      : std::runtime_error(message), name(name), code(code) {
+    }
+
+    static JobError Aborted() {
+      return JobError("AbortError", "ABORT_ERR", "The operation was aborted");
+    }
+
+    static JobError DeadlineExceeded() {
+      return JobError("Error", "ERR_DEADLINE_EXCEEDED", "The deadline passed before the job finished");
+    }
+
+    static JobError QueueFull() {
+      return JobError("Error", "ERR_QUEUE_FULL", "The job queue is full");
+    }
+
+    std::string name;
+    std::string code;
+  };
+
+  // Cancellation and deadline of one job. It is set from the main thread and
+  // polled by the thread running the job at points where stopping is cheap,
+  // e.g. between pyramid levels.
+  class JobControl {
+   public:
+    JobControl() : cancelled(false), hasDeadline(false) {
+    }
+
+    void Cancel() {
+      cancelled = true;
+    }
+
+    // deadline is in milliseconds since the epoch, as returned by Date.now().
+    void SetDeadline(double deadline) {
+      double now = std::chrono::duration<double, std::milli>(
+          std::chrono::system_clock::now().time_since_epoch()).count();
+      this->deadline = std::chrono::steady_clock::now() +
+          std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+              std::chrono::duration<double, std::milli>(deadline - now));
+      hasDeadline = true;
+    }
+
+    bool IsCancelled() const {
+      return cancelled;
+    }
+
+    bool IsExpired() const {
+      return hasDeadline && std::chrono::steady_clock::now() >= deadline;
+    }
+
+    // Throws the JobError the job should stop with, if any.
+    void Check() const {
+      if (IsCancelled()) {
+        throw JobError::Aborted();
+      }
+
+      if (IsExpired()) {
+        throw JobError::DeadlineExceeded();
+      }
+    }
+
+   private:
+    std::atomic<bool> cancelled;
+    bool hasDeadline;
+    std::chrono::steady_clock::time_point deadline;
+  };
+}
+
+#endif
@@ -0,0 +1,56 @@
+// mapped_file
+#include "mapped_file.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <stdexcept>
+
+namespace ObjectDetector {
+
+  MappedFile::MappedFile(const std::string& path) : data(NULL), size(0) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      throw std::runtime_error("Unable to open " + path + ": " + strerror(errno));
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+      int error = errno;
+      close(fd);
+      throw std::runtime_error("Unable to stat " + path + ": " + strerror(error));
+    }
+
+    size = info.st_size;
+    if (size > 0) {
+      void* mapping = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+      if (mapping == MAP_FAILED) {
+        int error = errno;
+        close(fd);
+        throw std::runtime_error("Unable to map " + path + ": " + strerror(error));
+      }
+      data = static_cast<const char*>(mapping);
+    }
+
+    // The mapping stays valid once the descriptor is closed.
+    close(fd);
+  }
+
+  MappedFile::MappedFile(const char* bytes, size_t size) : data(NULL), size(size), copy(bytes, bytes + size) {
+    // The copy is allocated with new, so it is aligned at least as strictly
+    // as any value a model file holds.
+    if (size > 0) {
+      data = &copy[0];
+    }
+  }
+
+  MappedFile::~MappedFile() {
+    if (data && copy.empty()) {
+      munmap(const_cast<char*>(data), size);
+    }
+  }
+}
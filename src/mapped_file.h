@@ -0,0 +1,38 @@
+// mapped_file.h
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+
+namespace ObjectDetector {
+  // A whole file mapped read-only into memory. Every process mapping the
+  // same file shares its pages through the page cache.
+  //
+  // It can also hold a copy of the bytes of a file that is already in
+  // memory, such as a model read into a Buffer, so that its readers needn't
+  // tell the two apart.
+  class MappedFile {
+   public:
+    // Throws std::runtime_error if the file can't be opened or mapped.
+    explicit MappedFile(const std::string& path);
+    // Copies size bytes from bytes.
+    MappedFile(const char* bytes, size_t size);
+    ~MappedFile();
+
+    const char* Data() const { return data; }
+    size_t Size() const { return size; }
+
+   private:
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+
+    const char* data;
+    size_t size;
+    std::vector<char> copy;
+  };
+}
+
+#endif
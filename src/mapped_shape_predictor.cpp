@@ -0,0 +1,204 @@
+// mapped_shape_predictor
+#include "mapped_shape_predictor.h"
+#include "model_file.h"
+
+#include <sstream>
+#include <stdexcept>
+
+namespace ObjectDetector {
+
+  enum ShapePredictorSection {
+    kInitialShapeSection = 1,
+    kCascadesSection = 2,
+    kTreesSection = 3,
+    kSplitsSection = 4,
+    kLeavesSection = 5,
+    kAnchorsSection = 6,
+    kDeltasSection = 7
+  };
+
+  // What dlib::shape_predictor serializes, in that order.
+  struct ShapePredictorParts {
+    dlib::matrix<float, 0, 1> initialShape;
+    std::vector<std::vector<dlib::impl::regression_tree> > forests;
+    std::vector<std::vector<unsigned long> > anchors;
+    std::vector<std::vector<dlib::vector<float, 2> > > deltas;
+  };
+
+  MappedShapePredictor::MappedShapePredictor(const std::string& path)
+    : MappedShapePredictor(std::make_shared<MappedFile>(path)) {
+  }
+
+  MappedShapePredictor::MappedShapePredictor(const std::shared_ptr<const MappedFile>& file) : file(file) {
+    ModelFileReader reader(file, ModelFile::kShapePredictor);
+
+    const float* shape = reader.Get<float>(kInitialShapeSection, shapeSize);
+    if (shapeSize == 0 || shapeSize % 2 != 0) {
+      throw std::runtime_error("Model file has an invalid initial shape");
+    }
+    initialShape = dlib::mat(shape, shapeSize);
+
+    size_t numSplits, numLeafValues, numAnchors, numDeltas;
+    cascades = reader.Get<Cascade>(kCascadesSection, numCascades);
+    trees = reader.Get<Tree>(kTreesSection, numTrees);
+    splits = reader.Get<Split>(kSplitsSection, numSplits);
+    leaves = reader.Get<float>(kLeavesSection, numLeafValues);
+    anchors = reader.Get<uint32_t>(kAnchorsSection, numAnchors);
+    deltas = reader.Get<float>(kDeltasSection, numDeltas);
+
+    // Check every index once here, so that predicting never reads outside
+    // the file whatever it holds.
+    if (numDeltas != 2 * numAnchors) {
+      throw std::runtime_error("Model file has the wrong number of pixel deltas");
+    }
+    for (size_t i = 0; i < numAnchors; ++i) {
+      if (anchors[i] >= shapeSize / 2) {
+        throw std::runtime_error("Model file has an invalid pixel anchor");
+      }
+    }
+
+    const uint64_t numLeaves = numLeafValues / shapeSize;
+    for (size_t c = 0; c < numCascades; ++c) {
+      const Cascade& cascade = cascades[c];
+      if (uint64_t(cascade.firstTree) + cascade.numTrees > numTrees ||
+          uint64_t(cascade.firstPixel) + cascade.numPixels > numAnchors) {
+        throw std::runtime_error("Model file has an invalid cascade");
+      }
+
+      for (uint32_t t = cascade.firstTree; t < cascade.firstTree + cascade.numTrees; ++t) {
+        const Tree& tree = trees[t];
+        if (uint64_t(tree.firstSplit) + tree.numSplits > numSplits || uint64_t(tree.numLeaves) != tree.numSplits + 1ull ||
+            uint64_t(tree.firstLeaf) + tree.numLeaves > numLeaves) {
+          throw std::runtime_error("Model file has an invalid tree");
+        }
+
+        for (uint32_t s = tree.firstSplit; s < tree.firstSplit + tree.numSplits; ++s) {
+          if (splits[s].idx1 >= cascade.numPixels || splits[s].idx2 >= cascade.numPixels) {
+            throw std::runtime_error("Model file has an invalid split");
+          }
+        }
+      }
+    }
+  }
+
+  void MappedShapePredictor::Save(const dlib::shape_predictor& predictor, const std::string& path) {
+    // dlib::shape_predictor keeps its parts to itself, so take them from its
+    // serialization.
+    ShapePredictorParts parts;
+    {
+      std::stringstream stream;
+      // Found by argument dependent lookup; it's a friend of shape_predictor.
+      serialize(predictor, stream);
+      int version = 0;
+      dlib::deserialize(version, stream);
+      if (version != 1) {
+        throw std::runtime_error("Unexpected shape_predictor version");
+      }
+      dlib::deserialize(parts.initialShape, stream);
+      dlib::deserialize(parts.forests, stream);
+      dlib::deserialize(parts.anchors, stream);
+      dlib::deserialize(parts.deltas, stream);
+    }
+
+    const size_t shapeSize = parts.initialShape.size();
+    if (shapeSize == 0 || parts.forests.size() != parts.anchors.size() ||
+        parts.forests.size() != parts.deltas.size()) {
+      throw std::runtime_error("Can't save an empty shape predictor");
+    }
+
+    std::vector<float> initialShape(parts.initialShape.begin(), parts.initialShape.end());
+    std::vector<Cascade> cascades;
+    std::vector<Tree> trees;
+    std::vector<Split> splits;
+    std::vector<float> leaves;
+    std::vector<uint32_t> anchors;
+    std::vector<float> deltas;
+
+    for (size_t c = 0; c < parts.forests.size(); ++c) {
+      Cascade cascade;
+      cascade.firstTree = trees.size();
+      cascade.numTrees = parts.forests[c].size();
+      cascade.firstPixel = anchors.size();
+      cascade.numPixels = parts.anchors[c].size();
+      cascades.push_back(cascade);
+
+      for (size_t t = 0; t < parts.forests[c].size(); ++t) {
+        const dlib::impl::regression_tree& source = parts.forests[c][t];
+        Tree tree;
+        tree.firstSplit = splits.size();
+        tree.numSplits = source.splits.size();
+        tree.firstLeaf = leaves.size() / shapeSize;
+        tree.numLeaves = source.leaf_values.size();
+        trees.push_back(tree);
+
+        for (size_t s = 0; s < source.splits.size(); ++s) {
+          Split split;
+          split.idx1 = source.splits[s].idx1;
+          split.idx2 = source.splits[s].idx2;
+          split.thresh = source.splits[s].thresh;
+          splits.push_back(split);
+        }
+        for (size_t l = 0; l < source.leaf_values.size(); ++l) {
+          if (static_cast<size_t>(source.leaf_values[l].size()) != shapeSize) {
+            throw std::runtime_error("Shape predictor has a leaf of the wrong size");
+          }
+          leaves.insert(leaves.end(), source.leaf_values[l].begin(), source.leaf_values[l].end());
+        }
+      }
+
+      for (size_t p = 0; p < parts.anchors[c].size(); ++p) {
+        anchors.push_back(parts.anchors[c][p]);
+        deltas.push_back(parts.deltas[c][p].x());
+        deltas.push_back(parts.deltas[c][p].y());
+      }
+    }
+
+    ModelFileWriter writer(ModelFile::kShapePredictor);
+    writer.Add(kInitialShapeSection, initialShape);
+    writer.Add(kCascadesSection, cascades);
+    writer.Add(kTreesSection, trees);
+    writer.Add(kSplitsSection, splits);
+    writer.Add(kLeavesSection, leaves);
+    writer.Add(kAnchorsSection, anchors);
+    writer.Add(kDeltasSection, deltas);
+    writer.Write(path);
+  }
+
+  void MappedShapePredictor::Serialize(std::ostream& out) const {
+    ShapePredictorParts parts;
+    parts.initialShape = initialShape;
+    parts.forests.resize(numCascades);
+    parts.anchors.resize(numCascades);
+    parts.deltas.resize(numCascades);
+
+    for (size_t c = 0; c < numCascades; ++c) {
+      const Cascade& cascade = cascades[c];
+      for (uint32_t t = cascade.firstTree; t < cascade.firstTree + cascade.numTrees; ++t) {
+        dlib::impl::regression_tree tree;
+        for (uint32_t s = trees[t].firstSplit; s < trees[t].firstSplit + trees[t].numSplits; ++s) {
+          dlib::impl::split_feature split;
+          split.idx1 = splits[s].idx1;
+          split.idx2 = splits[s].idx2;
+          split.thresh = splits[s].thresh;
+          tree.splits.push_back(split);
+        }
+        for (uint32_t l = trees[t].firstLeaf; l < trees[t].firstLeaf + trees[t].numLeaves; ++l) {
+          tree.leaf_values.push_back(dlib::mat(leaves + l * shapeSize, shapeSize));
+        }
+        parts.forests[c].push_back(tree);
+      }
+
+      for (uint32_t p = cascade.firstPixel; p < cascade.firstPixel + cascade.numPixels; ++p) {
+        parts.anchors[c].push_back(anchors[p]);
+        parts.deltas[c].push_back(dlib::vector<float, 2>(deltas[2 * p], deltas[2 * p + 1]));
+      }
+    }
+
+    int version = 1;
+    dlib::serialize(version, out);
+    dlib::serialize(parts.initialShape, out);
+    dlib::serialize(parts.forests, out);
+    dlib::serialize(parts.anchors, out);
+    dlib::serialize(parts.deltas, out);
+  }
+}
@@ -0,0 +1,136 @@
+// mapped_shape_predictor.h
+#ifndef MAPPED_SHAPE_PREDICTOR_H
+#define MAPPED_SHAPE_PREDICTOR_H
+
+#include <stdint.h>
+
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "dlib/image_processing.h"
+
+#include "mapped_file.h"
+
+namespace ObjectDetector {
+  // A dlib::shape_predictor that runs on the arrays of a mapped model file
+  // (see model_file.h) instead of its own copies. Only the initial shape is
+  // copied; the trees, which are nearly all of a model, are read in place.
+  // Predictions match those of the dlib::shape_predictor it was saved from.
+  class MappedShapePredictor {
+   public:
+    // Throws std::runtime_error if the file isn't a valid shape predictor
+    // model file.
+    explicit MappedShapePredictor(const std::string& path);
+    explicit MappedShapePredictor(const std::shared_ptr<const MappedFile>& file);
+
+    // Writes predictor to path as a model file.
+    static void Save(const dlib::shape_predictor& predictor, const std::string& path);
+
+    // Writes the model in dlib's serialization format, so that
+    // dlib::deserialize() reads it back as a dlib::shape_predictor.
+    void Serialize(std::ostream& out) const;
+
+    unsigned long num_parts() const {
+      return initialShape.size() / 2;
+    }
+
+    // Same as dlib::shape_predictor::operator().
+    template <typename image_type>
+    dlib::full_object_detection operator()(const image_type& img, const dlib::rectangle& rect) const {
+      dlib::matrix<float, 0, 1> currentShape = initialShape;
+      std::vector<float> featurePixelValues;
+      for (size_t c = 0; c < numCascades; ++c) {
+        const Cascade& cascade = cascades[c];
+        ExtractFeaturePixelValues(img, rect, currentShape, cascade, featurePixelValues);
+
+        for (uint32_t t = cascade.firstTree; t < cascade.firstTree + cascade.numTrees; ++t) {
+          const Tree& tree = trees[t];
+          const Split* treeSplits = splits + tree.firstSplit;
+
+          uint32_t i = 0;
+          while (i < tree.numSplits) {
+            if (featurePixelValues[treeSplits[i].idx1] - featurePixelValues[treeSplits[i].idx2] > treeSplits[i].thresh) {
+              i = dlib::impl::left_child(i);
+            } else {
+              i = dlib::impl::right_child(i);
+            }
+          }
+
+          currentShape += dlib::mat(leaves + (tree.firstLeaf + i - tree.numSplits) * shapeSize, shapeSize);
+        }
+      }
+
+      const dlib::point_transform_affine tformToImg = dlib::impl::unnormalizing_tform(rect);
+      std::vector<dlib::point> parts(currentShape.size() / 2);
+      for (unsigned long i = 0; i < parts.size(); ++i) {
+        parts[i] = tformToImg(dlib::impl::location(currentShape, i));
+      }
+      return dlib::full_object_detection(rect, parts);
+    }
+
+    // Records of the file's sections.
+    struct Cascade {
+      uint32_t firstTree;
+      uint32_t numTrees;
+      uint32_t firstPixel;
+      uint32_t numPixels;
+    };
+
+    struct Tree {
+      uint32_t firstSplit;
+      uint32_t numSplits;
+      uint32_t firstLeaf;
+      uint32_t numLeaves;
+    };
+
+    struct Split {
+      uint32_t idx1;
+      uint32_t idx2;
+      float thresh;
+    };
+
+   private:
+    // Same as dlib::impl::extract_feature_pixel_values().
+    template <typename image_type>
+    void ExtractFeaturePixelValues(const image_type& img_, const dlib::rectangle& rect,
+                                   const dlib::matrix<float, 0, 1>& currentShape, const Cascade& cascade,
+                                   std::vector<float>& featurePixelValues) const {
+      const dlib::matrix<float, 2, 2> tform = dlib::matrix_cast<float>(
+          dlib::impl::find_tform_between_shapes(initialShape, currentShape).get_m());
+      const dlib::point_transform_affine tformToImg = dlib::impl::unnormalizing_tform(rect);
+
+      const dlib::rectangle area = dlib::get_rect(img_);
+
+      dlib::const_image_view<image_type> img(img_);
+      featurePixelValues.resize(cascade.numPixels);
+      for (uint32_t i = 0; i < cascade.numPixels; ++i) {
+        const uint32_t pixel = cascade.firstPixel + i;
+        const dlib::vector<float, 2> delta(deltas[2 * pixel], deltas[2 * pixel + 1]);
+        dlib::point p = tformToImg(tform * delta + dlib::impl::location(currentShape, anchors[pixel]));
+        if (area.contains(p)) {
+          featurePixelValues[i] = dlib::get_pixel_intensity(img[p.y()][p.x()]);
+        } else {
+          featurePixelValues[i] = 0;
+        }
+      }
+    }
+
+    std::shared_ptr<const MappedFile> file;
+
+    dlib::matrix<float, 0, 1> initialShape;
+    size_t shapeSize;
+
+    const Cascade* cascades;
+    size_t numCascades;
+    const Tree* trees;
+    size_t numTrees;
+    const Split* splits;
+    const float* leaves;
+    const uint32_t* anchors;
+    const float* deltas;
+  };
+}
+
+#endif
@@ -0,0 +1,26 @@
+// memory_stream.h
+#ifndef MEMORY_STREAM_H
+#define MEMORY_STREAM_H
+
+#include <stddef.h>
+
+#include <istream>
+#include <streambuf>
+
+namespace ObjectDetector {
+  // An std::istream reading bytes in place, such as those of a Buffer, for
+  // dlib::deserialize(). The bytes must outlive the stream.
+  class MemoryStream : private std::streambuf, public std::istream {
+   public:
+    MemoryStream(const char* data, size_t size) : std::istream(this) {
+      char* begin = const_cast<char*>(data);
+      setg(begin, begin, begin + size);
+    }
+
+   private:
+    MemoryStream(const MemoryStream&);
+    MemoryStream& operator=(const MemoryStream&);
+  };
+}
+
+#endif
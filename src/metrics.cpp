@@ -0,0 +1,334 @@
+// metrics
+#include "metrics.h"
+
+#include <stdio.h>
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <utility>
+
+namespace ObjectDetector {
+
+  static const char* const kApiNames[kMetricsApiCount] = { "detect", "predict", "train" };
+
+  static const char* const kStageNames[kMetricsStageCount] = {
+    "decode", "pyramid", "fhog", "filter", "threshold", "nms", "shapes"
+  };
+
+  static const char* const kCounterNames[kMetricsCounterCount] = {
+    "calls", "errors", "decodeErrors", "cancelled", "candidates", "detections"
+  };
+
+  // Quantiles reported for every histogram.
+  static const double kQuantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+  static const char* const kQuantileNames[] = { "p50", "p90", "p99", "p999" };
+  static const size_t kQuantileCount = sizeof(kQuantiles) / sizeof(kQuantiles[0]);
+
+  LatencyHistogram::LatencyHistogram() : count(0), sum(0), min(UINT64_MAX), max(0) {
+    for (size_t i = 0; i < kBucketCount; ++i) {
+      buckets[i].store(0, std::memory_order_relaxed);
+    }
+  }
+
+  size_t LatencyHistogram::BucketOf(uint64_t value) {
+    if (value < kSubBuckets) {
+      return value;
+    }
+
+    const int magnitude = 63 - __builtin_clzll(value);
+    if (magnitude >= kMaxMagnitude) {
+      return kBucketCount - 1;
+    }
+
+    // The top kSubBucketBits bits of the value, the first of which is set.
+    const int shift = magnitude - (kSubBucketBits - 1);
+    return shift * (kSubBuckets / 2) + (value >> shift);
+  }
+
+  uint64_t LatencyHistogram::BucketLimit(size_t bucket) {
+    if (bucket < kSubBuckets) {
+      return bucket;
+    }
+
+    const int shift = bucket / (kSubBuckets / 2) - 1;
+    const uint64_t top = bucket - shift * (kSubBuckets / 2);
+    return ((top + 1) << shift) - 1;
+  }
+
+  void LatencyHistogram::Record(uint64_t value) {
+    buckets[BucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(value, std::memory_order_relaxed);
+
+    uint64_t current = min.load(std::memory_order_relaxed);
+    while (value < current && !min.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+    current = max.load(std::memory_order_relaxed);
+    while (value > current && !max.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+  }
+
+  LatencyHistogram::Snapshot LatencyHistogram::Read() const {
+    Snapshot snapshot;
+    snapshot.buckets.resize(kBucketCount);
+    snapshot.count = 0;
+    for (size_t i = 0; i < kBucketCount; ++i) {
+      snapshot.buckets[i] = buckets[i].load(std::memory_order_relaxed);
+      snapshot.count += snapshot.buckets[i];
+    }
+
+    snapshot.sum = sum.load(std::memory_order_relaxed);
+    snapshot.min = snapshot.count == 0 ? 0 : min.load(std::memory_order_relaxed);
+    snapshot.max = max.load(std::memory_order_relaxed);
+    return snapshot;
+  }
+
+  uint64_t LatencyHistogram::Snapshot::Quantile(double q) const {
+    if (count == 0) {
+      return 0;
+    }
+
+    uint64_t rank = static_cast<uint64_t>(q * count + 0.5);
+    if (rank < 1) {
+      rank = 1;
+    }
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < buckets.size(); ++i) {
+      seen += buckets[i];
+      if (seen >= rank) {
+        // Values past the last bucket's limit land in it as well, and no
+        // value is above the maximum.
+        return i + 1 == buckets.size() || BucketLimit(i) > max ? max : BucketLimit(i);
+      }
+    }
+
+    return max;
+  }
+
+  typedef std::map<std::pair<std::string, std::string>, std::unique_ptr<ModelMetrics> > MetricsRegistry;
+
+  // Never destroyed, so that threads still recording while the process exits
+  // don't touch freed memory.
+  static std::mutex& RegistryMutex() {
+    static std::mutex* mutex = new std::mutex();
+    return *mutex;
+  }
+
+  static MetricsRegistry& Registry() {
+    static MetricsRegistry* registry = new MetricsRegistry();
+    return *registry;
+  }
+
+  ModelMetrics* ModelMetrics::Get(const std::string& kind, const std::string& name) {
+    std::lock_guard<std::mutex> lock(RegistryMutex());
+    std::unique_ptr<ModelMetrics>& metrics = Registry()[std::make_pair(kind, name)];
+    if (!metrics) {
+      metrics.reset(new ModelMetrics(kind, name));
+    }
+    return metrics.get();
+  }
+
+  std::string ModelMetrics::BufferName(const char* data, size_t size) {
+    // 64-bit FNV-1a.
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; ++i) {
+      hash = (hash ^ static_cast<unsigned char>(data[i])) * 1099511628211ULL;
+    }
+
+    char name[32];
+    snprintf(name, sizeof(name), "buffer:%016llx", static_cast<unsigned long long>(hash));
+    return name;
+  }
+
+  static std::vector<ModelMetrics*> AllModelMetrics() {
+    std::lock_guard<std::mutex> lock(RegistryMutex());
+    std::vector<ModelMetrics*> all;
+    for (MetricsRegistry::iterator it = Registry().begin(); it != Registry().end(); ++it) {
+      all.push_back(it->second.get());
+    }
+    return all;
+  }
+
+  // Counters other than calls, errors and cancellations only apply to
+  // detection.
+  static bool HasCounter(MetricsApi api, MetricsCounter counter) {
+    return api == kDetectApi || counter == kCallsCounter || counter == kErrorsCounter ||
+        counter == kCancelledCounter;
+  }
+
+  static std::string JsonString(const std::string& value) {
+    std::string quoted = "\"";
+    for (size_t i = 0; i < value.size(); ++i) {
+      const unsigned char c = value[i];
+      if (c == '"' || c == '\\') {
+        quoted += '\\';
+        quoted += c;
+      } else if (c < 0x20) {
+        char escaped[8];
+        snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+        quoted += escaped;
+      } else {
+        quoted += c;
+      }
+    }
+    return quoted + "\"";
+  }
+
+  static void WriteJson(std::ostream& out, const LatencyHistogram& histogram) {
+    const LatencyHistogram::Snapshot snapshot = histogram.Read();
+    out << "{\"count\":" << snapshot.count << ",\"sum\":" << snapshot.sum << ",\"min\":" << snapshot.min
+        << ",\"max\":" << snapshot.max << ",\"mean\":"
+        << (snapshot.count == 0 ? 0 : snapshot.sum / snapshot.count);
+    for (size_t q = 0; q < kQuantileCount; ++q) {
+      out << ",\"" << kQuantileNames[q] << "\":" << snapshot.Quantile(kQuantiles[q]);
+    }
+    out << "}";
+  }
+
+  std::string ModelMetrics::ToJson() {
+    std::ostringstream out;
+    out << "{\"models\":[";
+
+    std::vector<ModelMetrics*> all = AllModelMetrics();
+    for (size_t m = 0; m < all.size(); ++m) {
+      ModelMetrics& metrics = *all[m];
+      out << (m == 0 ? "" : ",") << "{\"kind\":" << JsonString(metrics.kind)
+          << ",\"model\":" << JsonString(metrics.name) << ",\"apis\":{";
+
+      bool first = true;
+      for (int a = 0; a < kMetricsApiCount; ++a) {
+        const ApiMetrics& api = metrics.apis[a];
+        if (api.counters[kCallsCounter].Read() == 0) {
+          continue;
+        }
+
+        out << (first ? "" : ",") << "\"" << kApiNames[a] << "\":{";
+        first = false;
+        for (int c = 0; c < kMetricsCounterCount; ++c) {
+          if (HasCounter(static_cast<MetricsApi>(a), static_cast<MetricsCounter>(c))) {
+            out << "\"" << kCounterNames[c] << "\":" << api.counters[c].Read() << ",";
+          }
+        }
+        out << "\"latency\":";
+        WriteJson(out, api.latency);
+        out << "}";
+      }
+
+      out << "},\"stages\":{";
+      first = true;
+      for (int s = 0; s < kMetricsStageCount; ++s) {
+        if (metrics.stages[s].Read().count == 0) {
+          continue;
+        }
+
+        out << (first ? "" : ",") << "\"" << kStageNames[s] << "\":";
+        first = false;
+        WriteJson(out, metrics.stages[s]);
+      }
+      out << "}}";
+    }
+
+    out << "]}";
+    return out.str();
+  }
+
+  static std::string PrometheusLabel(const std::string& value) {
+    std::string escaped;
+    for (size_t i = 0; i < value.size(); ++i) {
+      if (value[i] == '\\') {
+        escaped += "\\\\";
+      } else if (value[i] == '"') {
+        escaped += "\\\"";
+      } else if (value[i] == '\n') {
+        escaped += "\\n";
+      } else {
+        escaped += value[i];
+      }
+    }
+    return escaped;
+  }
+
+  static std::string PrometheusSeconds(uint64_t nanoseconds) {
+    char seconds[32];
+    snprintf(seconds, sizeof(seconds), "%.9f", nanoseconds / 1e9);
+    return seconds;
+  }
+
+  static void WritePrometheus(std::ostream& out, const std::string& name, const std::string& labels,
+                              const LatencyHistogram& histogram) {
+    const LatencyHistogram::Snapshot snapshot = histogram.Read();
+    for (size_t q = 0; q < kQuantileCount; ++q) {
+      out << name << "{" << labels << ",quantile=\"" << kQuantiles[q] << "\"} "
+          << PrometheusSeconds(snapshot.Quantile(kQuantiles[q])) << "\n";
+    }
+    out << name << "_sum{" << labels << "} " << PrometheusSeconds(snapshot.sum) << "\n";
+    out << name << "_count{" << labels << "} " << snapshot.count << "\n";
+  }
+
+  std::string ModelMetrics::ToPrometheus() {
+    static const char* const kCounterMetrics[kMetricsCounterCount] = {
+      "object_detector_calls_total", "object_detector_errors_total", "object_detector_decode_errors_total",
+      "object_detector_cancelled_total", "object_detector_candidates_total", "object_detector_detections_total"
+    };
+    static const char* const kCounterHelp[kMetricsCounterCount] = {
+      "Calls by model and API.",
+      "Calls that failed, by model and API.",
+      "Detections that failed because the image could not be decoded.",
+      "Calls that were aborted or ran past their deadline, by model and API.",
+      "Windows that scored above the detection threshold.",
+      "Detections left after non-max suppression."
+    };
+
+    std::vector<ModelMetrics*> all = AllModelMetrics();
+    std::ostringstream out;
+
+    for (int c = 0; c < kMetricsCounterCount; ++c) {
+      out << "# HELP " << kCounterMetrics[c] << " " << kCounterHelp[c] << "\n";
+      out << "# TYPE " << kCounterMetrics[c] << " counter\n";
+      for (size_t m = 0; m < all.size(); ++m) {
+        for (int a = 0; a < kMetricsApiCount; ++a) {
+          const ApiMetrics& api = all[m]->apis[a];
+          if (api.counters[kCallsCounter].Read() == 0 ||
+              !HasCounter(static_cast<MetricsApi>(a), static_cast<MetricsCounter>(c))) {
+            continue;
+          }
+          out << kCounterMetrics[c] << "{kind=\"" << all[m]->kind << "\",model=\"" << PrometheusLabel(all[m]->name)
+              << "\",api=\"" << kApiNames[a] << "\"} " << api.counters[c].Read() << "\n";
+        }
+      }
+    }
+
+    out << "# HELP object_detector_latency_seconds Latency of calls by model and API.\n";
+    out << "# TYPE object_detector_latency_seconds summary\n";
+    for (size_t m = 0; m < all.size(); ++m) {
+      for (int a = 0; a < kMetricsApiCount; ++a) {
+        if (all[m]->apis[a].counters[kCallsCounter].Read() == 0) {
+          continue;
+        }
+        WritePrometheus(out, "object_detector_latency_seconds",
+                        "kind=\"" + all[m]->kind + "\",model=\"" + PrometheusLabel(all[m]->name) + "\",api=\"" +
+                            kApiNames[a] + "\"",
+                        all[m]->apis[a].latency);
+      }
+    }
+
+    out << "# HELP object_detector_stage_seconds Time spent in each stage of detection, by model.\n";
+    out << "# TYPE object_detector_stage_seconds summary\n";
+    for (size_t m = 0; m < all.size(); ++m) {
+      for (int s = 0; s < kMetricsStageCount; ++s) {
+        if (all[m]->stages[s].Read().count == 0) {
+          continue;
+        }
+        WritePrometheus(out, "object_detector_stage_seconds",
+                        "kind=\"" + all[m]->kind + "\",model=\"" + PrometheusLabel(all[m]->name) + "\",stage=\"" +
+                            kStageNames[s] + "\"",
+                        all[m]->stages[s]);
+      }
+    }
+
+    return out.str();
+  }
+}
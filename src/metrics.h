@@ -0,0 +1,188 @@
+// metrics.h
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <string>
+#include <vector>
+
+#include "job_control.h"
+
+namespace ObjectDetector {
+  enum MetricsApi {
+    kDetectApi,
+    kPredictApi,
+    kTrainApi,
+    kMetricsApiCount
+  };
+
+  // Stages of a detection, as in DetectionTimings.
+  enum MetricsStage {
+    kDecodeStage,
+    kPyramidStage,
+    kFhogStage,
+    kFilterStage,
+    kThresholdStage,
+    kNmsStage,
+    kShapesStage,
+    kMetricsStageCount
+  };
+
+  enum MetricsCounter {
+    kCallsCounter,
+    kErrorsCounter,
+    kDecodeErrorsCounter,
+    kCancelledCounter,
+    kCandidatesCounter,
+    kDetectionsCounter,
+    kMetricsCounterCount
+  };
+
+  class MetricsCount {
+   public:
+    MetricsCount() : value(0) {
+    }
+
+    void Add(uint64_t n = 1) {
+      value.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    uint64_t Read() const {
+      return value.load(std::memory_order_relaxed);
+    }
+
+   private:
+    std::atomic<uint64_t> value;
+  };
+
+  // A histogram of durations in nanoseconds, in the manner of HdrHistogram:
+  // values below kSubBuckets each get a bucket, and every power of two above
+  // that is split into kSubBuckets / 2 equal buckets, so a bucket is never
+  // wider than about 3% of the values in it. Values from 2^kMaxMagnitude ns
+  // (about 73 minutes) on share the last bucket. Recording takes a few
+  // relaxed atomic operations and never locks.
+  class LatencyHistogram {
+   public:
+    static const int kSubBucketBits = 6;
+    static const uint64_t kSubBuckets = 1 << kSubBucketBits;
+    static const int kMaxMagnitude = 42;
+    static const size_t kBucketCount = (kMaxMagnitude - kSubBucketBits) * (kSubBuckets / 2) + kSubBuckets;
+
+    LatencyHistogram();
+
+    void Record(uint64_t value);
+
+    // A copy of the histogram. Buckets are read one at a time while others
+    // may be recording, so the copy can be slightly out of step with itself.
+    struct Snapshot {
+      uint64_t count;
+      uint64_t sum;
+      uint64_t min;
+      uint64_t max;
+      std::vector<uint64_t> buckets;
+
+      // The value at quantile q (0 to 1), to the precision of a bucket. 0 if
+      // nothing was recorded.
+      uint64_t Quantile(double q) const;
+    };
+
+    Snapshot Read() const;
+
+    static size_t BucketOf(uint64_t value);
+    // The largest value that falls in the bucket.
+    static uint64_t BucketLimit(size_t bucket);
+
+   private:
+    std::atomic<uint64_t> buckets[kBucketCount];
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> sum;
+    std::atomic<uint64_t> min;
+    std::atomic<uint64_t> max;
+  };
+
+  // Measures consecutive stages. A clock that isn't enabled never reads the
+  // time, so untimed calls don't pay for it.
+  class StageClock {
+   public:
+    explicit StageClock(bool enabled) : enabled(enabled), last(enabled ? Now() : 0) {
+    }
+
+    // Nanoseconds since the previous lap or since construction.
+    uint64_t Lap() {
+      if (!enabled) {
+        return 0;
+      }
+
+      const uint64_t now = Now();
+      const uint64_t elapsed = now - last;
+      last = now;
+      return elapsed;
+    }
+
+   private:
+    static uint64_t Now() {
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    bool enabled;
+    uint64_t last;
+  };
+
+  struct ApiMetrics {
+    MetricsCount counters[kMetricsCounterCount];
+    LatencyHistogram latency;
+  };
+
+  // Everything recorded about one model, across all the Detectors or
+  // Predictors using it and all Node.js environments in the process. Models
+  // are named after the file they were loaded from, the contents of the
+  // buffer they were loaded from, or the XML file they were trained on.
+  class ModelMetrics {
+   public:
+    // The metrics of the model of the given kind ("detector" or
+    // "shape_predictor") and name, created on first use. They are never
+    // freed, so the pointer can be kept for good.
+    static ModelMetrics* Get(const std::string& kind, const std::string& name);
+    // The name of a model loaded from the given bytes: "buffer:" and a hash
+    // of them, so that different models are kept apart and loading the same
+    // one again adds to its metrics.
+    static std::string BufferName(const char* data, size_t size);
+
+    // All models' metrics as a JSON document, or in the Prometheus text
+    // exposition format.
+    static std::string ToJson();
+    static std::string ToPrometheus();
+
+    ApiMetrics& Api(MetricsApi api) { return apis[api]; }
+    LatencyHistogram& Stage(MetricsStage stage) { return stages[stage]; }
+
+    // Counts a call that threw, as cancelled if it was stopped by its
+    // JobControl.
+    void Failed(MetricsApi api, const std::exception& e) {
+      if (dynamic_cast<const JobError*>(&e)) {
+        apis[api].counters[kCancelledCounter].Add();
+      } else {
+        apis[api].counters[kErrorsCounter].Add();
+      }
+    }
+
+    const std::string& Kind() const { return kind; }
+    const std::string& Name() const { return name; }
+
+   private:
+    ModelMetrics(const std::string& kind, const std::string& name) : kind(kind), name(name) {
+    }
+
+    std::string kind;
+    std::string name;
+    ApiMetrics apis[kMetricsApiCount];
+    LatencyHistogram stages[kMetricsStageCount];
+  };
+}
+
+#endif
@@ -0,0 +1,113 @@
+// model_cache.h
+#ifndef MODEL_CACHE_H
+#define MODEL_CACHE_H
+
+#include <sys/stat.h>
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace ObjectDetector {
+  // Identifies one version of a file. Rewriting the file changes its size or
+  // modification time, and replacing it changes the inode.
+  struct FileVersion {
+    FileVersion() : device(0), inode(0), size(0), modified(0) {
+    }
+
+    // False if the file can't be stat'ed.
+    static bool Of(const std::string& path, FileVersion& version) {
+      struct stat info;
+      if (stat(path.c_str(), &info) != 0) {
+        return false;
+      }
+
+      version.device = info.st_dev;
+      version.inode = info.st_ino;
+      version.size = info.st_size;
+      version.modified = info.st_mtime;
+      return true;
+    }
+
+    bool operator==(const FileVersion& other) const {
+      return device == other.device && inode == other.inode && size == other.size && modified == other.modified;
+    }
+
+    unsigned long long device;
+    unsigned long long inode;
+    long long size;
+    long long modified;
+  };
+
+  // Models loaded from files, shared by everything that loads the same file
+  // in this process, including from worker threads. Entries only hold weak
+  // references, so a model is freed once nothing uses it any more.
+  template <typename Model>
+  class ModelCache {
+   public:
+    typedef std::function<std::shared_ptr<const Model>(const std::string& path)> Loader;
+
+    // The model in path, loaded with load unless a model from the same
+    // version of the file is still in use.
+    std::shared_ptr<const Model> Get(const std::string& path, const Loader& load) {
+      FileVersion version;
+      if (!FileVersion::Of(path, version)) {
+        // Let the loader report why the file can't be read.
+        return load(path);
+      }
+
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        typename std::map<std::string, Entry>::iterator it = entries.find(path);
+        if (it != entries.end() && it->second.version == version) {
+          std::shared_ptr<const Model> model = it->second.model.lock();
+          if (model) {
+            return model;
+          }
+        }
+      }
+
+      // Loaded without holding the lock, so other files load meanwhile. Two
+      // threads loading the same file at once both load it, and the first to
+      // finish is kept.
+      std::shared_ptr<const Model> model = load(path);
+
+      std::lock_guard<std::mutex> lock(mutex);
+      Entry& entry = entries[path];
+      std::shared_ptr<const Model> existing = entry.model.lock();
+      if (existing && entry.version == version) {
+        return existing;
+      }
+
+      entry.version = version;
+      entry.model = model;
+      Prune();
+      return model;
+    }
+
+   private:
+    struct Entry {
+      FileVersion version;
+      std::weak_ptr<const Model> model;
+    };
+
+    // Forgets models that have been freed.
+    void Prune() {
+      typename std::map<std::string, Entry>::iterator it = entries.begin();
+      while (it != entries.end()) {
+        if (it->second.model.expired()) {
+          entries.erase(it++);
+        } else {
+          ++it;
+        }
+      }
+    }
+
+    std::mutex mutex;
+    std::map<std::string, Entry> entries;
+  };
+}
+
+#endif
@@ -0,0 +1,123 @@
+// model_file
+#include "model_file.h"
+
+#include <string.h>
+
+#include <fstream>
+
+namespace ObjectDetector {
+
+  bool ModelFile::IsModelFile(const std::string& path) {
+    std::ifstream in(path.c_str(), std::ios::binary);
+    char magic[sizeof(kMagic)];
+    return in.read(magic, sizeof(magic)) && memcmp(magic, kMagic, sizeof(kMagic)) == 0;
+  }
+
+  bool ModelFile::IsModelFile(const char* data, size_t size) {
+    return size >= sizeof(kMagic) && memcmp(data, kMagic, sizeof(kMagic)) == 0;
+  }
+
+  static uint64_t AlignModelOffset(uint64_t offset) {
+    return (offset + ModelFile::kAlignment - 1) / ModelFile::kAlignment * ModelFile::kAlignment;
+  }
+
+  void ModelFileWriter::Add(uint32_t id, const void* data, size_t size) {
+    Pending section;
+    section.id = id;
+    section.data.assign(static_cast<const char*>(data), size);
+    sections.push_back(section);
+  }
+
+  void ModelFileWriter::Write(const std::string& path) const {
+    std::vector<ModelFile::Section> table(sections.size());
+    uint64_t offset = sizeof(ModelFile::Header) + table.size() * sizeof(ModelFile::Section);
+    for (size_t i = 0; i < sections.size(); ++i) {
+      offset = AlignModelOffset(offset);
+      table[i].id = sections[i].id;
+      table[i].reserved = 0;
+      table[i].offset = offset;
+      table[i].size = sections[i].data.size();
+      offset += sections[i].data.size();
+    }
+
+    ModelFile::Header header;
+    memcpy(header.magic, ModelFile::kMagic, sizeof(header.magic));
+    header.version = ModelFile::kVersion;
+    header.byteOrder = ModelFile::kByteOrder;
+    header.kind = kind;
+    header.numSections = table.size();
+    header.fileSize = offset;
+
+    std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+    if (!out) {
+      throw std::runtime_error("Unable to open " + path + " for writing");
+    }
+
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    if (!table.empty()) {
+      out.write(reinterpret_cast<const char*>(&table[0]), table.size() * sizeof(ModelFile::Section));
+    }
+
+    uint64_t written = sizeof(header) + table.size() * sizeof(ModelFile::Section);
+    const char padding[ModelFile::kAlignment] = { 0 };
+    for (size_t i = 0; i < sections.size(); ++i) {
+      out.write(padding, table[i].offset - written);
+      out.write(sections[i].data.data(), sections[i].data.size());
+      written = table[i].offset + table[i].size;
+    }
+
+    if (!out.flush()) {
+      throw std::runtime_error("Unable to write " + path);
+    }
+  }
+
+  ModelFileReader::ModelFileReader(const std::shared_ptr<const MappedFile>& file, uint32_t kind)
+    : file(file), sections(NULL), numSections(0) {
+    if (file->Size() < sizeof(ModelFile::Header)) {
+      throw std::runtime_error("Not a model file");
+    }
+
+    const ModelFile::Header* header = reinterpret_cast<const ModelFile::Header*>(file->Data());
+    if (memcmp(header->magic, ModelFile::kMagic, sizeof(ModelFile::kMagic)) != 0) {
+      throw std::runtime_error("Not a model file");
+    }
+    if (header->byteOrder != ModelFile::kByteOrder) {
+      throw std::runtime_error("Model file was written on a machine with a different byte order");
+    }
+    if (header->version != ModelFile::kVersion) {
+      throw std::runtime_error("Unsupported model file version");
+    }
+    if (header->kind != kind) {
+      throw std::runtime_error(kind == ModelFile::kDetector ? "Model file doesn't hold a detector"
+                                                            : "Model file doesn't hold a shape predictor");
+    }
+    if (header->fileSize != file->Size() ||
+        header->numSections > (file->Size() - sizeof(ModelFile::Header)) / sizeof(ModelFile::Section)) {
+      throw std::runtime_error("Model file is truncated");
+    }
+
+    numSections = header->numSections;
+    sections = reinterpret_cast<const ModelFile::Section*>(file->Data() + sizeof(ModelFile::Header));
+    for (uint32_t i = 0; i < numSections; ++i) {
+      if (sections[i].offset % ModelFile::kAlignment != 0 || sections[i].offset > file->Size() ||
+          sections[i].size > file->Size() - sections[i].offset) {
+        throw std::runtime_error("Model file is truncated");
+      }
+    }
+  }
+
+  const ModelFile::Section& ModelFileReader::Find(uint32_t id) const {
+    for (uint32_t i = 0; i < numSections; ++i) {
+      if (sections[i].id == id) {
+        return sections[i];
+      }
+    }
+
+    throw std::runtime_error("Model file is missing a section");
+  }
+
+  std::string ModelFileReader::GetBytes(uint32_t id) const {
+    const ModelFile::Section& section = Find(id);
+    return std::string(file->Data() + section.offset, section.size);
+  }
+}
@@ -0,0 +1,129 @@
+// model_file.h
+#ifndef MODEL_FILE_H
+#define MODEL_FILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "mapped_file.h"
+
+namespace ObjectDetector {
+  // Binary model files hold a model as flat arrays that are used straight
+  // from a read-only mapping of the file, rather than parsed into objects
+  // like dlib's serialization format.
+  //
+  // A file starts with a Header and a table of Sections, followed by the
+  // data of every section, each starting on a kAlignment boundary. Values
+  // are stored in the byte order of the machine that wrote the file; the
+  // byteOrder field lets readers on other machines refuse it.
+  namespace ModelFile {
+    static const char kMagic[8] = { 'O', 'D', 'M', 'O', 'D', 'E', 'L', '\0' };
+    static const uint32_t kVersion = 1;
+    static const uint32_t kByteOrder = 0x01020304;
+    static const size_t kAlignment = 64;
+
+    enum Kind {
+      kDetector = 1,
+      kShapePredictor = 2
+    };
+
+    struct Header {
+      char magic[8];
+      uint32_t version;
+      uint32_t byteOrder;
+      uint32_t kind;
+      uint32_t numSections;
+      uint64_t fileSize;
+    };
+
+    struct Section {
+      uint32_t id;
+      uint32_t reserved;
+      uint64_t offset;
+      uint64_t size;
+    };
+
+    // True if path starts like a binary model file. Files that can't be read
+    // aren't.
+    bool IsModelFile(const std::string& path);
+    // True if the size bytes at data start like a binary model file.
+    bool IsModelFile(const char* data, size_t size);
+  }
+
+  // Lays out the sections of a model and writes them to a file.
+  class ModelFileWriter {
+   public:
+    explicit ModelFileWriter(uint32_t kind) : kind(kind) {
+    }
+
+    // The data is copied.
+    void Add(uint32_t id, const void* data, size_t size);
+
+    template <typename T>
+    void Add(uint32_t id, const std::vector<T>& values) {
+      Add(id, values.empty() ? NULL : &values[0], values.size() * sizeof(T));
+    }
+
+    // Throws std::runtime_error if the file can't be written.
+    void Write(const std::string& path) const;
+
+   private:
+    struct Pending {
+      uint32_t id;
+      std::string data;
+    };
+
+    uint32_t kind;
+    std::vector<Pending> sections;
+  };
+
+  // Reads the sections of a mapped model file.
+  class ModelFileReader {
+   public:
+    // Throws std::runtime_error unless file is a well formed model file of
+    // the given kind, written on a machine with the same byte order.
+    ModelFileReader(const std::shared_ptr<const MappedFile>& file, uint32_t kind);
+
+    // The section with the given id as an array of T, pointing into the
+    // mapping. Throws std::runtime_error if it is missing or isn't a whole
+    // number of T.
+    template <typename T>
+    const T* Get(uint32_t id, size_t& count) const {
+      const ModelFile::Section& section = Find(id);
+      if (section.size % sizeof(T) != 0) {
+        throw std::runtime_error("Model file section has the wrong size");
+      }
+
+      count = section.size / sizeof(T);
+      return reinterpret_cast<const T*>(file->Data() + section.offset);
+    }
+
+    // Like Get(), for sections that must hold exactly count values.
+    template <typename T>
+    const T* Get(uint32_t id, size_t count, const char* what) const {
+      size_t actual;
+      const T* values = Get<T>(id, actual);
+      if (actual != count) {
+        throw std::runtime_error(std::string("Model file has the wrong number of ") + what);
+      }
+
+      return values;
+    }
+
+    std::string GetBytes(uint32_t id) const;
+
+   private:
+    const ModelFile::Section& Find(uint32_t id) const;
+
+    std::shared_ptr<const MappedFile> file;
+    const ModelFile::Section* sections;
+    uint32_t numSections;
+  };
+}
+
+#endif
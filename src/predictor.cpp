@@ -1,11 +1,24 @@
 // predictor
 #include "predictor.h"
+#include "addon_data.h"
+#include "image_source.h"
+#include "memory_stream.h"
+#include "model_cache.h"
+#include "model_file.h"
+#include "property_names.h"
+
+#include <fstream>
+#include <memory>
+#include <node_buffer.h>
+#include <sstream>
 
 namespace ObjectDetector {
 
   using v8::Array;
+  using v8::ArrayBuffer;
   using v8::Function;
   using v8::Exception;
+  using v8::Float32Array;
   using v8::FunctionCallbackInfo;
   using v8::FunctionTemplate;
   using v8::HandleScope;
@@ -13,12 +26,10 @@ namespace ObjectDetector {
   using v8::Local;
   using v8::Number;
   using v8::Object;
-  using v8::Persistent;
   using v8::String;
+  using v8::Undefined;
   using v8::Value;
 
-  Persistent<Function> Predictor::constructor;
-
   void Predictor::Init(Local<Object> exports) {
     Isolate* isolate = exports->GetIsolate();
 
@@ -29,9 +40,18 @@ namespace ObjectDetector {
 
     // Prototype
     NODE_SET_PROTOTYPE_METHOD(tpl, "predictShapeInRect", PredictShapeInRect);
+    NODE_SET_PROTOTYPE_METHOD(tpl, "predictShapeInBuffer", PredictShapeInBuffer);
+    NODE_SET_PROTOTYPE_METHOD(tpl, "predictShapesInRects", PredictShapesInRects);
     NODE_SET_PROTOTYPE_METHOD(tpl, "saveToFile", SaveToFile);
+    NODE_SET_PROTOTYPE_METHOD(tpl, "saveToBinaryFile", SaveToBinaryFile);
+
+    // Static methods
+    tpl->Set(String::NewFromUtf8(isolate, "fromBuffer"), FunctionTemplate::New(isolate, FromBuffer));
+    tpl->Set(String::NewFromUtf8(isolate, "fromBufferAsync"), FunctionTemplate::New(isolate, FromBufferAsync));
 
-    constructor.Reset(isolate, tpl->GetFunction());
+    AddonData* data = AddonData::Get(isolate);
+    data->predictorTemplate.Reset(isolate, tpl);
+    data->predictorConstructor.Reset(isolate, tpl->GetFunction());
     exports->Set(String::NewFromUtf8(isolate, "Predictor"), tpl->GetFunction());
   }
 
@@ -61,7 +81,7 @@ namespace ObjectDetector {
         // Invoked as plain function `Predictor(...)`, turn into construct call.
         const int argc = 1;
         Local<Value> argv[argc] = { args[0] };
-        Local<Function> cons = Local<Function>::New(isolate, constructor);
+        Local<Function> cons = Local<Function>::New(isolate, AddonData::Get(isolate)->predictorConstructor);
         args.GetReturnValue().Set(cons->NewInstance(argc, argv));
       }
     } catch (std::exception& e) {
@@ -69,6 +89,148 @@ namespace ObjectDetector {
     }
   }
 
+  std::shared_ptr<const PredictorModel> Predictor::LoadModel(const std::string& path) {
+    static ModelCache<PredictorModel> cache;
+    return cache.Get(path, [](const std::string& path) {
+      std::shared_ptr<PredictorModel> model = std::make_shared<PredictorModel>();
+      if (ModelFile::IsModelFile(path)) {
+        model->mapped.reset(new MappedShapePredictor(path));
+      } else {
+        dlib::deserialize(path) >> model->predictor;
+      }
+      model->metrics = ModelMetrics::Get("shape_predictor", path);
+      return std::shared_ptr<const PredictorModel>(model);
+    });
+  }
+
+  std::shared_ptr<const PredictorModel> Predictor::LoadModel(const char* data, size_t size) {
+    std::shared_ptr<PredictorModel> model = std::make_shared<PredictorModel>();
+    if (ModelFile::IsModelFile(data, size)) {
+      model->mapped.reset(new MappedShapePredictor(std::make_shared<MappedFile>(data, size)));
+    } else {
+      MemoryStream in(data, size);
+      // Found by argument dependent lookup; it's a friend of shape_predictor.
+      deserialize(model->predictor, in);
+    }
+    model->metrics = ModelMetrics::Get("shape_predictor", ModelMetrics::BufferName(data, size));
+    return model;
+  }
+
+  bool Predictor::HasInstance(Isolate* isolate, Local<Value> value) {
+    Local<FunctionTemplate> tpl = Local<FunctionTemplate>::New(isolate, AddonData::Get(isolate)->predictorTemplate);
+    return tpl->HasInstance(value);
+  }
+
+  Predictor::TrainOptions Predictor::ParseTrainOptions(Isolate* isolate, Local<Value> value, TrainOptions options) {
+    if (value->IsUndefined() || !value->IsObject()) {
+      return options;
+    }
+
+    Local<Object> opts = value->ToObject();
+
+    Local<Value> optVerbose = opts->Get(String::NewFromUtf8(isolate, "verbose"));
+    if (!optVerbose->IsUndefined()) {
+      options.verbose = optVerbose->BooleanValue();
+    }
+
+    Local<Value> optCascadeDepth = opts->Get(String::NewFromUtf8(isolate, "cascadeDepth"));
+    if (!optCascadeDepth->IsUndefined()) {
+      options.cascadeDepth = optCascadeDepth->NumberValue();
+    }
+
+    Local<Value> optOversamplingAmount = opts->Get(String::NewFromUtf8(isolate, "oversamplingAmount"));
+    if (!optOversamplingAmount->IsUndefined()) {
+      options.oversamplingAmount = optOversamplingAmount->NumberValue();
+    }
+
+    Local<Value> optNu = opts->Get(String::NewFromUtf8(isolate, "nu"));
+    if (!optNu->IsUndefined()) {
+      options.nu = optNu->NumberValue();
+    }
+
+    Local<Value> optTreesPerCascade = opts->Get(String::NewFromUtf8(isolate, "treesPerCascadeLevel"));
+    if (!optTreesPerCascade->IsUndefined()) {
+      options.treesPerCascade = optTreesPerCascade->IntegerValue();
+    }
+
+    Local<Value> optMirrors = opts->Get(String::NewFromUtf8(isolate, "includeMirrors"));
+    if (!optMirrors->IsUndefined()) {
+      options.includeMirrors = optMirrors->BooleanValue();
+    }
+
+    Local<Value> optTreeDepth = opts->Get(String::NewFromUtf8(isolate, "treeDepth"));
+    if (!optTreeDepth->IsUndefined()) {
+      options.treeDepth = optTreeDepth->IntegerValue();
+    }
+
+    return options;
+  }
+
+  std::shared_ptr<PredictorModel> Predictor::Train(const std::string& xmlPath, const TrainOptions& options,
+                                                   const TrainingReporter& report) {
+    // A trained model is known by the file it was trained on.
+    ModelMetrics* metrics = ModelMetrics::Get("shape_predictor", xmlPath);
+    metrics->Api(kTrainApi).counters[kCallsCounter].Add();
+    StageClock clock(true);
+    try {
+      std::shared_ptr<PredictorModel> model = std::make_shared<PredictorModel>();
+      model->predictor = TrainModel(xmlPath, options, report);
+      model->metrics = metrics;
+      metrics->Api(kTrainApi).latency.Record(clock.Lap());
+      return model;
+    } catch (std::exception& e) {
+      metrics->Failed(kTrainApi, e);
+      throw;
+    }
+  }
+
+  dlib::shape_predictor Predictor::TrainModel(const std::string& xmlPath, const TrainOptions& options,
+                                              const TrainingReporter& report) {
+    dlib::array<dlib::array2d<unsigned char> > images_train;
+    std::vector<std::vector<dlib::full_object_detection> > shapes_train;
+    dlib::load_image_dataset(images_train, shapes_train, xmlPath);
+
+    if (options.includeMirrors) {
+      // Add mirror images
+      dlib::add_image_left_right_flips(images_train, shapes_train);
+    }
+
+    dlib::shape_predictor_trainer trainer;
+    trainer.set_cascade_depth(options.cascadeDepth);
+    trainer.set_oversampling_amount(options.oversamplingAmount);
+    trainer.set_nu(options.nu);
+    trainer.set_tree_depth(options.treeDepth);
+    trainer.set_num_trees_per_cascade_level(options.treesPerCascade);
+
+    if (options.verbose) {
+      std::cout << "Cascade depth set to " << options.cascadeDepth << std::endl;
+      std::cout << "Trees per cascade level set to " << options.treesPerCascade << std::endl;
+      std::cout << "Tree depth set to " << options.treeDepth << std::endl;
+      std::cout << "Oversampling amount set to " << options.oversamplingAmount << std::endl;
+      std::cout << "Nu set to " << options.nu << std::endl;
+      std::cout << "Mirrors: " << (options.includeMirrors ? "on" : "off") << std::endl;
+      std::cout << "Total samples: " << images_train.size() << std::endl;
+      trainer.be_verbose();
+    }
+
+    if (report) {
+      const unsigned long iterations = trainer.get_cascade_depth() * trainer.get_num_trees_per_cascade_level();
+      TrainingStatus status;
+      status.iterations = iterations;
+      report(status);
+
+      trainer.set_status_callback([&report, iterations](unsigned long treesFit, unsigned long samplesProcessed) {
+        TrainingStatus status;
+        status.iteration = treesFit;
+        status.iterations = iterations;
+        status.samplesProcessed = samplesProcessed;
+        report(status);
+      });
+    }
+
+    return trainer.train(images_train, shapes_train);
+  }
+
   void Predictor::TrainFromXML(const FunctionCallbackInfo<Value>& args) {
     Isolate* isolate = args.GetIsolate();
 
@@ -79,83 +241,155 @@ namespace ObjectDetector {
     }
 
     try {
-      Local<Function> cons = Local<Function>::New(isolate, constructor);
+      Local<Function> cons = Local<Function>::New(isolate, AddonData::Get(isolate)->predictorConstructor);
       Local<Object> inst = cons->NewInstance(0, 0);
       args.GetReturnValue().Set(inst);
 
       Predictor* obj = ObjectWrap::Unwrap<Predictor>(inst);
       v8::String::Utf8Value xmlPath(args[0]->ToString());
 
-      double cascadeDepth = 10, oversamplingAmount = 20, nu = 0.1;
-      bool verbose = true, includeMirrors = false;
-      int treeDepth = 5, treesPerCascade = 500;
-      if (args.Length() == 2 && !args[1]->IsUndefined() && args[1]->IsObject()) {
-        Local<Object> options = args[1]->ToObject();
+      TrainOptions options = ParseTrainOptions(isolate, args.Length() == 2 ? args[1] : Local<Value>(Undefined(isolate)),
+                                               TrainOptions());
+      obj->model = Train(*xmlPath, options, TrainingReporter());
+    } catch (std::exception& e) {
+      isolate->ThrowException(Exception::Error(String::NewFromUtf8(isolate, e.what())));
+    }
+  }
 
-        Local<Value> optVerbose = options->Get(String::NewFromUtf8(isolate, "verbose"));
-        if (!optVerbose->IsUndefined()) {
-          verbose = optVerbose->BooleanValue();
-        }
+  // Trains a shape predictor on the thread pool and settles with a new
+  // Predictor.
+  class PredictorTrainWorker : public TrainingWorker {
+   public:
+    PredictorTrainWorker(Isolate* isolate, const std::string& xmlPath, const Predictor::TrainOptions& options,
+                         Local<Value> onProgress)
+      : TrainingWorker(isolate, onProgress), xmlPath(xmlPath), options(options) {
+    }
 
-        Local<Value> optCascadeDepth = options->Get(String::NewFromUtf8(isolate, "cascadeDepth"));
-        if (!optCascadeDepth->IsUndefined()) {
-          cascadeDepth = optCascadeDepth->NumberValue();
-        }
+   protected:
+    void Execute() {
+      StartClock();
+      model = Predictor::Train(xmlPath, options, Reporter());
+    }
 
-        Local<Value> optOversamplingAmount = options->Get(String::NewFromUtf8(isolate, "oversamplingAmount"));
-        if (!optOversamplingAmount->IsUndefined()) {
-          oversamplingAmount = optOversamplingAmount->NumberValue();
-        }
+    Local<Value> Result() {
+      Local<Function> cons = Local<Function>::New(isolate, AddonData::Get(isolate)->predictorConstructor);
+      Local<Object> inst = cons->NewInstance(0, 0);
+      node::ObjectWrap::Unwrap<Predictor>(inst)->model = model;
+      return inst;
+    }
 
-        Local<Value> optNu = options->Get(String::NewFromUtf8(isolate, "nu"));
-        if (!optNu->IsUndefined()) {
-          nu = optNu->NumberValue();
-        }
+   private:
+    std::string xmlPath;
+    Predictor::TrainOptions options;
+    std::shared_ptr<const PredictorModel> model;
+  };
 
-        Local<Value> optTreesPerCascade = options->Get(String::NewFromUtf8(isolate, "treesPerCascadeLevel"));
-        if (!optTreesPerCascade->IsUndefined()) {
-          treesPerCascade = optTreesPerCascade->IntegerValue();
-        }
+  void Predictor::TrainFromXMLAsync(const FunctionCallbackInfo<Value>& args) {
+    Isolate* isolate = args.GetIsolate();
 
-        Local<Value> optMirrors = options->Get(String::NewFromUtf8(isolate, "includeMirrors"));
-        if (!optMirrors->IsUndefined()) {
-          includeMirrors = optMirrors->BooleanValue();
-        }
+    if (args.Length() < 1 || args.Length() > 3) {
+      isolate->ThrowException(Exception::TypeError(
+          String::NewFromUtf8(isolate, "Wrong number of arguments")));
+      return;
+    }
 
-        Local<Value> optTreeDepth = options->Get(String::NewFromUtf8(isolate, "treeDepth"));
-        if (!optTreeDepth->IsUndefined()) {
-          treeDepth = optTreeDepth->IntegerValue();
+    try {
+      v8::String::Utf8Value xmlPath(args[0]->ToString());
+
+      // Progress goes to onProgress rather than standard out unless asked for.
+      TrainOptions options;
+      options.verbose = false;
+      Local<Value> onProgress = Undefined(isolate);
+      bool hasOptions = args.Length() > 1 && args[1]->IsObject() && !args[1]->IsFunction();
+      if (hasOptions) {
+        options = ParseTrainOptions(isolate, args[1], options);
+
+        onProgress = args[1]->ToObject()->Get(String::NewFromUtf8(isolate, "onProgress"));
+        if (!onProgress->IsUndefined() && !onProgress->IsFunction()) {
+          isolate->ThrowException(Exception::TypeError(
+              String::NewFromUtf8(isolate, "onProgress must be a function")));
+          return;
         }
       }
 
-      dlib::array<dlib::array2d<unsigned char> > images_train;
-      std::vector<std::vector<dlib::full_object_detection> > shapes_train;
-      dlib::load_image_dataset(images_train, shapes_train, *xmlPath);
-
-      if (includeMirrors) {
-        // Add mirror images
-        dlib::add_image_left_right_flips(images_train, shapes_train);
+      // Owned here until queued, in case the job options are invalid.
+      std::unique_ptr<PredictorTrainWorker> worker(new PredictorTrainWorker(isolate, *xmlPath, options, onProgress));
+      if (hasOptions) {
+        worker->SetJobOptions(args[1]);
       }
+      args.GetReturnValue().Set(worker.release()->Queue(args[hasOptions ? 2 : 1]));
+    } catch (std::exception& e) {
+      isolate->ThrowException(Exception::Error(String::NewFromUtf8(isolate, e.what())));
+    }
+  }
 
-      dlib::shape_predictor_trainer trainer;
-      trainer.set_cascade_depth(cascadeDepth);
-      trainer.set_oversampling_amount(oversamplingAmount);
-      trainer.set_nu(nu);
-      trainer.set_tree_depth(treeDepth);
-      trainer.set_num_trees_per_cascade_level(treesPerCascade);
-
-      if (verbose) {
-        std::cout << "Cascade depth set to " << cascadeDepth << std::endl;
-        std::cout << "Trees per cascade level set to " << treesPerCascade << std::endl;
-        std::cout << "Tree depth set to " << treeDepth << std::endl;
-        std::cout << "Oversampling amount set to " << oversamplingAmount << std::endl;
-        std::cout << "Nu set to " << nu << std::endl;
-        std::cout << "Mirrors: " << (includeMirrors ? "on" : "off") << std::endl;
-        std::cout << "Total samples: " << images_train.size() << std::endl;
-        trainer.be_verbose();
-      }
+  void Predictor::FromBuffer(const FunctionCallbackInfo<Value>& args) {
+    Isolate* isolate = args.GetIsolate();
+
+    if (args.Length() != 1 || !node::Buffer::HasInstance(args[0])) {
+      isolate->ThrowException(Exception::TypeError(
+          String::NewFromUtf8(isolate, "Wrong number/type of arguments")));
+      return;
+    }
+
+    try {
+      std::shared_ptr<const PredictorModel> model = LoadModel(node::Buffer::Data(args[0]), node::Buffer::Length(args[0]));
+
+      Local<Function> cons = Local<Function>::New(isolate, AddonData::Get(isolate)->predictorConstructor);
+      Local<Object> inst = cons->NewInstance(0, 0);
+      ObjectWrap::Unwrap<Predictor>(inst)->model = model;
+      args.GetReturnValue().Set(inst);
+    } catch (std::exception& e) {
+      isolate->ThrowException(Exception::Error(String::NewFromUtf8(isolate, e.what())));
+    }
+  }
+
+  // Parses a model held in a Buffer on the thread pool.
+  class PredictorLoadWorker : public AsyncWorker {
+   public:
+    PredictorLoadWorker(Isolate* isolate, Local<Value> buffer)
+      : AsyncWorker(isolate), data(node::Buffer::Data(buffer)), size(node::Buffer::Length(buffer)) {
+    }
+
+   protected:
+    void Execute() {
+      Control().Check();
+      model = Predictor::LoadModel(data, size);
+    }
+
+    Local<Value> Result() {
+      Local<Function> cons = Local<Function>::New(isolate, AddonData::Get(isolate)->predictorConstructor);
+      Local<Object> inst = cons->NewInstance(0, 0);
+      node::ObjectWrap::Unwrap<Predictor>(inst)->model = model;
+      return inst;
+    }
+
+   private:
+    const char* data;
+    size_t size;
+    std::shared_ptr<const PredictorModel> model;
+  };
+
+  void Predictor::FromBufferAsync(const FunctionCallbackInfo<Value>& args) {
+    Isolate* isolate = args.GetIsolate();
+
+    if (args.Length() < 1 || args.Length() > 3 || !node::Buffer::HasInstance(args[0])) {
+      isolate->ThrowException(Exception::TypeError(
+          String::NewFromUtf8(isolate, "Wrong number/type of arguments")));
+      return;
+    }
+
+    try {
+      bool hasOptions = args.Length() > 1 && args[1]->IsObject() && !args[1]->IsFunction();
 
-      obj->dlibShapePredictor = trainer.train(images_train, shapes_train);
+      // Owned here until queued, in case the job options are invalid.
+      std::unique_ptr<PredictorLoadWorker> worker(new PredictorLoadWorker(isolate, args[0]));
+      if (hasOptions) {
+        worker->SetJobOptions(args[1]);
+      }
+      // The Buffer is read in place, so keep it from being collected.
+      worker->SaveToPersistent(0, args[0]);
+      args.GetReturnValue().Set(worker.release()->Queue(args[hasOptions ? 2 : 1]));
     } catch (std::exception& e) {
       isolate->ThrowException(Exception::Error(String::NewFromUtf8(isolate, e.what())));
     }
@@ -164,67 +398,188 @@ namespace ObjectDetector {
   void Predictor::PredictShapeInRect(const FunctionCallbackInfo<Value>& args) {
     Isolate* isolate = args.GetIsolate();
 
-    if (args.Length() != 2 || args[1]->IsUndefined() || !args[1]->IsObject()) {
+    if (args.Length() < 2 || args.Length() > 3 || args[1]->IsUndefined() || !args[1]->IsObject()) {
+      isolate->ThrowException(Exception::TypeError(
+          String::NewFromUtf8(isolate, "Wrong number/type of arguments")));
+      return;
+    }
+
+    PredictShape(args);
+  }
+
+  void Predictor::PredictShapeInBuffer(const FunctionCallbackInfo<Value>& args) {
+    Isolate* isolate = args.GetIsolate();
+
+    if (args.Length() < 2 || args.Length() > 3 || !ImageSource::IsBuffer(args[0]) ||
+        args[1]->IsUndefined() || !args[1]->IsObject()) {
       isolate->ThrowException(Exception::TypeError(
           String::NewFromUtf8(isolate, "Wrong number/type of arguments")));
       return;
     }
 
+    PredictShape(args);
+  }
+
+  bool Predictor::ToRectangle(Isolate* isolate, Local<Value> value, dlib::rectangle& rect) {
+    if (value->IsUndefined() || !value->IsObject()) {
+      isolate->ThrowException(Exception::TypeError(
+        String::NewFromUtf8(isolate, "Rect must be an object")));
+      return false;
+    }
+
+    Local<Object> obj = value->ToObject();
+    Local<Value> rectTop = obj->Get(String::NewFromUtf8(isolate, "top"));
+    if (rectTop->IsUndefined()) {
+      isolate->ThrowException(Exception::TypeError(
+        String::NewFromUtf8(isolate, "Rect top must be defined")));
+      return false;
+    }
+
+    Local<Value> rectLeft = obj->Get(String::NewFromUtf8(isolate, "left"));
+    if (rectLeft->IsUndefined()) {
+      isolate->ThrowException(Exception::TypeError(
+        String::NewFromUtf8(isolate, "Rect left must be defined")));
+      return false;
+    }
+
+    Local<Value> rectWidth = obj->Get(String::NewFromUtf8(isolate, "width"));
+    if (rectWidth->IsUndefined()) {
+      isolate->ThrowException(Exception::TypeError(
+        String::NewFromUtf8(isolate, "Rect width must be defined")));
+      return false;
+    }
+
+    Local<Value> rectHeight = obj->Get(String::NewFromUtf8(isolate, "height"));
+    if (rectHeight->IsUndefined()) {
+      isolate->ThrowException(Exception::TypeError(
+        String::NewFromUtf8(isolate, "Rect height must be defined")));
+      return false;
+    }
+
+    double top = rectTop->NumberValue(), left = rectLeft->NumberValue();
+    double width = rectWidth->NumberValue(), height = rectHeight->NumberValue();
+    rect = dlib::rectangle(left, top, left + width, top + height);
+    return true;
+  }
+
+  Local<Array> Predictor::ToArray(Isolate* isolate, const dlib::full_object_detection& shape, long cols, long rows) {
+    Local<Array> points = Array::New(isolate);
+    for (unsigned int i = 0; i < shape.num_parts(); ++i) {
+      double x = shape.part(i).x();
+      double y = shape.part(i).y();
+      double xScaled = x / cols, yScaled = y / rows;
+
+      HandleScope scope(isolate);
+      Local<Object> point = Object::New(isolate);
+      point->Set(GetPropertyName(isolate, kX), Number::New(isolate, x));
+      point->Set(GetPropertyName(isolate, kY), Number::New(isolate, y));
+      point->Set(GetPropertyName(isolate, kXScaled), Number::New(isolate, xScaled));
+      point->Set(GetPropertyName(isolate, kYScaled), Number::New(isolate, yScaled));
+      points->Set(i, point);
+    }
+
+    return points;
+  }
+
+  void Predictor::Pack(const dlib::full_object_detection& shape, float* out) {
+    for (unsigned long i = 0; i < shape.num_parts(); ++i) {
+      out[2 * i] = shape.part(i).x();
+      out[2 * i + 1] = shape.part(i).y();
+    }
+  }
+
+  bool Predictor::IsPacked(Isolate* isolate, Local<Value> options) {
+    if (options->IsUndefined() || !options->IsObject()) {
+      return false;
+    }
+
+    return options->ToObject()->Get(String::NewFromUtf8(isolate, "packed"))->BooleanValue();
+  }
+
+  Local<Float32Array> Predictor::ToFloat32Array(Isolate* isolate,
+                                                const std::vector<dlib::full_object_detection>& shapes) {
+    size_t length = 0;
+    for (unsigned int i = 0; i < shapes.size(); ++i) {
+      length += 2 * shapes[i].num_parts();
+    }
+
+    Local<ArrayBuffer> buffer = ArrayBuffer::New(isolate, length * sizeof(float));
+    float* out = static_cast<float*>(buffer->GetContents().Data());
+    for (unsigned int i = 0; i < shapes.size(); ++i) {
+      Pack(shapes[i], out);
+      out += 2 * shapes[i].num_parts();
+    }
+
+    return Float32Array::New(buffer, 0, length);
+  }
+
+  void Predictor::PredictShape(const FunctionCallbackInfo<Value>& args) {
+    Isolate* isolate = args.GetIsolate();
+
     try {
       Predictor* obj = ObjectWrap::Unwrap<Predictor>(args.Holder());
-      v8::String::Utf8Value imgPath(args[0]->ToString());
+      ImageSource source(isolate, args[0]);
 
-      Local<Object> rect = args[1]->ToObject();
-      Local<Value> rectTop = rect->Get(String::NewFromUtf8(isolate, "top"));
-      if (rectTop->IsUndefined()) {
-        isolate->ThrowException(Exception::TypeError(
-          String::NewFromUtf8(isolate, "Rect top must be defined")));
+      dlib::rectangle detection;
+      if (!ToRectangle(isolate, args[1], detection)) {
         return;
       }
 
-      Local<Value> rectLeft = rect->Get(String::NewFromUtf8(isolate, "left"));
-      if (rectLeft->IsUndefined()) {
-        isolate->ThrowException(Exception::TypeError(
-          String::NewFromUtf8(isolate, "Rect left must be defined")));
-        return;
-      }
+      dlib::array2d<unsigned char> img;
+      source.Load(img);
 
-      Local<Value> rectWidth = rect->Get(String::NewFromUtf8(isolate, "width"));
-      if (rectWidth->IsUndefined()) {
-        isolate->ThrowException(Exception::TypeError(
-          String::NewFromUtf8(isolate, "Rect width must be defined")));
-        return;
+      dlib::full_object_detection shape = obj->Predict(img, detection);
+
+      HandleScope scope(isolate);
+      if (IsPacked(isolate, args[2])) {
+        args.GetReturnValue().Set(ToFloat32Array(isolate, std::vector<dlib::full_object_detection>(1, shape)));
+      } else {
+        args.GetReturnValue().Set(ToArray(isolate, shape, img.nc(), img.nr()));
       }
+    } catch (std::exception& e) {
+      isolate->ThrowException(Exception::Error(String::NewFromUtf8(isolate, e.what())));
+    }
+  }
 
-      Local<Value> rectHeight = rect->Get(String::NewFromUtf8(isolate, "height"));
-      if (rectHeight->IsUndefined()) {
-        isolate->ThrowException(Exception::TypeError(
-          String::NewFromUtf8(isolate, "Rect height must be defined")));
-        return;
+  // Decodes the image once and predicts a shape in each of the rectangles.
+  void Predictor::PredictShapesInRects(const FunctionCallbackInfo<Value>& args) {
+    Isolate* isolate = args.GetIsolate();
+
+    if (args.Length() < 2 || args.Length() > 3 || !args[1]->IsArray()) {
+      isolate->ThrowException(Exception::TypeError(
+          String::NewFromUtf8(isolate, "Wrong number/type of arguments")));
+      return;
+    }
+
+    try {
+      Predictor* obj = ObjectWrap::Unwrap<Predictor>(args.Holder());
+      ImageSource source(isolate, args[0]);
+
+      Local<Array> rects = args[1].As<Array>();
+      std::vector<dlib::rectangle> detections(rects->Length());
+      for (unsigned int i = 0; i < detections.size(); ++i) {
+        if (!ToRectangle(isolate, rects->Get(i), detections[i])) {
+          return;
+        }
       }
 
-      double top = rectTop->NumberValue(), left = rectLeft->NumberValue();
-      double width = rectWidth->NumberValue(), height = rectHeight->NumberValue();
       dlib::array2d<unsigned char> img;
-      dlib::load_image(img, std::string(*imgPath));
+      source.Load(img);
 
-      dlib::rectangle detection(left, top, left + width, top + height);
-      dlib::full_object_detection shape = obj->dlibShapePredictor(img, detection);
+      std::vector<dlib::full_object_detection> shapes(detections.size());
+      for (unsigned int i = 0; i < detections.size(); ++i) {
+        shapes[i] = obj->Predict(img, detections[i]);
+      }
 
       HandleScope scope(isolate);
-      Local<Array> points = Array::New(isolate);
-      for (unsigned int i = 0; i < shape.num_parts(); ++i) {
-        double x = shape.part(i).x();
-        double y = shape.part(i).y();
-        double xScaled = x / img.nc(), yScaled = y / img.nr();
-
-        HandleScope scope(isolate);
-        Local<Object> point = Object::New(isolate);
-        point->Set(String::NewFromUtf8(isolate, "x"), Number::New(isolate, x));
-        point->Set(String::NewFromUtf8(isolate, "y"), Number::New(isolate, y));
-        point->Set(String::NewFromUtf8(isolate, "xScaled"), Number::New(isolate, xScaled));
-        point->Set(String::NewFromUtf8(isolate, "yScaled"), Number::New(isolate, yScaled));
-        points->Set(i, point);
+      if (IsPacked(isolate, args[2])) {
+        args.GetReturnValue().Set(ToFloat32Array(isolate, shapes));
+        return;
+      }
+
+      Local<Array> points = Array::New(isolate, shapes.size());
+      for (unsigned int i = 0; i < shapes.size(); ++i) {
+        points->Set(i, ToArray(isolate, shapes[i], img.nc(), img.nr()));
       }
 
       args.GetReturnValue().Set(points);
@@ -245,7 +600,41 @@ namespace ObjectDetector {
     try {
       Predictor* obj = ObjectWrap::Unwrap<Predictor>(args.Holder());
       v8::String::Utf8Value filePath(args[0]->ToString());
-      dlib::serialize(std::string(*filePath)) << obj->dlibShapePredictor;
+      if (obj->model->mapped) {
+        std::ofstream out(*filePath, std::ios::binary);
+        obj->model->mapped->Serialize(out);
+        if (!out.flush()) {
+          throw std::runtime_error(std::string("Unable to write ") + *filePath);
+        }
+      } else {
+        dlib::serialize(std::string(*filePath)) << obj->model->predictor;
+      }
+    } catch (std::exception& e) {
+      isolate->ThrowException(Exception::Error(String::NewFromUtf8(isolate, e.what())));
+    }
+  }
+
+  void Predictor::SaveToBinaryFile(const FunctionCallbackInfo<Value>& args) {
+    Isolate* isolate = args.GetIsolate();
+
+    if (args.Length() != 1) {
+      isolate->ThrowException(Exception::TypeError(
+          String::NewFromUtf8(isolate, "Wrong number of arguments")));
+      return;
+    }
+
+    try {
+      Predictor* obj = ObjectWrap::Unwrap<Predictor>(args.Holder());
+      v8::String::Utf8Value filePath(args[0]->ToString());
+      if (obj->model->mapped) {
+        std::stringstream stream;
+        obj->model->mapped->Serialize(stream);
+        dlib::shape_predictor predictor;
+        deserialize(predictor, stream);
+        MappedShapePredictor::Save(predictor, *filePath);
+      } else {
+        MappedShapePredictor::Save(obj->model->predictor, *filePath);
+      }
     } catch (std::exception& e) {
       isolate->ThrowException(Exception::Error(String::NewFromUtf8(isolate, e.what())));
     }
@@ -5,29 +5,129 @@
 #include <node.h>
 #include <node_object_wrap.h>
 
+#include <memory>
+#include <vector>
+
 #include "dlib/image_processing.h"
 #include "dlib/data_io.h"
 
+#include "mapped_shape_predictor.h"
+#include "metrics.h"
+#include "trace.h"
+#include "training.h"
+
 namespace ObjectDetector {
+  // A trained shape predictor, either in dlib's own structures or used in
+  // place from a mapped model file. It is never modified once loaded, so
+  // Predictors made from the same file share it.
+  struct PredictorModel {
+    PredictorModel() : metrics(ModelMetrics::Get("shape_predictor", "unnamed")) {
+    }
+
+    dlib::shape_predictor predictor;
+    std::unique_ptr<MappedShapePredictor> mapped;
+
+    // Where calls using the model are counted. Set to a name for the model
+    // by whatever loads or trains it.
+    ModelMetrics* metrics;
+  };
+
   class Predictor : public node::ObjectWrap {
    public:
     static void Init(v8::Local<v8::Object> exports);
     static void New(const v8::FunctionCallbackInfo<v8::Value>& args);
     static void TrainFromXML(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void TrainFromXMLAsync(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void FromBuffer(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void FromBufferAsync(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static bool HasInstance(v8::Isolate* isolate, v8::Local<v8::Value> value);
+
+    // Every shape is counted in the model's metrics.
+    template <typename image_type>
+    dlib::full_object_detection Predict(const image_type& img, const dlib::rectangle& rect) const {
+      ApiMetrics& metrics = model->metrics->Api(kPredictApi);
+      metrics.counters[kCallsCounter].Add();
+      StageClock clock(true);
+      TraceScope trace("predictShape");
+      try {
+        dlib::full_object_detection shape = model->mapped ? (*model->mapped)(img, rect) : model->predictor(img, rect);
+        metrics.latency.Record(clock.Lap());
+        return shape;
+      } catch (std::exception& e) {
+        model->metrics->Failed(kPredictApi, e);
+        throw;
+      }
+    }
+
+    // Points of a shape, with xScaled and yScaled relative to an image of
+    // cols x rows pixels.
+    static v8::Local<v8::Array> ToArray(v8::Isolate* isolate, const dlib::full_object_detection& shape, long cols, long rows);
+
+    // Writes the points of a shape as [x0, y0, x1, y1, ...].
+    static void Pack(const dlib::full_object_detection& shape, float* out);
 
    private:
-    explicit Predictor() {
+    friend class PredictorTrainWorker;
+    friend class PredictorLoadWorker;
+
+    // Options accepted by trainPredictorFromXML.
+    struct TrainOptions {
+      TrainOptions()
+        : cascadeDepth(10), oversamplingAmount(20), nu(0.1), verbose(true), includeMirrors(false), treeDepth(5),
+          treesPerCascade(500) {
+      }
+
+      double cascadeDepth;
+      double oversamplingAmount;
+      double nu;
+      bool verbose;
+      bool includeMirrors;
+      int treeDepth;
+      int treesPerCascade;
+    };
 
+    // Fields missing from value keep their value in options.
+    static TrainOptions ParseTrainOptions(v8::Isolate* isolate, v8::Local<v8::Value> value, TrainOptions options);
+
+    // Trains a shape predictor on the shapes listed in an imglab XML file. If
+    // report is set it is called once the data set is loaded, after every
+    // sample's features are computed and after every tree, and training stops
+    // if it throws.
+    static std::shared_ptr<PredictorModel> Train(const std::string& xmlPath, const TrainOptions& options,
+                                                 const TrainingReporter& report);
+    // Train() without the metrics.
+    static dlib::shape_predictor TrainModel(const std::string& xmlPath, const TrainOptions& options,
+                                            const TrainingReporter& report);
+
+    explicit Predictor() : model(std::make_shared<PredictorModel>()) {
     }
 
-    explicit Predictor(std::string xmlFile) {
-      dlib::deserialize(xmlFile) >> this->dlibShapePredictor;
+    explicit Predictor(std::string xmlFile) : model(LoadModel(xmlFile)) {
     }
 
+    // Reads either dlib's serialization format or a model file (see
+    // model_file.h). Predictors loaded from the same file share one copy of
+    // it.
+    static std::shared_ptr<const PredictorModel> LoadModel(const std::string& path);
+    // Like LoadModel(), for the size bytes of a model at data, which are not
+    // cached. A model file is copied, as it is used in place.
+    static std::shared_ptr<const PredictorModel> LoadModel(const char* data, size_t size);
+
+    // Reads a {left, top, width, height} object, throwing a JS TypeError and
+    // returning false if a field is missing.
+    static bool ToRectangle(v8::Isolate* isolate, v8::Local<v8::Value> value, dlib::rectangle& rect);
+    static bool IsPacked(v8::Isolate* isolate, v8::Local<v8::Value> options);
+    // A single Float32Array holding all the shapes one after another.
+    static v8::Local<v8::Float32Array> ToFloat32Array(v8::Isolate* isolate,
+                                                      const std::vector<dlib::full_object_detection>& shapes);
+
+    static void PredictShape(const v8::FunctionCallbackInfo<v8::Value>& args);
     static void PredictShapeInRect(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void PredictShapeInBuffer(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void PredictShapesInRects(const v8::FunctionCallbackInfo<v8::Value>& args);
     static void SaveToFile(const v8::FunctionCallbackInfo<v8::Value>& args);
-    static v8::Persistent<v8::Function> constructor;
-    dlib::shape_predictor dlibShapePredictor;
+    static void SaveToBinaryFile(const v8::FunctionCallbackInfo<v8::Value>& args);
+    std::shared_ptr<const PredictorModel> model;
   };
 }
 
@@ -0,0 +1,41 @@
+// property_names
+#include "property_names.h"
+#include "addon_data.h"
+
+namespace ObjectDetector {
+
+  using v8::Isolate;
+  using v8::Local;
+  using v8::String;
+
+  static const char* propertyNameStrings[kPropertyNameCount] = {
+    "left",
+    "top",
+    "width",
+    "height",
+    "score",
+    "detectorIndex",
+    "shape",
+    "x",
+    "y",
+    "xScaled",
+    "yScaled",
+    "detections",
+    "shapes",
+    "format",
+    "channels",
+    "bitDepth"
+  };
+
+  void InitPropertyNames(Isolate* isolate) {
+    AddonData* data = AddonData::Get(isolate);
+    for (int i = 0; i < kPropertyNameCount; ++i) {
+      data->propertyNames[i].Reset(isolate,
+          String::NewFromUtf8(isolate, propertyNameStrings[i], String::kInternalizedString));
+    }
+  }
+
+  Local<String> GetPropertyName(Isolate* isolate, PropertyName name) {
+    return Local<String>::New(isolate, AddonData::Get(isolate)->propertyNames[name]);
+  }
+}
@@ -0,0 +1,35 @@
+// property_names.h
+#ifndef PROPERTY_NAMES_H
+#define PROPERTY_NAMES_H
+
+#include <node.h>
+
+namespace ObjectDetector {
+  // Names of the properties of result objects. They are internalized once when
+  // the addon loads instead of being created again for every detection and
+  // every landmark.
+  enum PropertyName {
+    kLeft,
+    kTop,
+    kWidth,
+    kHeight,
+    kScore,
+    kDetectorIndex,
+    kShape,
+    kX,
+    kY,
+    kXScaled,
+    kYScaled,
+    kDetections,
+    kShapes,
+    kFormat,
+    kChannels,
+    kBitDepth,
+    kPropertyNameCount
+  };
+
+  void InitPropertyNames(v8::Isolate* isolate);
+  v8::Local<v8::String> GetPropertyName(v8::Isolate* isolate, PropertyName name);
+}
+
+#endif
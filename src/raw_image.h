@@ -0,0 +1,80 @@
+// raw_image.h
+#ifndef RAW_IMAGE_H
+#define RAW_IMAGE_H
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "dlib/image_processing/generic_image.h"
+#include "dlib/pixel.h"
+
+namespace ObjectDetector {
+  // A dlib generic image over pixels that live in memory we don't own, e.g.
+  // the backing store of a Uint8Array. It never allocates or copies, so dlib
+  // algorithms read the caller's memory directly.
+  template <typename pixel_type>
+  class RawImage {
+   public:
+    RawImage() : data(NULL), rows(0), cols(0), stride(0) {
+    }
+
+    RawImage(const unsigned char* data, long rows, long cols, long stride)
+      : data(data), rows(rows), cols(cols), stride(stride) {
+    }
+
+    const unsigned char* data;
+    long rows;
+    long cols;
+    long stride;
+  };
+
+  template <typename T>
+  inline long num_rows(const RawImage<T>& img) { return img.rows; }
+
+  template <typename T>
+  inline long num_columns(const RawImage<T>& img) { return img.cols; }
+
+  template <typename T>
+  inline long width_step(const RawImage<T>& img) { return img.stride; }
+
+  template <typename T>
+  inline const void* image_data(const RawImage<T>& img) {
+    return img.rows != 0 && img.cols != 0 ? img.data : NULL;
+  }
+
+  // The remaining functions of the generic image interface. A view can't be
+  // resized and is only ever read from.
+  template <typename T>
+  inline void* image_data(RawImage<T>& img) {
+    return img.rows != 0 && img.cols != 0 ? const_cast<unsigned char*>(img.data) : NULL;
+  }
+
+  template <typename T>
+  inline void set_image_size(RawImage<T>& img, long rows, long cols) {
+    if (rows != img.rows || cols != img.cols) {
+      throw std::logic_error("A RawImage views external memory and can't be resized");
+    }
+  }
+
+  template <typename T>
+  inline void swap(RawImage<T>& a, RawImage<T>& b) {
+    std::swap(a.data, b.data);
+    std::swap(a.rows, b.rows);
+    std::swap(a.cols, b.cols);
+    std::swap(a.stride, b.stride);
+  }
+}
+
+namespace dlib {
+  template <typename T>
+  struct image_traits<ObjectDetector::RawImage<T> > {
+    typedef T pixel_type;
+  };
+
+  template <typename T>
+  struct image_traits<const ObjectDetector::RawImage<T> > {
+    typedef T pixel_type;
+  };
+}
+
+#endif
@@ -0,0 +1,137 @@
+// scheduler
+#include "scheduler.h"
+#include "addon_data.h"
+#include "worker.h"
+
+#include <cstdlib>
+#include <limits>
+
+namespace ObjectDetector {
+
+  using v8::Isolate;
+
+  Scheduler::Scheduler(uv_loop_t* loop)
+    : concurrency(4), maxQueueDepth(std::numeric_limits<size_t>::max()), running(0), nextSequence(0) {
+    // By default, use as many threads as the libuv pool has.
+    const char* poolSize = std::getenv("UV_THREADPOOL_SIZE");
+    if (poolSize != NULL && std::atoi(poolSize) > 0) {
+      concurrency = std::atoi(poolSize);
+    }
+
+    droppedHandle.data = this;
+    uv_async_init(loop, &droppedHandle, OnDropped);
+    // Don't keep the process alive just for the scheduler. It is only
+    // referenced while dropped lanes wait to be completed.
+    uv_unref(reinterpret_cast<uv_handle_t*>(&droppedHandle));
+  }
+
+  Scheduler* Scheduler::Get(Isolate* isolate) {
+    return AddonData::Get(isolate)->scheduler;
+  }
+
+  void Scheduler::Configure(unsigned int concurrency, size_t maxQueueDepth) {
+    this->concurrency = concurrency;
+    this->maxQueueDepth = maxQueueDepth;
+    Dispatch();
+  }
+
+  void Scheduler::Submit(AsyncWorker* worker, int priority) {
+    const size_t lanes = worker->requests.size();
+
+    if (worker->control.IsCancelled()) {
+      Drop(worker, JobError::Aborted(), lanes);
+      return;
+    }
+
+    if (worker->control.IsExpired()) {
+      Drop(worker, JobError::DeadlineExceeded(), lanes);
+      return;
+    }
+
+    const size_t idle = running < concurrency ? concurrency - running : 0;
+    const size_t waiting = queue.size() + (lanes > idle ? lanes - idle : 0);
+    if (waiting > maxQueueDepth) {
+      Drop(worker, JobError::QueueFull(), lanes);
+      return;
+    }
+
+    for (size_t i = 0; i < lanes; ++i) {
+      Entry entry = { priority, nextSequence++, worker, &worker->requests[i] };
+      queue.insert(entry);
+    }
+
+    Dispatch();
+  }
+
+  void Scheduler::Cancel(AsyncWorker* worker) {
+    for (std::set<Entry>::iterator it = queue.begin(); it != queue.end();) {
+      if (it->worker == worker) {
+        queue.erase(it++);
+        Drop(worker, JobError::Aborted());
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  void Scheduler::Finished() {
+    --running;
+    Dispatch();
+  }
+
+  void Scheduler::Dispatch() {
+    // Expired jobs are dropped as soon as they're noticed rather than when
+    // they reach the front, so their callers hear back without waiting for a
+    // free thread.
+    for (std::set<Entry>::iterator it = queue.begin(); it != queue.end();) {
+      if (it->worker->control.IsExpired()) {
+        AsyncWorker* worker = it->worker;
+        queue.erase(it++);
+        Drop(worker, JobError::DeadlineExceeded());
+      } else {
+        ++it;
+      }
+    }
+
+    while (running < concurrency && !queue.empty()) {
+      Entry entry = *queue.begin();
+      queue.erase(queue.begin());
+      ++running;
+      entry.worker->Run(entry.request);
+    }
+  }
+
+  // Completes lanes of the worker without running them.
+  void Scheduler::Drop(AsyncWorker* worker, const JobError& error, size_t lanes) {
+    worker->Fail(error);
+    // Their callers must hear back even if nothing else keeps the loop alive.
+    if (dropped.empty()) {
+      uv_ref(reinterpret_cast<uv_handle_t*>(&droppedHandle));
+    }
+    dropped.insert(dropped.end(), lanes, worker);
+    uv_async_send(&droppedHandle);
+  }
+
+  void Scheduler::OnDropped(uv_async_t* handle) {
+    Scheduler* scheduler = static_cast<Scheduler*>(handle->data);
+    std::vector<AsyncWorker*> workers;
+    workers.swap(scheduler->dropped);
+
+    for (unsigned int i = 0; i < workers.size(); ++i) {
+      workers[i]->LaneDone();
+    }
+
+    // Callbacks may have dropped more jobs, which are completed next time.
+    if (scheduler->dropped.empty()) {
+      uv_unref(reinterpret_cast<uv_handle_t*>(handle));
+    }
+  }
+
+  void Scheduler::Close() {
+    uv_close(reinterpret_cast<uv_handle_t*>(&droppedHandle), OnClose);
+  }
+
+  void Scheduler::OnClose(uv_handle_t* handle) {
+    delete static_cast<Scheduler*>(handle->data);
+  }
+}
@@ -0,0 +1,79 @@
+// scheduler.h
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <node.h>
+#include <uv.h>
+
+#include <set>
+#include <vector>
+
+#include "job_control.h"
+
+namespace ObjectDetector {
+  class AsyncWorker;
+
+  // Decides when queued AsyncWorkers get a thread pool thread. At most
+  // `concurrency` jobs run at once; the rest wait, highest priority first and
+  // in submission order within a priority. Jobs are refused once
+  // `maxQueueDepth` are waiting, and dropped when they are aborted or their
+  // deadline passes before they start.
+  //
+  // Lives on the event loop thread of its environment and is not thread safe.
+  class Scheduler {
+   public:
+    explicit Scheduler(uv_loop_t* loop);
+
+    static Scheduler* Get(v8::Isolate* isolate);
+
+    void Configure(unsigned int concurrency, size_t maxQueueDepth);
+    unsigned int GetConcurrency() const { return concurrency; }
+    size_t GetMaxQueueDepth() const { return maxQueueDepth; }
+
+    // Queues every lane of the worker.
+    void Submit(AsyncWorker* worker, int priority);
+
+    // Drops the worker's lanes that haven't started yet.
+    void Cancel(AsyncWorker* worker);
+
+    // Called when a lane that was started has returned.
+    void Finished();
+
+    // Deletes the scheduler once libuv is done with it.
+    void Close();
+
+   private:
+    struct Entry {
+      int priority;
+      unsigned long long sequence;
+      AsyncWorker* worker;
+      uv_work_t* request;
+
+      bool operator<(const Entry& other) const {
+        if (priority != other.priority) {
+          return priority > other.priority;
+        }
+        return sequence < other.sequence;
+      }
+    };
+
+    void Dispatch();
+    void Drop(AsyncWorker* worker, const JobError& error, size_t lanes = 1);
+
+    static void OnDropped(uv_async_t* handle);
+    static void OnClose(uv_handle_t* handle);
+
+    unsigned int concurrency;
+    size_t maxQueueDepth;
+    unsigned int running;
+    unsigned long long nextSequence;
+    std::set<Entry> queue;
+
+    // Lanes that were dropped are completed from the event loop rather than
+    // inside the call that dropped them, so callbacks never run synchronously.
+    uv_async_t droppedHandle;
+    std::vector<AsyncWorker*> dropped;
+  };
+}
+
+#endif
@@ -0,0 +1,345 @@
+// tiled_detection.h
+#ifndef TILED_DETECTION_H
+#define TILED_DETECTION_H
+
+#include <stddef.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "detection.h"
+
+namespace ObjectDetector {
+  // Bytes of working memory per FHOG cell: the 31 feature planes, plus the 18
+  // orientation bins and the norm extract_fhog_features keeps while it runs
+  // and the saliency and scratch images the filters are applied with.
+  static const size_t kFeatureBytesPerCell = 31 * sizeof(float);
+  static const size_t kScanBytesPerCell = (31 + 18 + 1 + 2) * sizeof(float);
+
+  // Roughly the working memory of Detect() on a rows by cols image: the
+  // features of every pyramid level, which it keeps until the filters have
+  // run, and the temporaries of the largest level. The image and its
+  // pyramid levels come on top.
+  inline double ScanMemory(const object_detector_type& detector, long rows, long cols) {
+    const image_scanner_type& scanner = detector.get_scanner();
+    const long cellSize = scanner.get_cell_size();
+    image_scanner_type::pyramid_type pyr;
+
+    dlib::rectangle rect(cols, rows);
+    double memory = 0;
+    for (unsigned long l = PyramidLevels(scanner, rect); l > 0; --l) {
+      const double cells = static_cast<double>(rect.height() / cellSize + scanner.get_fhog_window_height()) *
+                           (rect.width() / cellSize + scanner.get_fhog_window_width());
+      memory += cells * kFeatureBytesPerCell;
+      rect = pyr.rect_down(rect);
+    }
+
+    const double firstCells = static_cast<double>(rows / cellSize + scanner.get_fhog_window_height()) *
+                              (cols / cellSize + scanner.get_fhog_window_width());
+    return memory + firstCells * (kScanBytesPerCell - kFeatureBytesPerCell);
+  }
+
+  // How the levels of a tiled scan are cut up. Every tile owns a square core
+  // of cells and reads a margin of cells around it, wide enough for the
+  // windows centered in the core to score exactly as in a whole image scan:
+  // it covers half a window, the 3 cells a FHOG feature reads pixels from,
+  // and the last columns of a tile, which dlib's filters compute without
+  // SIMD. Cores and margins are multiples of 8 cells so that tiles line up
+  // their columns with the whole image the same way its SIMD loops do.
+  struct TileGrid {
+    long coreCells;
+    long marginCells;
+  };
+
+  // The largest tiles that fit threads of them at once in memoryBudget bytes.
+  // Throws std::invalid_argument if not even a tile of one detection window
+  // fits.
+  inline TileGrid PlanTiles(const object_detector_type& detector, double memoryBudget, unsigned int threads) {
+    const image_scanner_type& scanner = detector.get_scanner();
+    const long window = std::max(scanner.get_fhog_window_width(), scanner.get_fhog_window_height());
+
+    TileGrid grid;
+    grid.marginCells = (window / 2 + 12 + 7) / 8 * 8;
+
+    // A tile's features are padded by a window on top of its margins.
+    const long side = static_cast<long>(std::sqrt(memoryBudget / threads / kScanBytesPerCell));
+    grid.coreCells = (side - window - 2 * grid.marginCells) / 8 * 8;
+    if (grid.coreCells < std::max(8L, window)) {
+      throw std::invalid_argument("memoryBudget is too small for tiles that fit the detection window");
+    }
+    return grid;
+  }
+
+  // A window that scored above the threshold, with where it was found so
+  // that candidates from any number of tiles can be put back in the order a
+  // whole image scan finds them in.
+  struct TileCandidate {
+    bool operator<(const TileCandidate& other) const {
+      if (level != other.level) {
+        return level < other.level;
+      }
+      if (row != other.row) {
+        return row < other.row;
+      }
+      return col < other.col;
+    }
+
+    unsigned long level;
+    long row;
+    long col;
+    double score;
+    dlib::rectangle rect;
+  };
+
+  // Scans one pyramid level tile by tile on up to threads threads, adding the
+  // windows whose center lies in the core of the tile that found them to
+  // candidates, by detector. The calling thread scans with scratch.
+  template <typename image_type>
+  void ScanTiles(const object_detector_type& detector, const image_type& img, unsigned long level,
+                 const TileGrid& grid, double adjustThreshold, unsigned int threads, DetectionScratch& scratch,
+                 std::vector<std::vector<TileCandidate> >& candidates, const JobControl* control,
+                 DetectionTimings::Level* timing) {
+    const image_scanner_type& scanner = detector.get_scanner();
+    const unsigned long windowWidth = scanner.get_fhog_window_width();
+    const unsigned long windowHeight = scanner.get_fhog_window_height();
+    const unsigned long boxWidth = windowWidth - 2 * scanner.get_padding();
+    const unsigned long boxHeight = windowHeight - 2 * scanner.get_padding();
+    const int cellSize = scanner.get_cell_size();
+    const image_scanner_type::feature_extractor_type& fe = scanner.get_feature_extractor();
+    const image_scanner_type::pyramid_type pyr;
+
+    const long rows = dlib::get_rect(img).height();
+    const long cols = dlib::get_rect(img).width();
+    const long stride = grid.coreCells * cellSize;
+    const long margin = grid.marginCells * cellSize;
+    const long tileRows = std::max(1L, (rows + stride - 1) / stride);
+    const long tileCols = std::max(1L, (cols + stride - 1) / stride);
+    const long numTiles = tileRows * tileCols;
+
+    std::atomic<long> nextTile(0);
+    std::mutex mutex;
+    std::exception_ptr error;
+
+    // Each lane takes the next unscanned tile until there are none left.
+    // Nothing may escape a lane, since an exception leaving a helper thread
+    // ends the process.
+    auto lane = [&](DetectionScratch& laneScratch) {
+      try {
+        std::vector<std::vector<TileCandidate> > found(detector.num_detectors());
+        DetectionTimings::Level spent;
+        StageClock clock(timing != NULL);
+        if (laneScratch.feats.size() == 0) {
+          laneScratch.feats.set_max_size(1);
+          laneScratch.feats.set_size(1);
+        }
+        dlib::array<dlib::array2d<float> >& feats = laneScratch.feats[0];
+
+        for (long t = nextTile++; t < numTiles; t = nextTile++) {
+          if (control) {
+            control->Check();
+          }
+
+          const long tileRow = t / tileCols;
+          const long tileCol = t % tileCols;
+          const dlib::rectangle context(std::max(0L, tileCol * stride - margin),
+                                        std::max(0L, tileRow * stride - margin),
+                                        std::min(cols, (tileCol + 1) * stride + margin) - 1,
+                                        std::min(rows, (tileRow + 1) * stride + margin) - 1);
+          const long rowOffset = context.top() / cellSize;
+          const long colOffset = context.left() / cellSize;
+
+          TraceScope trace("tile", "level", level);
+          clock.Lap();
+          {
+            TraceScope trace("fhog", "level", level);
+            fe(dlib::sub_image(img, context), feats, cellSize, windowHeight, windowWidth);
+          }
+          spent.fhog += clock.Lap();
+
+          for (unsigned long i = 0; i < detector.num_detectors(); ++i) {
+            const dlib::processed_weight_vector<image_scanner_type>& w = detector.get_processed_w(i);
+            const double thresh = w.w(scanner.get_num_dimensions());
+
+            dlib::rectangle area;
+            {
+              TraceScope trace("filter", "level", level);
+              area = dlib::impl::apply_filters_to_fhog(w.get_detect_argument(), feats, laneScratch.saliency);
+            }
+            spent.filter += clock.Lap();
+
+            for (long r = area.top(); r <= area.bottom(); ++r) {
+              for (long c = area.left(); c <= area.right(); ++c) {
+                if (laneScratch.saliency[r][c] >= thresh + adjustThreshold) {
+                  // The window as the whole image scan maps it, from where it
+                  // is in the features of the whole level.
+                  TileCandidate candidate;
+                  candidate.level = level;
+                  candidate.row = r + rowOffset;
+                  candidate.col = c + colOffset;
+                  const dlib::rectangle box = fe.feats_to_image(
+                      dlib::centered_rect(dlib::point(candidate.col, candidate.row), boxWidth, boxHeight), cellSize,
+                      windowHeight, windowWidth);
+
+                  // Windows in the margin belong to the neighbouring tile,
+                  // and windows off the edge of the level to the tile at
+                  // that edge.
+                  const dlib::point middle = dlib::center(box);
+                  if (std::min(std::max(middle.y(), 0L), rows - 1) / stride != tileRow ||
+                      std::min(std::max(middle.x(), 0L), cols - 1) / stride != tileCol) {
+                    continue;
+                  }
+
+                  candidate.score = laneScratch.saliency[r][c];
+                  candidate.rect = pyr.rect_up(box, level);
+                  found[i].push_back(candidate);
+                }
+              }
+            }
+            spent.threshold += clock.Lap();
+          }
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        for (unsigned long i = 0; i < found.size(); ++i) {
+          candidates[i].insert(candidates[i].end(), found[i].begin(), found[i].end());
+        }
+        if (timing) {
+          timing->fhog += spent.fhog;
+          timing->filter += spent.filter;
+          timing->threshold += spent.threshold;
+        }
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!error) {
+          error = std::current_exception();
+        }
+        // Stops the other lanes after their current tile.
+        nextTile = numTiles;
+      }
+    };
+
+    // The helpers are threads of their own, outside the libuv pool, so the
+    // scheduler's concurrency doesn't bound them: every job scanning in tiles
+    // adds up to threads - 1 of them. If no more threads can be started, the
+    // tiles are scanned by the lanes that did start, the calling thread at
+    // least. The room is reserved first so that pushing a started thread
+    // can't throw and leave it unjoined.
+    std::vector<std::thread> helpers;
+    const long lanes = std::min<long>(std::max(1U, threads), numTiles);
+    try {
+      helpers.reserve(lanes - 1);
+      for (long i = 1; i < lanes; ++i) {
+        helpers.push_back(std::thread([&lane]() {
+          DetectionScratch laneScratch;
+          lane(laneScratch);
+        }));
+      }
+    } catch (const std::exception&) {
+    }
+    lane(scratch);
+    for (size_t i = 0; i < helpers.size(); ++i) {
+      helpers[i].join();
+    }
+
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+
+  // Gives the same detections as Detect(), while holding the features of at
+  // most threads tiles of grid at once rather than those of the whole
+  // pyramid. The pyramid levels are built one after the other from the whole
+  // image as in Detect(), and each is scanned in tiles on up to threads
+  // threads. The candidates of all tiles are then sorted and suppressed as in
+  // Detect(). Timings of the stages run in tiles are summed over the threads.
+  template <typename image_type>
+  void DetectTiled(const object_detector_type& detector, const image_type& img, double adjustThreshold,
+                   const TileGrid& grid, unsigned int threads, DetectionScratch& scratch,
+                   std::vector<dlib::rect_detection>& dets, const JobControl* control = NULL,
+                   DetectionTimings* timings = NULL) {
+    const image_scanner_type& scanner = detector.get_scanner();
+    image_scanner_type::pyramid_type pyr;
+    const unsigned long levels = PyramidLevels(scanner, dlib::get_rect(img));
+
+    std::vector<std::vector<TileCandidate> > candidates(detector.num_detectors());
+    StageClock clock(timings != NULL);
+    if (timings) {
+      timings->levels.assign(levels, DetectionTimings::Level());
+      timings->levels[0].width = dlib::get_rect(img).width();
+      timings->levels[0].height = dlib::get_rect(img).height();
+    }
+
+    ScanTiles(detector, img, 0, grid, adjustThreshold, threads, scratch, candidates, control,
+              timings ? &timings->levels[0] : NULL);
+
+    typedef typename dlib::image_traits<image_type>::pixel_type pixel_type;
+    dlib::array2d<pixel_type> temp1, temp2;
+    for (unsigned long l = 1; l < levels; ++l) {
+      if (control) {
+        control->Check();
+      }
+      clock.Lap();
+      {
+        TraceScope trace("pyramid", "level", l);
+        if (l == 1) {
+          pyr(img, temp1);
+        } else {
+          pyr(temp2, temp1);
+        }
+      }
+      if (timings) {
+        timings->levels[l].pyramid = clock.Lap();
+        timings->levels[l].width = temp1.nc();
+        timings->levels[l].height = temp1.nr();
+      }
+
+      ScanTiles(detector, temp1, l, grid, adjustThreshold, threads, scratch, candidates, control,
+                timings ? &timings->levels[l] : NULL);
+      swap(temp1, temp2);
+    }
+
+    clock.Lap();
+    uint64_t numCandidates = 0;
+    std::vector<dlib::rect_detection> accum;
+    for (unsigned long i = 0; i < detector.num_detectors(); ++i) {
+      // Back in the order of a whole image scan, which decides the order of
+      // candidates with equal scores.
+      std::sort(candidates[i].begin(), candidates[i].end());
+      scratch.candidates.resize(candidates[i].size());
+      for (unsigned long j = 0; j < candidates[i].size(); ++j) {
+        scratch.candidates[j] = std::make_pair(candidates[i][j].score, candidates[i][j].rect);
+      }
+
+      numCandidates += candidates[i].size();
+      const double thresh = detector.get_processed_w(i).w(scanner.get_num_dimensions());
+      AppendCandidates(scratch.candidates, thresh, i, accum);
+    }
+
+    {
+      TraceScope trace("nms");
+      SuppressOverlaps(detector, accum, dets);
+    }
+
+    if (timings) {
+      timings->nms = clock.Lap();
+      timings->pyramid = timings->fhog = timings->filter = timings->threshold = 0;
+      for (unsigned long l = 0; l < levels; ++l) {
+        timings->pyramid += timings->levels[l].pyramid;
+        timings->fhog += timings->levels[l].fhog;
+        timings->filter += timings->levels[l].filter;
+        timings->threshold += timings->levels[l].threshold;
+      }
+      timings->candidates = numCandidates;
+      timings->detections = dets.size();
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,188 @@
+// trace
+#include "trace.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+namespace ObjectDetector {
+
+  std::atomic<bool> Tracer::enabled(false);
+
+  struct TraceEvent {
+    const char* name;
+    const char* argName;
+    int64_t arg;
+    uint64_t start;
+    uint64_t end;
+  };
+
+  // The events of one thread. The thread only contends for the mutex with
+  // Start() and Dump().
+  struct TraceBuffer {
+    std::mutex mutex;
+    std::vector<TraceEvent> events;
+    size_t next;
+    bool wrapped;
+    uint32_t tid;
+    std::string threadName;
+  };
+
+  struct TraceState {
+    TraceState() : eventsPerThread(0), origin(0), nextTid(1) {
+    }
+
+    std::mutex mutex;
+    std::vector<std::shared_ptr<TraceBuffer> > buffers;
+    size_t eventsPerThread;
+    uint64_t origin;
+    uint32_t nextTid;
+  };
+
+  // Never destroyed, so that threads still recording while the process exits
+  // don't touch freed memory.
+  static TraceState& State() {
+    static TraceState* state = new TraceState();
+    return *state;
+  }
+
+  // Held by the thread and by the state, so a thread's events outlive it
+  // until the next Start().
+  static thread_local std::shared_ptr<TraceBuffer> threadBuffer;
+
+  uint64_t Tracer::Now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  void Tracer::Start(size_t eventsPerThread) {
+    TraceState& state = State();
+    std::lock_guard<std::mutex> lock(state.mutex);
+
+    enabled = false;
+    std::vector<std::shared_ptr<TraceBuffer> > live;
+    for (size_t i = 0; i < state.buffers.size(); ++i) {
+      // Buffers only the state holds belong to threads that have exited.
+      if (state.buffers[i].use_count() > 1) {
+        TraceBuffer& buffer = *state.buffers[i];
+        std::lock_guard<std::mutex> bufferLock(buffer.mutex);
+        buffer.events.assign(eventsPerThread, TraceEvent());
+        buffer.next = 0;
+        buffer.wrapped = false;
+        live.push_back(state.buffers[i]);
+      }
+    }
+    state.buffers.swap(live);
+    state.eventsPerThread = eventsPerThread;
+    state.origin = Now();
+    enabled = true;
+  }
+
+  void Tracer::Stop() {
+    enabled = false;
+  }
+
+  void Tracer::Record(const char* name, uint64_t start, uint64_t end, const char* argName, int64_t arg) {
+    if (!threadBuffer) {
+      std::shared_ptr<TraceBuffer> buffer = std::make_shared<TraceBuffer>();
+      buffer->next = 0;
+      buffer->wrapped = false;
+
+      char threadName[64] = "";
+      pthread_getname_np(pthread_self(), threadName, sizeof(threadName));
+      buffer->threadName = threadName;
+
+      TraceState& state = State();
+      std::lock_guard<std::mutex> lock(state.mutex);
+      buffer->tid = state.nextTid++;
+      buffer->events.assign(state.eventsPerThread, TraceEvent());
+      state.buffers.push_back(buffer);
+      threadBuffer = buffer;
+    }
+
+    TraceBuffer& buffer = *threadBuffer;
+    std::lock_guard<std::mutex> lock(buffer.mutex);
+    if (buffer.events.empty()) {
+      return;
+    }
+
+    TraceEvent& event = buffer.events[buffer.next];
+    event.name = name;
+    event.argName = argName;
+    event.arg = arg;
+    event.start = start;
+    event.end = end;
+    if (++buffer.next == buffer.events.size()) {
+      buffer.next = 0;
+      buffer.wrapped = true;
+    }
+  }
+
+  static std::string TraceJsonString(const std::string& value) {
+    std::string quoted = "\"";
+    for (size_t i = 0; i < value.size(); ++i) {
+      const unsigned char c = value[i];
+      if (c == '"' || c == '\\') {
+        quoted += '\\';
+        quoted += c;
+      } else if (c >= 0x20) {
+        quoted += c;
+      }
+    }
+    return quoted + "\"";
+  }
+
+  // Trace Event Format timestamps are in microseconds.
+  static std::string TraceMicroseconds(uint64_t nanoseconds) {
+    char microseconds[32];
+    snprintf(microseconds, sizeof(microseconds), "%.3f", nanoseconds / 1e3);
+    return microseconds;
+  }
+
+  std::string Tracer::Dump() {
+    TraceState& state = State();
+    std::lock_guard<std::mutex> lock(state.mutex);
+
+    const int pid = getpid();
+    std::ostringstream out;
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+    bool first = true;
+    for (size_t b = 0; b < state.buffers.size(); ++b) {
+      TraceBuffer& buffer = *state.buffers[b];
+      std::lock_guard<std::mutex> bufferLock(buffer.mutex);
+
+      const std::string threadName = buffer.threadName.empty() ? "thread" : buffer.threadName;
+      out << (first ? "" : ",") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":"
+          << buffer.tid << ",\"args\":{\"name\":" << TraceJsonString(threadName) << "}}";
+      first = false;
+
+      const size_t count = buffer.wrapped ? buffer.events.size() : buffer.next;
+      const size_t oldest = buffer.wrapped ? buffer.next : 0;
+      for (size_t i = 0; i < count; ++i) {
+        const TraceEvent& event = buffer.events[(oldest + i) % buffer.events.size()];
+        // Scopes that were already open when the trace started.
+        if (event.start < state.origin) {
+          continue;
+        }
+
+        out << ",{\"name\":\"" << event.name << "\",\"cat\":\"object-detector\",\"ph\":\"X\",\"ts\":"
+            << TraceMicroseconds(event.start - state.origin) << ",\"dur\":"
+            << TraceMicroseconds(event.end - event.start) << ",\"pid\":" << pid << ",\"tid\":" << buffer.tid;
+        if (event.argName) {
+          out << ",\"args\":{\"" << event.argName << "\":" << event.arg << "}";
+        }
+        out << "}";
+      }
+    }
+
+    out << "]}";
+    return out.str();
+  }
+}
@@ -0,0 +1,67 @@
+// trace.h
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <string>
+
+namespace ObjectDetector {
+  // Records what the addon's threads do, for chrome://tracing or Perfetto.
+  // Every thread writes its events to a ring buffer of its own, which keeps
+  // the latest eventsPerThread of them. While tracing is off, a TraceScope
+  // costs one relaxed atomic load.
+  class Tracer {
+   public:
+    // Starts a new trace, dropping every event recorded so far.
+    static void Start(size_t eventsPerThread);
+    // Stops recording. The events recorded stay available to Dump().
+    static void Stop();
+
+    static bool IsEnabled() {
+      return enabled.load(std::memory_order_relaxed);
+    }
+
+    // The events recorded since Start() as a Trace Event Format JSON
+    // document, oldest first on every thread. Safe to call while tracing.
+    static std::string Dump();
+
+    // Records an event from start to end, in Now() nanoseconds. name and
+    // argName are kept as pointers, so they must be string literals. argName
+    // may be NULL for an event without an argument.
+    static void Record(const char* name, uint64_t start, uint64_t end, const char* argName, int64_t arg);
+
+    static uint64_t Now();
+
+   private:
+    static std::atomic<bool> enabled;
+  };
+
+  // Records an event spanning the lifetime of the scope, if tracing was on
+  // when it started.
+  class TraceScope {
+   public:
+    explicit TraceScope(const char* name, const char* argName = NULL, int64_t arg = 0)
+      : name(Tracer::IsEnabled() ? name : NULL), argName(argName), arg(arg), start(this->name ? Tracer::Now() : 0) {
+    }
+
+    ~TraceScope() {
+      if (name) {
+        Tracer::Record(name, start, Tracer::Now(), argName, arg);
+      }
+    }
+
+   private:
+    TraceScope(const TraceScope&);
+    TraceScope& operator=(const TraceScope&);
+
+    const char* name;
+    const char* argName;
+    int64_t arg;
+    uint64_t start;
+  };
+}
+
+#endif
@@ -0,0 +1,84 @@
+// training
+#include "training.h"
+
+namespace ObjectDetector {
+
+  using v8::Function;
+  using v8::HandleScope;
+  using v8::Isolate;
+  using v8::Local;
+  using v8::Number;
+  using v8::Object;
+  using v8::String;
+  using v8::Value;
+
+  TrainingWorker::TrainingWorker(Isolate* isolate, Local<Value> onProgress)
+    : AsyncWorker(isolate), start(std::chrono::steady_clock::now()), updated(false) {
+    if (onProgress->IsFunction()) {
+      this->onProgress.Reset(isolate, onProgress.As<Function>());
+      EnableProgress();
+    }
+  }
+
+  TrainingWorker::~TrainingWorker() {
+    onProgress.Reset();
+  }
+
+  void TrainingWorker::StartClock() {
+    start = std::chrono::steady_clock::now();
+  }
+
+  TrainingReporter TrainingWorker::Reporter() {
+    return [this](const TrainingStatus& status) {
+      Report(status);
+    };
+  }
+
+  void TrainingWorker::Report(const TrainingStatus& status) {
+    // Stop at the next report, so a cancelled or expired job doesn't train to
+    // the end.
+    Control().Check();
+
+    if (onProgress.IsEmpty()) {
+      return;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(statusMutex);
+      this->status = status;
+      this->status.elapsed = std::chrono::duration<double, std::milli>(
+          std::chrono::steady_clock::now() - start).count();
+      updated = true;
+    }
+    NotifyProgress();
+  }
+
+  void TrainingWorker::HandleProgress() {
+    TrainingStatus latest;
+    {
+      std::lock_guard<std::mutex> lock(statusMutex);
+      if (!updated) {
+        return;
+      }
+      latest = status;
+      updated = false;
+    }
+
+    HandleScope scope(isolate);
+    Local<Object> event = Object::New(isolate);
+    event->Set(String::NewFromUtf8(isolate, "iteration"), Number::New(isolate, latest.iteration));
+    if (latest.iterations > 0) {
+      event->Set(String::NewFromUtf8(isolate, "iterations"), Number::New(isolate, latest.iterations));
+    }
+    if (latest.riskGap >= 0) {
+      event->Set(String::NewFromUtf8(isolate, "riskGap"), Number::New(isolate, latest.riskGap));
+    }
+    event->Set(String::NewFromUtf8(isolate, "samplesProcessed"), Number::New(isolate, latest.samplesProcessed));
+    event->Set(String::NewFromUtf8(isolate, "elapsed"), Number::New(isolate, latest.elapsed));
+
+    const int argc = 1;
+    Local<Value> argv[argc] = { event };
+    node::MakeCallback(isolate, isolate->GetCurrentContext()->Global(), Local<Function>::New(isolate, onProgress),
+                       argc, argv);
+  }
+}
@@ -0,0 +1,63 @@
+// training.h
+#ifndef TRAINING_H
+#define TRAINING_H
+
+#include <node.h>
+
+#include <chrono>
+#include <functional>
+#include <mutex>
+
+#include "worker.h"
+
+namespace ObjectDetector {
+  // How far a training run has got.
+  struct TrainingStatus {
+    TrainingStatus() : iteration(0), iterations(0), riskGap(-1), samplesProcessed(0), elapsed(0) {
+    }
+
+    // Optimizer iterations for detectors, trees fit for shape predictors.
+    unsigned long iteration;
+    // Total number of iterations if known in advance, otherwise 0.
+    unsigned long iterations;
+    // Risk gap of the detector's SVM; training converges once it drops below
+    // epsilon. Negative for trainers that don't have one.
+    double riskGap;
+    // Training samples evaluated so far, counting every pass over the set.
+    unsigned long samplesProcessed;
+    // Milliseconds since training started.
+    double elapsed;
+  };
+
+  // Called by the trainers as they make progress, on whichever thread they
+  // run on. May throw to stop training.
+  typedef std::function<void(const TrainingStatus&)> TrainingReporter;
+
+  // Runs a training job on the thread pool. If an onProgress function was
+  // given it is called on the main thread as onProgress(status) with the
+  // latest status; updates arriving faster than that are coalesced.
+  // Execute() should call StartClock() first and pass Reporter() to the
+  // trainer.
+  class TrainingWorker : public AsyncWorker {
+   public:
+    TrainingWorker(v8::Isolate* isolate, v8::Local<v8::Value> onProgress);
+    ~TrainingWorker();
+
+   protected:
+    void StartClock();
+    TrainingReporter Reporter();
+    void HandleProgress();
+
+   private:
+    void Report(const TrainingStatus& status);
+
+    v8::Persistent<v8::Function> onProgress;
+    std::chrono::steady_clock::time_point start;
+
+    std::mutex statusMutex;
+    TrainingStatus status;
+    bool updated;
+  };
+}
+
+#endif
@@ -0,0 +1,258 @@
+// worker
+#include "worker.h"
+#include "scheduler.h"
+#include "trace.h"
+
+#include <stdexcept>
+
+namespace ObjectDetector {
+
+  using v8::Exception;
+  using v8::External;
+  using v8::Function;
+  using v8::FunctionCallbackInfo;
+  using v8::FunctionTemplate;
+  using v8::HandleScope;
+  using v8::Isolate;
+  using v8::Local;
+  using v8::Null;
+  using v8::Object;
+  using v8::Promise;
+  using v8::String;
+  using v8::Undefined;
+  using v8::Value;
+
+  AsyncWorker::AsyncWorker(Isolate* isolate) : isolate(isolate), pending(0), priority(0), progress(false) {
+    HandleScope scope(isolate);
+    persistentHandle.Reset(isolate, Object::New(isolate));
+  }
+
+  AsyncWorker::~AsyncWorker() {
+    persistentHandle.Reset();
+    callback.Reset();
+    resolver.Reset();
+    abortSignal.Reset();
+    abortListener.Reset();
+  }
+
+  void AsyncWorker::SaveToPersistent(uint32_t index, Local<Value> value) {
+    HandleScope scope(isolate);
+    Local<Object>::New(isolate, persistentHandle)->Set(index, value);
+  }
+
+  Local<Value> AsyncWorker::GetFromPersistent(uint32_t index) {
+    return Local<Object>::New(isolate, persistentHandle)->Get(index);
+  }
+
+  void AsyncWorker::SetJobOptions(Local<Value> value) {
+    if (value->IsUndefined() || !value->IsObject()) {
+      return;
+    }
+
+    Local<Object> options = value->ToObject();
+
+    Local<Value> optPriority = options->Get(String::NewFromUtf8(isolate, "priority"));
+    if (!optPriority->IsUndefined()) {
+      if (!optPriority->IsNumber()) {
+        throw std::invalid_argument("priority must be a number");
+      }
+      priority = optPriority->IntegerValue();
+    }
+
+    Local<Value> optDeadline = options->Get(String::NewFromUtf8(isolate, "deadline"));
+    if (!optDeadline->IsUndefined()) {
+      if (!optDeadline->IsNumber() && !optDeadline->IsDate()) {
+        throw std::invalid_argument("deadline must be a number or a Date");
+      }
+      control.SetDeadline(optDeadline->NumberValue());
+    }
+
+    Local<Value> optSignal = options->Get(String::NewFromUtf8(isolate, "signal"));
+    if (!optSignal->IsUndefined()) {
+      if (!optSignal->IsObject()) {
+        throw std::invalid_argument("signal must be an AbortSignal");
+      }
+
+      Local<Object> signal = optSignal->ToObject();
+      if (signal->Get(String::NewFromUtf8(isolate, "aborted"))->BooleanValue()) {
+        control.Cancel();
+        return;
+      }
+
+      Local<Value> addEventListener = signal->Get(String::NewFromUtf8(isolate, "addEventListener"));
+      if (!addEventListener->IsFunction()) {
+        throw std::invalid_argument("signal must be an AbortSignal");
+      }
+
+      Local<Function> listener = FunctionTemplate::New(isolate, OnAbort, External::New(isolate, this))->GetFunction();
+      const int argc = 2;
+      Local<Value> argv[argc] = { String::NewFromUtf8(isolate, "abort"), listener };
+      addEventListener.As<Function>()->Call(signal, argc, argv);
+
+      abortSignal.Reset(isolate, signal);
+      abortListener.Reset(isolate, listener);
+    }
+  }
+
+  void AsyncWorker::OnAbort(const FunctionCallbackInfo<Value>& args) {
+    AsyncWorker* worker = static_cast<AsyncWorker*>(args.Data().As<External>()->Value());
+    // Running lanes notice at their next check; queued ones never start.
+    worker->control.Cancel();
+    worker->Fail(JobError::Aborted());
+    Scheduler::Get(worker->isolate)->Cancel(worker);
+  }
+
+  void AsyncWorker::EnableProgress() {
+    progress = true;
+  }
+
+  void AsyncWorker::NotifyProgress() {
+    if (progress) {
+      uv_async_send(&progressHandle);
+    }
+  }
+
+  Local<Value> AsyncWorker::Queue(Local<Value> cb, unsigned int parallelism) {
+    Local<Value> returnValue = Undefined(isolate);
+    if (cb->IsFunction()) {
+      callback.Reset(isolate, cb.As<Function>());
+    } else {
+      Local<Promise::Resolver> res = Promise::Resolver::New(isolate);
+      resolver.Reset(isolate, res);
+      returnValue = res->GetPromise();
+    }
+
+    if (progress) {
+      progressHandle.data = this;
+      uv_async_init(node::GetCurrentEventLoop(isolate), &progressHandle, DoProgress);
+    }
+
+    requests.resize(parallelism > 0 ? parallelism : 1);
+    pending = requests.size();
+    for (unsigned int i = 0; i < requests.size(); ++i) {
+      requests[i].data = this;
+    }
+
+    Scheduler::Get(isolate)->Submit(this, priority);
+    return returnValue;
+  }
+
+  void AsyncWorker::Run(uv_work_t* request) {
+    uv_queue_work(node::GetCurrentEventLoop(isolate), request, DoExecute, AfterExecute);
+  }
+
+  void AsyncWorker::DoExecute(uv_work_t* request) {
+    AsyncWorker* worker = static_cast<AsyncWorker*>(request->data);
+    TraceScope trace("job");
+    try {
+      // The job may have waited in the pool's own queue since it was started.
+      worker->control.Check();
+      worker->Execute();
+    } catch (JobError& e) {
+      worker->Fail(e);
+    } catch (std::exception& e) {
+      std::lock_guard<std::mutex> lock(worker->errorMutex);
+      if (worker->error.empty()) {
+        worker->error = e.what();
+        if (worker->error.empty()) {
+          worker->error = "Unknown error";
+        }
+      }
+    }
+  }
+
+  void AsyncWorker::Fail(const JobError& jobError) {
+    std::lock_guard<std::mutex> lock(errorMutex);
+    if (error.empty()) {
+      error = jobError.what();
+      errorName = jobError.name;
+      errorCode = jobError.code;
+    }
+  }
+
+  void AsyncWorker::DoProgress(uv_async_t* handle) {
+    AsyncWorker* worker = static_cast<AsyncWorker*>(handle->data);
+    HandleScope scope(worker->isolate);
+    worker->HandleProgress();
+  }
+
+  void AsyncWorker::AfterExecute(uv_work_t* request, int status) {
+    AsyncWorker* worker = static_cast<AsyncWorker*>(request->data);
+    Scheduler* scheduler = Scheduler::Get(worker->isolate);
+    worker->LaneDone();
+    scheduler->Finished();
+  }
+
+  void AsyncWorker::LaneDone() {
+    if (--pending > 0) {
+      return;
+    }
+
+    Settle();
+  }
+
+  void AsyncWorker::Settle() {
+    HandleScope scope(isolate);
+
+    if (!abortSignal.IsEmpty()) {
+      Local<Object> signal = Local<Object>::New(isolate, abortSignal);
+      Local<Value> removeEventListener = signal->Get(String::NewFromUtf8(isolate, "removeEventListener"));
+      if (removeEventListener->IsFunction()) {
+        const int argc = 2;
+        Local<Value> argv[argc] = { String::NewFromUtf8(isolate, "abort"),
+                                    Local<Function>::New(isolate, abortListener) };
+        removeEventListener.As<Function>()->Call(signal, argc, argv);
+      }
+    }
+
+    if (progress) {
+      HandleProgress();
+    }
+
+    Local<Value> result = Undefined(isolate);
+    if (error.empty()) {
+      try {
+        result = Result();
+      } catch (std::exception& e) {
+        error = e.what();
+      }
+    }
+
+    Local<Value> err = Null(isolate);
+    if (!error.empty()) {
+      err = Exception::Error(String::NewFromUtf8(isolate, error.c_str()));
+      if (!errorCode.empty()) {
+        Local<Object> errObj = err->ToObject();
+        errObj->Set(String::NewFromUtf8(isolate, "name"), String::NewFromUtf8(isolate, errorName.c_str()));
+        errObj->Set(String::NewFromUtf8(isolate, "code"), String::NewFromUtf8(isolate, errorCode.c_str()));
+      }
+    }
+
+    if (!callback.IsEmpty()) {
+      const int argc = 2;
+      Local<Value> argv[argc] = { err, result };
+      Local<Function> cb = Local<Function>::New(isolate, callback);
+      node::MakeCallback(isolate, isolate->GetCurrentContext()->Global(), cb, argc, argv);
+    } else {
+      Local<Promise::Resolver> res = Local<Promise::Resolver>::New(isolate, resolver);
+      if (error.empty()) {
+        res->Resolve(result);
+      } else {
+        res->Reject(err);
+      }
+      isolate->RunMicrotasks();
+    }
+
+    if (progress) {
+      // The handle is owned by this worker, so it can only go once libuv is
+      // done with it.
+      uv_close(reinterpret_cast<uv_handle_t*>(&progressHandle), AfterClose);
+    } else {
+      delete this;
+    }
+  }
+
+  void AsyncWorker::AfterClose(uv_handle_t* handle) {
+    delete static_cast<AsyncWorker*>(handle->data);
+  }
+}
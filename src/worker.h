@@ -0,0 +1,102 @@
+// worker.h
+#ifndef WORKER_H
+#define WORKER_H
+
+#include <node.h>
+#include <uv.h>
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "job_control.h"
+
+namespace ObjectDetector {
+  // Runs Execute() on the libuv thread pool and settles either a node-style
+  // callback or a Promise with the value of Result() back on the main thread.
+  // When it runs is up to the Scheduler.
+  class AsyncWorker {
+   public:
+    explicit AsyncWorker(v8::Isolate* isolate);
+    virtual ~AsyncWorker();
+
+    // Queues the work. If callback is a function it is called as
+    // callback(err, result) and undefined is returned, otherwise a Promise is
+    // returned. With a parallelism above one, Execute() is run that many times
+    // concurrently and the worker settles once every run has returned. The
+    // worker deletes itself once it has settled.
+    v8::Local<v8::Value> Queue(v8::Local<v8::Value> callback, unsigned int parallelism = 1);
+
+    // Reads the scheduling options of a call, before Queue():
+    //   priority: jobs with higher priority start first, default 0
+    //   signal:   an AbortSignal that cancels the job
+    //   deadline: time in ms since the epoch after which the job is dropped
+    //             if it hasn't started, or stopped if it has
+    // Throws std::invalid_argument for values of the wrong type.
+    void SetJobOptions(v8::Local<v8::Value> options);
+
+    // Keeps a JS value (the wrapping object, a Buffer, ...) alive until the
+    // worker has settled.
+    void SaveToPersistent(uint32_t index, v8::Local<v8::Value> value);
+    v8::Local<v8::Value> GetFromPersistent(uint32_t index);
+
+   protected:
+    // Called on a thread pool thread; must not touch V8. Exceptions are
+    // reported to JS as an Error.
+    virtual void Execute() = 0;
+
+    // Called on the main thread inside a HandleScope once Execute() succeeded.
+    virtual v8::Local<v8::Value> Result() = 0;
+
+    // Execute() should call Control().Check() wherever it can stop early.
+    const JobControl& Control() const { return control; }
+
+    // Must be called before Queue() by workers that report progress.
+    void EnableProgress();
+
+    // May be called from Execute(); schedules HandleProgress() on the main
+    // thread. Notifications can be coalesced, and HandleProgress() is called
+    // once more before the worker settles, so it should drain whatever state
+    // Execute() has produced so far.
+    void NotifyProgress();
+    virtual void HandleProgress() {}
+
+    v8::Isolate* isolate;
+
+   private:
+    friend class Scheduler;
+
+    static void DoExecute(uv_work_t* request);
+    static void AfterExecute(uv_work_t* request, int status);
+    static void DoProgress(uv_async_t* handle);
+    static void AfterClose(uv_handle_t* handle);
+    static void OnAbort(const v8::FunctionCallbackInfo<v8::Value>& args);
+
+    void Run(uv_work_t* request);
+    void Fail(const JobError& jobError);
+    void LaneDone();
+    void Settle();
+
+    std::vector<uv_work_t> requests;
+    unsigned int pending;
+
+    int priority;
+    JobControl control;
+    v8::Persistent<v8::Object> abortSignal;
+    v8::Persistent<v8::Function> abortListener;
+
+    bool progress;
+    uv_async_t progressHandle;
+
+    std::mutex errorMutex;
+    std::string error;
+    std::string errorName;
+    std::string errorCode;
+
+    v8::Persistent<v8::Object> persistentHandle;
+    v8::Persistent<v8::Function> callback;
+    v8::Persistent<v8::Promise::Resolver> resolver;
+  };
+}
+
+#endif